@@ -148,6 +148,7 @@ testScripts = [
 ]
 if ENABLE_ZMQ:
     testScripts.append('zmq_test.py')
+    testScripts.append('zmq_addressindex.py')
 
 testScriptsExt = [
     'bip9-softforks.py',
@@ -13,6 +13,8 @@ from test_framework.util import *
 from test_framework.script import *
 from test_framework.mininode import *
 import binascii
+import http.client
+import urllib.parse
 
 class AddressIndexTest(BitcoinTestFramework):
 
@@ -24,7 +26,7 @@ class AddressIndexTest(BitcoinTestFramework):
         self.nodes = []
         # Nodes 0/1 are "wallet" nodes
         self.nodes.append(start_node(0, self.options.tmpdir, ["-debug", "-relaypriority=0"]))
-        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug", "-addressindex"]))
+        self.nodes.append(start_node(1, self.options.tmpdir, ["-debug", "-addressindex", "-rest"]))
         # Nodes 2/3 are used for testing
         self.nodes.append(start_node(2, self.options.tmpdir, ["-debug", "-addressindex", "-relaypriority=0"]))
         self.nodes.append(start_node(3, self.options.tmpdir, ["-debug", "-addressindex"]))
@@ -105,6 +107,71 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(multitxids[4], txid2)
         assert_equal(multitxids[5], txidb2)
 
+        # Check that txids and deltas can be paged with a limit and cursor
+        print("Testing paging of txids and deltas...")
+        page1 = self.nodes[1].getaddresstxids({"addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br"], "limit": 2})
+        assert_equal(page1["txids"], [txidb0, txidb1])
+        page2 = self.nodes[1].getaddresstxids({
+            "addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br"],
+            "limit": 2,
+            "cursor": page1["cursor"]
+        })
+        assert_equal(page2["txids"], [txidb2])
+        assert("cursor" not in page2)
+
+        deltas_page = self.nodes[1].getaddressdeltas({
+            "addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br", "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"],
+            "limit": 4
+        })
+        assert_equal(len(deltas_page["deltas"]), 4)
+        deltas_rest = self.nodes[1].getaddressdeltas({
+            "addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br", "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"],
+            "cursor": deltas_page["cursor"]
+        })
+        assert_equal(len(deltas_rest["deltas"]), 2)
+        assert_equal(deltas_rest["deltas"][0]["txid"], txid2)
+        assert_equal(deltas_rest["deltas"][1]["txid"], txidb2)
+
+        multi_page = self.nodes[1].getaddresstxids({
+            "addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br", "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"],
+            "limit": 3
+        })
+        assert_equal(multi_page["txids"], [txid0, txidb0, txid1])
+        multi_rest = self.nodes[1].getaddresstxids({
+            "addresses": ["2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br", "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"],
+            "cursor": multi_page["cursor"]
+        })
+        assert_equal(multi_rest["txids"], [txidb1, txid2, txidb2])
+
+        # Check the REST address endpoints
+        print("Testing REST address queries...")
+        url = urllib.parse.urlparse(self.nodes[1].url)
+        conn = http.client.HTTPConnection(url.hostname, url.port)
+        conn.request('GET', '/rest/address/2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br/txids.json')
+        assert_equal(json.loads(conn.getresponse().read().decode('utf-8')), [txidb0, txidb1, txidb2])
+
+        conn.request('GET', '/rest/address/2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br/txids/2.json')
+        response = conn.getresponse()
+        rest_cursor = response.getheader('X-Address-Cursor')
+        rest_page = json.loads(response.read().decode('utf-8'))
+        assert_equal(rest_page["txids"], [txidb0, txidb1])
+        assert_equal(rest_page["cursor"], rest_cursor)
+
+        conn.request('GET', '/rest/address/2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br/txids/2/' + rest_cursor + '.bin')
+        response = conn.getresponse()
+        assert_equal(response.getheader('X-Address-Cursor'), None)
+        rest_bin = response.read()
+        assert_equal(len(rest_bin), 36)
+        assert_equal(bytes_to_hex_str(rest_bin[31::-1]), txidb2)
+
+        conn.request('GET', '/rest/address/2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br/deltas.bin')
+        rest_bin = conn.getresponse().read()
+        assert_equal(len(rest_bin), 3 * (66 + 8))
+
+        conn.request('GET', '/rest/address/2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br/utxos.json')
+        rest_utxos = json.loads(conn.getresponse().read().decode('utf-8'))
+        assert_equal(len(rest_utxos), 3)
+
         # Check that balances are correct
         balance0 = self.nodes[1].getaddressbalance("2N2JD6wb56AfK4tfmM6PwdVmoYk2dCKf4Br")
         assert_equal(balance0["balance"], 45 * 100000000)
@@ -206,6 +273,13 @@ class AddressIndexTest(BitcoinTestFramework):
         balance4 = self.nodes[1].getaddressbalance(address2)
         assert_equal(balance4, balance1)
 
+        summary = self.nodes[1].getaddresssummary({"addresses": [address2]})
+        assert_equal(len(summary), 1)
+        assert_equal(summary[0]["balance"], balance1["balance"])
+        assert_equal(summary[0]["txcount"], 1)
+        assert_equal(summary[0]["firstheight"], 113)
+        assert_equal(summary[0]["lastheight"], 113)
+
         utxos2 = self.nodes[1].getaddressutxos({"addresses": [address2]})
         assert_equal(len(utxos2), 1)
         assert_equal(utxos2[0]["satoshis"], amount)
@@ -225,6 +299,18 @@ class AddressIndexTest(BitcoinTestFramework):
         assert_equal(utxos3[1]["height"], 264)
         assert_equal(utxos3[2]["height"], 265)
 
+        # Check filtering of utxos while scanning
+        utxos4 = self.nodes[1].getaddressutxos({"addresses": [address2], "start": 200})
+        assert_equal([utxo["height"] for utxo in utxos4], [264, 265])
+        utxos4 = self.nodes[1].getaddressutxos({"addresses": [address2], "minconf": 2})
+        assert_equal([utxo["height"] for utxo in utxos4], [114, 264])
+        utxos4 = self.nodes[1].getaddressutxos({"addresses": [address2], "minSatoshis": 5000000000})
+        assert_equal([utxo["height"] for utxo in utxos4], [264, 265])
+        utxos4 = self.nodes[1].getaddressutxos({"addresses": [address2], "limit": 2})
+        assert_equal([utxo["height"] for utxo in utxos4], [114, 264])
+        utxos4 = self.nodes[1].getaddressutxos({"addresses": [address2], "start": 200, "end": 264, "limit": 1})
+        assert_equal([utxo["height"] for utxo in utxos4], [264])
+
         # Check mempool indexing
         print("Testing mempool indexing...")
 
@@ -341,6 +427,21 @@ class AddressIndexTest(BitcoinTestFramework):
         expected_tip_block_hash = self.nodes[1].getblockhash(267);
         assert_equal(utxos_with_info["height"], 267)
         assert_equal(utxos_with_info["hash"], expected_tip_block_hash)
+        assert_equal(deltas_with_info["height"], 267)
+        assert_equal(deltas_with_info["hash"], expected_tip_block_hash)
+
+        balance_with_info = self.nodes[1].getaddressbalance({"addresses": [address2], "chainInfo": True})
+        assert_equal(balance_with_info["balance"], self.nodes[1].getaddressbalance(address2)["balance"])
+        assert_equal(balance_with_info["height"], 267)
+        assert_equal(balance_with_info["hash"], expected_tip_block_hash)
+
+        txids_with_info = self.nodes[1].getaddresstxids({"addresses": [address2], "chainInfo": True})
+        assert_equal(txids_with_info["txids"], self.nodes[1].getaddresstxids(address2))
+        assert_equal(txids_with_info["height"], 267)
+
+        summary_with_info = self.nodes[1].getaddresssummary({"addresses": [address2], "chainInfo": True})
+        assert_equal(summary_with_info["summaries"], self.nodes[1].getaddresssummary(address2))
+        assert_equal(summary_with_info["hash"], expected_tip_block_hash)
 
         print("Passed\n")
 
@@ -13,6 +13,7 @@ from test_framework.util import *
 from test_framework.script import *
 from test_framework.mininode import *
 import binascii
+import struct
 
 class SpentIndexTest(BitcoinTestFramework):
 
@@ -71,6 +72,20 @@ class SpentIndexTest(BitcoinTestFramework):
         assert_equal(info["index"], 0)
         assert_equal(info["height"], 106)
 
+        # A repeated lookup is answered from the spent index cache
+        cacheinfo = self.nodes[1].getspentindexcacheinfo()
+        info = self.nodes[1].getspentinfo({"txid": unspent[0]["txid"], "index": unspent[0]["vout"]})
+        assert_equal(info["txid"], txid)
+        assert_equal(self.nodes[1].getspentindexcacheinfo()["hits"], cacheinfo["hits"] + 1)
+
+        # Look up several outputs at once, in request order with null for unspent outputs
+        infos = self.nodes[1].getspentinfo([{"txid": txid, "index": 0}, {"txid": unspent[0]["txid"], "index": unspent[0]["vout"]}])
+        assert_equal(len(infos), 2)
+        assert_equal(infos[0], None)
+        assert_equal(infos[1]["txid"], txid)
+        assert_equal(infos[1]["index"], 0)
+        assert_equal(infos[1]["height"], 106)
+
         print("Testing getrawtransaction method...")
 
         # Check that verbose raw transaction includes spent info
@@ -134,6 +149,47 @@ class SpentIndexTest(BitcoinTestFramework):
         assert_equal(block["deltas"][1]["outputs"][0]["address"], "mgY65WSfEmsyYaYPQaXhmXMeBhwp4EcsQW")
         assert_equal(block["deltas"][1]["outputs"][0]["satoshis"], amount)
 
+        # Deltas are read from the undo data, so nodes without the spent index can return them
+        assert_equal(self.nodes[0].getblockdeltas(block_hash[0]), block)
+
+        print("Testing getblockdeltasrange...")
+
+        height = block["height"]
+        blocks = self.nodes[0].getblockdeltasrange(height - 1, height)
+        assert_equal(len(blocks), 2)
+        assert_equal(blocks[0]["hash"], block["previousblockhash"])
+        assert_equal(blocks[1], block)
+        assert_raises(JSONRPCException, self.nodes[0].getblockdeltasrange, height, height + 1)
+        assert_raises(JSONRPCException, self.nodes[0].getblockdeltasrange, 0, 100)
+
+        # Binary format
+        raw = hex_str_to_bytes(self.nodes[0].getblockdeltasrange(height, height, "hex"))
+        assert_equal(raw, hex_str_to_bytes(self.nodes[0].getblockdeltas(block_hash[0], "hex")))
+        assert_equal(bytes_to_hex_str(raw[0:32][::-1]), block_hash[0])
+        assert_equal(bytes_to_hex_str(raw[32:64][::-1]), block["previousblockhash"])
+        assert_equal(struct.unpack("<iI", raw[64:72]), (height, block["time"]))
+        assert_equal(raw[72], 2)
+        # the coinbase pays to a public key, so it has no deltas
+        assert_equal(raw[73 + 32:73 + 34], b"\x00\x00")
+        tx = raw[73 + 34:]
+        assert_equal(bytes_to_hex_str(tx[0:32][::-1]), txid2)
+        assert_equal(tx[32], 1)
+        index, addressType, addressHash, satoshis, prevtxid, prevout = struct.unpack("<IB20sq32sI", tx[33:102])
+        assert_equal((index, addressType, satoshis, prevout), (0, 1, (amount + feeSatoshis) * -1, 0))
+        assert_equal(bytes_to_hex_str(prevtxid[::-1]), txid)
+        assert_equal(tx[102], 1)
+        index, addressType, addressHash, satoshis = struct.unpack("<IB20sq", tx[103:136])
+        assert_equal((index, addressType, satoshis), (0, 1, amount))
+        assert_equal(len(tx), 136)
+
+        # A stale block is still served from its undo data, without confirmations
+        self.nodes[0].invalidateblock(block_hash[0])
+        stale = self.nodes[0].getblockdeltas(block_hash[0])
+        assert_equal(stale["confirmations"], -1)
+        assert_equal(stale["deltas"], block["deltas"])
+        self.nodes[0].reconsiderblock(block_hash[0])
+        assert_equal(self.nodes[0].getbestblockhash(), block_hash[0])
+
         print("Passed\n")
 
 
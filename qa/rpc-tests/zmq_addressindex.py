@@ -0,0 +1,83 @@
+#!/usr/bin/env python3
+# Copyright (c) 2016 The Bitcoin Core developers
+# Distributed under the MIT software license, see the accompanying
+# file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#
+# Test the ZMQ address index notifications
+#
+
+from test_framework.test_framework import BitcoinTestFramework
+from test_framework.util import *
+import zmq
+import struct
+
+class ZMQAddressIndexTest (BitcoinTestFramework):
+
+    def __init__(self):
+        super().__init__()
+        self.num_nodes = 1
+
+    port = 28332
+    address = "mo9ncXisMeAoXwqcV5EWuyncbmCcQN4rVs"
+    addressHash = "53c0307d6851aa0ce7825ba883c6bd9ad242b486"
+
+    def setup_network(self):
+        # subscribe to a single p2pkh address
+        self.topic = b"addresstx" + bytes([1]) + hex_str_to_bytes(self.addressHash)
+        self.zmqContext = zmq.Context()
+        self.zmqSubSocket = self.zmqContext.socket(zmq.SUB)
+        self.zmqSubSocket.setsockopt(zmq.SUBSCRIBE, self.topic)
+        self.zmqSubSocket.setsockopt(zmq.RCVTIMEO, 60000)
+        self.zmqSubSocket.connect("tcp://127.0.0.1:%i" % self.port)
+        self.nodes = start_nodes(self.num_nodes, self.options.tmpdir, extra_args=[
+            ['-addressindex', '-zmqpubaddresstx=tcp://127.0.0.1:'+str(self.port)],
+            ])
+        self.is_network_split = False
+
+    def receive(self):
+        msg = self.zmqSubSocket.recv_multipart()
+        assert_equal(msg[0], self.topic)
+        body = msg[1]
+        event = body[0]
+        txid = bytes_to_hex_str(body[1:33][::-1])
+        height = struct.unpack('<i', body[33:37])[0]
+        count = body[37]
+        records = []
+        for i in range(count):
+            record = body[38 + 13 * i:38 + 13 * (i + 1)]
+            records.append(struct.unpack('<IBq', record))
+        assert_equal(len(body), 38 + 13 * count)
+        return event, txid, height, records
+
+    def run_test(self):
+        self.nodes[0].generate(101)
+
+        txid = self.nodes[0].sendtoaddress(self.address, 10)
+        vout = [o["n"] for o in self.nodes[0].getrawtransaction(txid, 1)["vout"] if o["value"] == 10][0]
+
+        # accepted to the mempool
+        event, txidZMQ, height, records = self.receive()
+        assert_equal(event, 0)
+        assert_equal(txidZMQ, txid)
+        assert_equal(height, -1)
+        assert_equal(records, [(vout, 0, 1000000000)])
+
+        # connected in a block
+        blockhash = self.nodes[0].generate(1)[0]
+        event, txidZMQ, height, records = self.receive()
+        assert_equal(event, 1)
+        assert_equal(txidZMQ, txid)
+        assert_equal(height, 102)
+        assert_equal(records, [(vout, 0, 1000000000)])
+
+        # disconnected again
+        self.nodes[0].invalidateblock(blockhash)
+        event, txidZMQ, height, records = self.receive()
+        assert_equal(event, 2)
+        assert_equal(txidZMQ, txid)
+        assert_equal(height, 102)
+        assert_equal(records, [(vout, 0, 1000000000)])
+
+if __name__ == '__main__':
+    ZMQAddressIndexTest ().main ()
@@ -95,6 +95,17 @@ class ZMQTest (BitcoinTestFramework):
 
         assert_equal(hashRPC, hashZMQ) #blockhash from generate must be equal to the hash received over zmq
 
+        # all notifications were published
+        info = self.nodes[0].getzmqqueueinfo()
+        assert_equal(info["queued"], 0)
+        assert_equal(info["droppolicy"], "newest")
+        assert_equal(len(info["notifiers"]), 2)
+        for notifier in info["notifiers"]:
+            assert_equal(notifier["address"], "tcp://127.0.0.1:"+str(self.port))
+            assert_equal(notifier["dropped"], 0)
+            assert_equal(notifier["failed"], 0)
+        assert_raises(JSONRPCException, self.nodes[1].getzmqqueueinfo)
+
 
 if __name__ == '__main__':
     ZMQTest ().main ()
@@ -8,8 +8,32 @@
 
 #include "uint256.h"
 #include "amount.h"
+#include "primitives/transaction.h"
 #include "script/script.h"
 
+#include <limits>
+#include <utility>
+#include <vector>
+
+/**
+ * Get the address index type (1 for pay-to-pubkey-hash, 2 for pay-to-script-hash)
+ * and hash of an output script, reading the hash in place.
+ * @return false if the script is not indexed
+ */
+inline bool GetScriptAddressIndexKey(const CScript &script, uint160 &hashBytes, int &type)
+{
+    if (script.IsPayToScriptHash()) {
+        memcpy(hashBytes.begin(), &script[2], 20);
+        type = 2;
+    } else if (script.IsPayToPublicKeyHash()) {
+        memcpy(hashBytes.begin(), &script[3], 20);
+        type = 1;
+    } else {
+        return false;
+    }
+    return true;
+}
+
 struct CAddressUnspentKey {
     unsigned int type;
     uint160 hashBytes;
@@ -88,6 +112,43 @@ struct CAddressUnspentValue {
     }
 };
 
+/** Conditions on unspent outputs, evaluated while scanning the address unspent index */
+struct CAddressUnspentFilter {
+    int minHeight;
+    int maxHeight;
+    CAmount minSatoshis;
+    //! Keep at most this many outputs of the lowest heights (0 for no limit)
+    size_t nLimit;
+
+    CAddressUnspentFilter() {
+        SetNull();
+    }
+
+    void SetNull() {
+        minHeight = 0;
+        maxHeight = std::numeric_limits<int>::max();
+        minSatoshis = 0;
+        nLimit = 0;
+    }
+
+    bool Match(const CAddressUnspentValue &value) const {
+        return value.blockHeight >= minHeight && value.blockHeight <= maxHeight && value.satoshis >= minSatoshis;
+    }
+};
+
+/** Order unspent outputs by height, then outpoint */
+struct CAddressUnspentHeightCompare
+{
+    bool operator()(const std::pair<CAddressUnspentKey, CAddressUnspentValue> &a,
+                    const std::pair<CAddressUnspentKey, CAddressUnspentValue> &b) const {
+        if (a.second.blockHeight != b.second.blockHeight)
+            return a.second.blockHeight < b.second.blockHeight;
+        if (a.first.txhash != b.first.txhash)
+            return a.first.txhash < b.first.txhash;
+        return a.first.index < b.first.index;
+    }
+};
+
 struct CAddressIndexKey {
     unsigned int type;
     uint160 hashBytes;
@@ -151,6 +212,113 @@ struct CAddressIndexKey {
 
 };
 
+/**
+ * On-disk form of an address index key. The txid is not part of the key: the
+ * transaction is already identified by its height and position in the block,
+ * and its hash is stored once per transaction in a CAddressIndexTxKey row
+ * instead of once per address row. The output/input index is a varint.
+ */
+struct CCompactAddressIndexKey {
+    unsigned int type;
+    uint160 hashBytes;
+    int blockHeight;
+    unsigned int txindex;
+    bool spending;
+    unsigned int index;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 30 + GetSizeOfVarInt<unsigned int>(index);
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata8(s, type);
+        hashBytes.Serialize(s, nType, nVersion);
+        // Heights are stored big-endian for key sorting in LevelDB
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+        char f = spending;
+        ser_writedata8(s, f);
+        WriteVarInt<Stream, unsigned int>(s, index);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        type = ser_readdata8(s);
+        hashBytes.Unserialize(s, nType, nVersion);
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+        char f = ser_readdata8(s);
+        spending = f;
+        index = ReadVarInt<Stream, unsigned int>(s);
+    }
+
+    explicit CCompactAddressIndexKey(const CAddressIndexKey &key) {
+        type = key.type;
+        hashBytes = key.hashBytes;
+        blockHeight = key.blockHeight;
+        txindex = key.txindex;
+        spending = key.spending;
+        index = key.index;
+    }
+
+    CCompactAddressIndexKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        type = 0;
+        hashBytes.SetNull();
+        blockHeight = 0;
+        txindex = 0;
+        spending = false;
+        index = 0;
+    }
+
+    CAddressIndexKey ToKey(const uint256 &txhash) const {
+        return CAddressIndexKey(type, hashBytes, blockHeight, txindex, txhash, index, spending);
+    }
+};
+
+/** Position of a transaction in the active chain, the key of the txid of compact address index rows */
+struct CAddressIndexTxKey {
+    int blockHeight;
+    unsigned int txindex;
+
+    size_t GetSerializeSize(int nType, int nVersion) const {
+        return 8;
+    }
+    template<typename Stream>
+    void Serialize(Stream& s, int nType, int nVersion) const {
+        ser_writedata32be(s, blockHeight);
+        ser_writedata32be(s, txindex);
+    }
+    template<typename Stream>
+    void Unserialize(Stream& s, int nType, int nVersion) {
+        blockHeight = ser_readdata32be(s);
+        txindex = ser_readdata32be(s);
+    }
+
+    CAddressIndexTxKey(int height, unsigned int blockindex) {
+        blockHeight = height;
+        txindex = blockindex;
+    }
+
+    CAddressIndexTxKey() {
+        SetNull();
+    }
+
+    void SetNull() {
+        blockHeight = 0;
+        txindex = 0;
+    }
+
+    friend bool operator==(const CAddressIndexTxKey &a, const CAddressIndexTxKey &b) {
+        return a.blockHeight == b.blockHeight && a.txindex == b.txindex;
+    }
+    friend bool operator!=(const CAddressIndexTxKey &a, const CAddressIndexTxKey &b) {
+        return !(a == b);
+    }
+};
+
 struct CAddressIndexIteratorKey {
     unsigned int type;
     uint160 hashBytes;
@@ -222,6 +390,49 @@ struct CAddressIndexIteratorHeightKey {
     }
 };
 
+struct CAddressSummaryValue {
+    CAmount balance;
+    CAmount received;
+    int64_t txCount;
+    int firstHeight;
+    int lastHeight;
+
+    ADD_SERIALIZE_METHODS;
+
+    template <typename Stream, typename Operation>
+    inline void SerializationOp(Stream& s, Operation ser_action, int nType, int nVersion) {
+        READWRITE(balance);
+        READWRITE(received);
+        READWRITE(txCount);
+        READWRITE(firstHeight);
+        READWRITE(lastHeight);
+    }
+
+    CAddressSummaryValue(CAmount balanceIn, CAmount receivedIn, int64_t count, int first, int last) {
+        balance = balanceIn;
+        received = receivedIn;
+        txCount = count;
+        firstHeight = first;
+        lastHeight = last;
+    }
+
+    CAddressSummaryValue() {
+        SetNull();
+    }
+
+    void SetNull() {
+        balance = 0;
+        received = 0;
+        txCount = 0;
+        firstHeight = 0;
+        lastHeight = 0;
+    }
+
+    bool IsNull() const {
+        return (txCount == 0);
+    }
+};
+
 struct CMempoolAddressDelta
 {
     int64_t time;
@@ -292,4 +503,52 @@ struct CMempoolAddressDeltaKeyCompare
     }
 };
 
+/** Address delta of a mempool transaction, as kept in the mempool address index */
+struct CMempoolAddressDeltaEntry
+{
+    CMempoolAddressDeltaKey key;
+    CMempoolAddressDelta delta;
+
+    CMempoolAddressDeltaEntry(const CMempoolAddressDeltaKey& k, const CMempoolAddressDelta& d) : key(k), delta(d) {}
+};
+
+/** Orders the deltas of each address by the time their transaction entered the mempool */
+struct CMempoolAddressDeltaEntryCompare
+{
+    bool operator()(const CMempoolAddressDeltaEntry& a, const CMempoolAddressDeltaEntry& b) const {
+        if (a.key.type != b.key.type)
+            return a.key.type < b.key.type;
+        if (a.key.addressBytes != b.key.addressBytes)
+            return a.key.addressBytes < b.key.addressBytes;
+        if (a.delta.time != b.delta.time)
+            return a.delta.time < b.delta.time;
+        return CMempoolAddressDeltaKeyCompare()(a.key, b.key);
+    }
+};
+
+/**
+ * Append the address index and address unspent index rows of the outputs of
+ * transaction tx, which is at position nTx of the block at height nHeight.
+ */
+inline void GetOutputAddressIndexes(const CTransaction &tx, int nHeight, unsigned int nTx,
+                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex)
+{
+    const uint256 &txhash = tx.GetHash();
+    for (unsigned int k = 0; k < tx.vout.size(); k++) {
+        const CTxOut &out = tx.vout[k];
+        uint160 hashBytes;
+        int addressType;
+
+        if (!GetScriptAddressIndexKey(out.scriptPubKey, hashBytes, addressType))
+            continue;
+
+        // record receiving activity
+        addressIndex.push_back(std::make_pair(CAddressIndexKey(addressType, hashBytes, nHeight, nTx, txhash, k, false), out.nValue));
+
+        // record unspent output
+        addressUnspentIndex.push_back(std::make_pair(CAddressUnspentKey(addressType, hashBytes, txhash, k), CAddressUnspentValue(out.nValue, out.scriptPubKey, nHeight)));
+    }
+}
+
 #endif // BITCOIN_ADDRESSINDEX_H
@@ -0,0 +1,46 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "addressindex.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/standard.h"
+
+/* About the transactions and outputs of a full 1 MB block */
+static const unsigned int TXS = 2500;
+static const unsigned int OUTPUTS = 2;
+
+/*
+ * The address index rows of the outputs of a block, as ConnectBlock builds
+ * them on the main thread while the script check threads verify the inputs.
+ */
+static void AddressIndexOutputs(benchmark::State& state)
+{
+    std::vector<CTransaction> vtx;
+    vtx.reserve(TXS);
+    for (unsigned int i = 0; i < TXS; i++) {
+        CMutableTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        for (unsigned int j = 0; j < OUTPUTS; j++) {
+            uint160 hash = uint160(std::vector<unsigned char>(20, (unsigned char)(i + j)));
+            CScript script = (i + j) % 4 ? GetScriptForDestination(CKeyID(hash)) : GetScriptForDestination(CScriptID(hash));
+            tx.vout.push_back(CTxOut(1000 + j, script));
+        }
+        vtx.push_back(tx);
+    }
+
+    while (state.KeepRunning()) {
+        std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > addressUnspentIndex;
+        for (unsigned int i = 0; i < vtx.size(); i++)
+            GetOutputAddressIndexes(vtx[i], 100000, i, addressIndex, addressUnspentIndex);
+        assert(addressIndex.size() == TXS * OUTPUTS);
+    }
+}
+
+BENCHMARK(AddressIndexOutputs);
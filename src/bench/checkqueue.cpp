@@ -0,0 +1,77 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "checkqueue.h"
+#include "crypto/sha256.h"
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+/* Checks per iteration, added in batches like the inputs of transactions */
+static const unsigned int CHECKS = 5000;
+static const unsigned int BATCH = 4;
+
+/* Stands in for a script check: a few SHA256 compressions, more for a costlier check */
+struct HashCheck
+{
+    unsigned int nRounds;
+
+    HashCheck() : nRounds(0) {}
+    HashCheck(unsigned int nRoundsIn) : nRounds(nRoundsIn) {}
+
+    bool operator()()
+    {
+        unsigned char buf[64] = {0};
+        for (unsigned int i = 0; i < nRounds; i++)
+            CSHA256().Write(buf, 64).Finalize(buf);
+        return buf[0] != 0 || buf[1] != 0 || buf[2] != 0 || buf[3] != 0;
+    }
+
+    unsigned int GetCost() const { return nRounds; }
+
+    void swap(HashCheck& check) { std::swap(nRounds, check.nRounds); }
+};
+
+/*
+ * CHECKS checks of uneven cost run by the master and nThreads - 1 workers.
+ * Checks per second is CHECKS divided by the time per iteration.
+ */
+static void CheckQueue(benchmark::State& state, int nThreads)
+{
+    CCheckQueue<HashCheck> queue(128, nThreads);
+    boost::thread_group threads;
+    for (int i = 0; i < nThreads - 1; i++)
+        threads.create_thread(boost::bind(&CCheckQueue<HashCheck>::Thread, &queue));
+
+    while (state.KeepRunning()) {
+        CCheckQueueControl<HashCheck> control(&queue);
+        std::vector<HashCheck> vChecks;
+        for (unsigned int i = 0; i < CHECKS; i += BATCH) {
+            for (unsigned int j = 0; j < BATCH; j++)
+                vChecks.push_back(HashCheck(10 + (i + j) % 7 * 10));
+            control.Add(vChecks);
+        }
+        bool fOk = control.Wait();
+        assert(fOk);
+    }
+
+    threads.interrupt_all();
+    threads.join_all();
+}
+
+static void CheckQueue_1Thread(benchmark::State& state) { CheckQueue(state, 1); }
+static void CheckQueue_2Threads(benchmark::State& state) { CheckQueue(state, 2); }
+static void CheckQueue_4Threads(benchmark::State& state) { CheckQueue(state, 4); }
+static void CheckQueue_8Threads(benchmark::State& state) { CheckQueue(state, 8); }
+static void CheckQueue_16Threads(benchmark::State& state) { CheckQueue(state, 16); }
+static void CheckQueue_64Threads(benchmark::State& state) { CheckQueue(state, 64); }
+
+BENCHMARK(CheckQueue_1Thread);
+BENCHMARK(CheckQueue_2Threads);
+BENCHMARK(CheckQueue_4Threads);
+BENCHMARK(CheckQueue_8Threads);
+BENCHMARK(CheckQueue_16Threads);
+BENCHMARK(CheckQueue_64Threads);
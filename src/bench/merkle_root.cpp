@@ -0,0 +1,35 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "consensus/merkle.h"
+#include "random.h"
+#include "uint256.h"
+
+static void MerkleRoot(benchmark::State& state, size_t nLeaves)
+{
+    std::vector<uint256> leaves(nLeaves);
+    for (size_t i = 0; i < nLeaves; i++)
+        leaves[i] = GetRandHash();
+    while (state.KeepRunning()) {
+        bool mutated = false;
+        uint256 hash = ComputeMerkleRoot(leaves, &mutated);
+        // Feed the result back in, so the computation can't be skipped
+        leaves[mutated] = hash;
+    }
+}
+
+static void MerkleRoot_2000(benchmark::State& state)
+{
+    MerkleRoot(state, 2000);
+}
+
+static void MerkleRoot_10000(benchmark::State& state)
+{
+    MerkleRoot(state, 10000);
+}
+
+BENCHMARK(MerkleRoot_2000);
+BENCHMARK(MerkleRoot_10000);
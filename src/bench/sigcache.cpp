@@ -0,0 +1,84 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "bench.h"
+
+#include "key.h"
+#include "primitives/transaction.h"
+#include "pubkey.h"
+#include "random.h"
+#include "script/sigcache.h"
+
+#include <memory>
+
+#include <boost/bind.hpp>
+#include <boost/thread/thread.hpp>
+
+/* Signatures looked up, round robin, by each thread */
+static const unsigned int SIGNATURES = 64;
+/* Lookups per thread per iteration */
+static const unsigned int LOOKUPS = 4000;
+
+struct CachedSignature
+{
+    std::vector<unsigned char> vchSig;
+    CPubKey pubkey;
+    uint256 hash;
+};
+
+static void LookUp(const CTransaction* ptx, const std::vector<CachedSignature>* psigs, bool* pfOk)
+{
+    // Storing checkers keep the entries they hit, like mempool acceptance does
+    CachingTransactionSignatureChecker checker(ptx, 0, 0, true);
+    bool fOk = true;
+    for (unsigned int i = 0; i < LOOKUPS; i++) {
+        const CachedSignature& sig = (*psigs)[i % psigs->size()];
+        fOk &= checker.VerifySignature(sig.vchSig, sig.pubkey, sig.hash);
+    }
+    *pfOk = fOk;
+}
+
+/*
+ * Signature cache hits from nThreads threads at once. Each thread does the
+ * same amount of work, so with perfect scaling the time per iteration stays
+ * flat as threads are added.
+ */
+static void SigCacheHits(benchmark::State& state, int nThreads)
+{
+    ECCVerifyHandle verifyHandle;
+    CKey key;
+    key.MakeNewKey(true);
+    std::vector<CachedSignature> sigs(SIGNATURES);
+    for (unsigned int i = 0; i < sigs.size(); i++) {
+        sigs[i].hash = GetRandHash();
+        key.Sign(sigs[i].hash, sigs[i].vchSig);
+        sigs[i].pubkey = key.GetPubKey();
+    }
+
+    // Verify and store the signatures, so that all lookups below are hits
+    CTransaction tx;
+    bool fOk;
+    LookUp(&tx, &sigs, &fOk);
+    assert(fOk);
+
+    std::unique_ptr<bool[]> vfOk(new bool[nThreads]);
+    while (state.KeepRunning()) {
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&LookUp, &tx, &sigs, &vfOk[i]));
+        threads.join_all();
+    }
+}
+
+static void SigCacheHits_1Thread(benchmark::State& state) { SigCacheHits(state, 1); }
+static void SigCacheHits_2Threads(benchmark::State& state) { SigCacheHits(state, 2); }
+static void SigCacheHits_4Threads(benchmark::State& state) { SigCacheHits(state, 4); }
+static void SigCacheHits_8Threads(benchmark::State& state) { SigCacheHits(state, 8); }
+static void SigCacheHits_16Threads(benchmark::State& state) { SigCacheHits(state, 16); }
+
+BENCHMARK(SigCacheHits_1Thread);
+BENCHMARK(SigCacheHits_2Threads);
+BENCHMARK(SigCacheHits_4Threads);
+BENCHMARK(SigCacheHits_8Threads);
+BENCHMARK(SigCacheHits_16Threads);
@@ -0,0 +1,272 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+
+#include "chain.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+//! Serialized size of a block header
+static const size_t BLOCK_HEADER_SIZE = 80;
+
+CMappedBlockFile::~CMappedBlockFile()
+{
+#ifndef WIN32
+    munmap((void*)pdata, nSize);
+#endif
+}
+
+std::shared_ptr<const CMappedBlockFile> CMappedBlockFile::Open(const boost::filesystem::path& path)
+{
+#ifndef WIN32
+    int fd = open(path.string().c_str(), O_RDONLY);
+    if (fd == -1)
+        return std::shared_ptr<const CMappedBlockFile>();
+
+    struct stat st;
+    void* pdata = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && st.st_size > 0)
+        pdata = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    // The mapping stays valid after the descriptor is closed
+    close(fd);
+    if (pdata == MAP_FAILED) {
+        LogPrintf("%s: failed to map %s\n", __func__, path.string());
+        return std::shared_ptr<const CMappedBlockFile>();
+    }
+    return std::make_shared<const CMappedBlockFile>((const char*)pdata, (size_t)st.st_size);
+#else
+    return std::shared_ptr<const CMappedBlockFile>();
+#endif
+}
+
+CBlockFileMap::CBlockFileMap(size_t nMaxFilesIn) : nMaxFiles(nMaxFilesIn), nHits(0), nMaps(0)
+{
+}
+
+std::shared_ptr<const CMappedBlockFile> CBlockFileMap::GetFile(int nFile, size_t nMinSize)
+{
+    LOCK(cs);
+    for (list_type::iterator it = files.begin(); it != files.end(); it++) {
+        if (it->first != nFile)
+            continue;
+        if (it->second->size() >= nMinSize) {
+            files.splice(files.begin(), files, it);
+            nHits++;
+            return it->second;
+        }
+        // The file has grown since it was mapped
+        files.erase(it);
+        break;
+    }
+
+    if (nMaxFiles == 0)
+        return std::shared_ptr<const CMappedBlockFile>();
+
+    std::shared_ptr<const CMappedBlockFile> file = CMappedBlockFile::Open(GetBlockPosFilename(CDiskBlockPos(nFile, 0), "blk"));
+    if (!file)
+        return file;
+    nMaps++;
+    files.push_front(std::make_pair(nFile, file));
+    if (files.size() > nMaxFiles)
+        files.pop_back();
+
+    if (file->size() < nMinSize)
+        return std::shared_ptr<const CMappedBlockFile>();
+    return file;
+}
+
+bool CBlockFileMap::GetBlock(const CDiskBlockPos& pos, CBlockFileSpan& span)
+{
+    // Blocks are preceded by the network magic and their size
+    if (pos.IsNull() || pos.nPos < 8)
+        return false;
+
+    std::shared_ptr<const CMappedBlockFile> file = GetFile(pos.nFile, pos.nPos + BLOCK_HEADER_SIZE);
+    if (!file)
+        return false;
+    uint32_t nSize = ReadLE32((const unsigned char*)file->data() + pos.nPos - 4);
+    if (nSize < BLOCK_HEADER_SIZE)
+        return false;
+    if ((uint64_t)pos.nPos + nSize > file->size()) {
+        file = GetFile(pos.nFile, (uint64_t)pos.nPos + nSize);
+        if (!file)
+            return false;
+    }
+
+    span = CBlockFileSpan(file, file->data() + pos.nPos, nSize);
+    return true;
+}
+
+bool CBlockFileMap::GetTransaction(const CDiskTxPos& pos, CBlockFileSpan& span, CBlockFileSpan* pheader)
+{
+    CBlockFileSpan block;
+    if (!GetBlock(pos, block))
+        return false;
+    if (BLOCK_HEADER_SIZE + pos.nTxOffset >= block.size())
+        return false;
+
+    const char* pbegin = block.begin() + BLOCK_HEADER_SIZE + pos.nTxOffset;
+    size_t nSize = GetSerializedTransactionSize(pbegin, block.end());
+    if (nSize == 0)
+        return false;
+
+    span = CBlockFileSpan(block, pbegin, nSize);
+    if (pheader)
+        *pheader = CBlockFileSpan(block, block.begin(), BLOCK_HEADER_SIZE);
+    return true;
+}
+
+void CBlockFileMap::Forget(int nFile)
+{
+    LOCK(cs);
+    for (list_type::iterator it = files.begin(); it != files.end(); it++) {
+        if (it->first == nFile) {
+            files.erase(it);
+            return;
+        }
+    }
+}
+
+CBlockFileMap::Stats CBlockFileMap::GetStats() const
+{
+    LOCK(cs);
+    Stats stats;
+    stats.nMapped = files.size();
+    stats.nMaxFiles = nMaxFiles;
+    stats.nHits = nHits;
+    stats.nMaps = nMaps;
+    return stats;
+}
+
+namespace {
+
+/** Walks serialized data without copying it, failing once it would run past the end */
+class SerializedDataCursor
+{
+private:
+    const char* pcur;
+    const char* pend;
+
+public:
+    SerializedDataCursor(const char* pbegin, const char* pendIn) : pcur(pbegin), pend(pendIn) {}
+
+    const char* Position() const { return pcur; }
+
+    bool Skip(uint64_t nSize)
+    {
+        if (nSize > (uint64_t)(pend - pcur))
+            return false;
+        pcur += nSize;
+        return true;
+    }
+
+    bool ReadByte(unsigned char& ch)
+    {
+        if (pcur == pend)
+            return false;
+        ch = *pcur++;
+        return true;
+    }
+
+    /** Read a compact size, as ReadCompactSize does */
+    bool ReadCompactSize(uint64_t& n)
+    {
+        unsigned char chSize;
+        if (!ReadByte(chSize))
+            return false;
+        unsigned int nBytes = chSize < 253 ? 0 : chSize == 253 ? 2 : chSize == 254 ? 4 : 8;
+        if (nBytes == 0) {
+            n = chSize;
+            return true;
+        }
+        if ((size_t)(pend - pcur) < nBytes)
+            return false;
+        n = 0;
+        for (unsigned int i = 0; i < nBytes; i++)
+            n |= (uint64_t)(unsigned char)pcur[i] << (8 * i);
+        pcur += nBytes;
+        return n <= MAX_SIZE;
+    }
+
+    bool SkipVector()
+    {
+        uint64_t nSize;
+        return ReadCompactSize(nSize) && Skip(nSize);
+    }
+};
+
+bool SkipInputs(SerializedDataCursor& cursor, uint64_t& nInputs)
+{
+    if (!cursor.ReadCompactSize(nInputs))
+        return false;
+    for (uint64_t i = 0; i < nInputs; i++) {
+        // prevout, scriptSig, nSequence
+        if (!cursor.Skip(36) || !cursor.SkipVector() || !cursor.Skip(4))
+            return false;
+    }
+    return true;
+}
+
+bool SkipOutputs(SerializedDataCursor& cursor)
+{
+    uint64_t nOutputs;
+    if (!cursor.ReadCompactSize(nOutputs))
+        return false;
+    for (uint64_t i = 0; i < nOutputs; i++) {
+        // nValue, scriptPubKey
+        if (!cursor.Skip(8) || !cursor.SkipVector())
+            return false;
+    }
+    return true;
+}
+
+} // anon namespace
+
+size_t GetSerializedTransactionSize(const char* pbegin, const char* pend)
+{
+    // Follows the layout read by UnserializeTransaction
+    SerializedDataCursor cursor(pbegin, pend);
+    uint64_t nInputs;
+    unsigned char flags = 0;
+    if (!cursor.Skip(4) || !SkipInputs(cursor, nInputs))
+        return 0;
+    if (nInputs == 0) {
+        // An empty vin is the marker of the extended format, followed by the flags
+        if (!cursor.ReadByte(flags))
+            return 0;
+        if (flags != 0 && (!SkipInputs(cursor, nInputs) || !SkipOutputs(cursor)))
+            return 0;
+    } else if (!SkipOutputs(cursor)) {
+        return 0;
+    }
+    if (flags & 1) {
+        flags ^= 1;
+        // One witness stack per input
+        for (uint64_t i = 0; i < nInputs; i++) {
+            uint64_t nItems;
+            if (!cursor.ReadCompactSize(nItems))
+                return 0;
+            for (uint64_t j = 0; j < nItems; j++) {
+                if (!cursor.SkipVector())
+                    return 0;
+            }
+        }
+    }
+    // Unknown optional data, as in UnserializeTransaction
+    if (flags)
+        return 0;
+    if (!cursor.Skip(4))
+        return 0;
+    return cursor.Position() - pbegin;
+}
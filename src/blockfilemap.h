@@ -0,0 +1,126 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKFILEMAP_H
+#define BITCOIN_BLOCKFILEMAP_H
+
+#include "sync.h"
+
+#include <list>
+#include <memory>
+#include <stdint.h>
+
+#include <boost/filesystem/path.hpp>
+
+struct CDiskBlockPos;
+struct CDiskTxPos;
+
+//! -maxmappedblockfiles default; mapping 128 MiB files is only sensible with a 64-bit address space
+static const unsigned int DEFAULT_MAX_MAPPED_BLOCK_FILES = sizeof(void*) >= 8 ? 32 : 0;
+
+/** A read-only memory mapping of a whole block file */
+class CMappedBlockFile
+{
+private:
+    const char* pdata;
+    size_t nSize;
+
+    CMappedBlockFile(const CMappedBlockFile&);
+    CMappedBlockFile& operator=(const CMappedBlockFile&);
+
+public:
+    CMappedBlockFile(const char* pdataIn, size_t nSizeIn) : pdata(pdataIn), nSize(nSizeIn) {}
+    ~CMappedBlockFile();
+
+    /** Map the file at path. Returns NULL on failure, or on platforms without mmap. */
+    static std::shared_ptr<const CMappedBlockFile> Open(const boost::filesystem::path& path);
+
+    const char* data() const { return pdata; }
+    size_t size() const { return nSize; }
+};
+
+/**
+ * Serialized data inside a mapped block file. The span holds a reference to
+ * the mapping, so the data stays valid for as long as the span, or a pin
+ * obtained from it, exists.
+ */
+class CBlockFileSpan
+{
+private:
+    std::shared_ptr<const CMappedBlockFile> file;
+    const char* pbegin;
+    size_t nSize;
+
+public:
+    CBlockFileSpan() : pbegin(NULL), nSize(0) {}
+    CBlockFileSpan(const std::shared_ptr<const CMappedBlockFile>& fileIn, const char* pbeginIn, size_t nSizeIn) :
+        file(fileIn), pbegin(pbeginIn), nSize(nSizeIn) {}
+    //! A part of another span
+    CBlockFileSpan(const CBlockFileSpan& outer, const char* pbeginIn, size_t nSizeIn) :
+        file(outer.file), pbegin(pbeginIn), nSize(nSizeIn) {}
+
+    const char* begin() const { return pbegin; }
+    const char* end() const { return pbegin + nSize; }
+    size_t size() const { return nSize; }
+    bool empty() const { return nSize == 0; }
+
+    //! Keeps the data valid after the span is gone, e.g. while it is sent to a client
+    std::shared_ptr<const void> GetPin() const { return file; }
+};
+
+/**
+ * Memory maps block files (blk?????.dat), so that blocks and transactions can
+ * be read straight from the page cache instead of being copied through a FILE
+ * buffer. At most nMaxFiles files are mapped at a time; the least recently used
+ * one is dropped first, and unmapped once no span refers to it anymore.
+ *
+ * Block files only ever grow while the node runs. A file that has grown past
+ * its mapping since it was mapped is mapped again.
+ */
+class CBlockFileMap
+{
+public:
+    struct Stats {
+        size_t nMapped;
+        size_t nMaxFiles;
+        uint64_t nHits;
+        uint64_t nMaps;
+    };
+
+    CBlockFileMap(size_t nMaxFilesIn);
+
+    /** Get the serialized block at pos, as written by WriteBlockToDisk */
+    bool GetBlock(const CDiskBlockPos& pos, CBlockFileSpan& span);
+    /**
+     * Get the serialized transaction at pos, as recorded in the transaction index.
+     * @param[out] pheader  If not NULL, the serialized header of the block containing it
+     */
+    bool GetTransaction(const CDiskTxPos& pos, CBlockFileSpan& span, CBlockFileSpan* pheader = NULL);
+    /** Drop the mapping of a file, e.g. because it is being pruned */
+    void Forget(int nFile);
+
+    Stats GetStats() const;
+
+private:
+    typedef std::list<std::pair<int, std::shared_ptr<const CMappedBlockFile> > > list_type;
+
+    mutable CCriticalSection cs;
+    size_t nMaxFiles;
+    //! Most recently used files first
+    list_type files;
+    uint64_t nHits;
+    uint64_t nMaps;
+
+    /** Get a mapping of file nFile that is at least nMinSize bytes long */
+    std::shared_ptr<const CMappedBlockFile> GetFile(int nFile, size_t nMinSize);
+};
+
+/**
+ * Size of the serialized transaction (with witness) at the start of
+ * [pbegin, pend), found without deserializing it. Returns 0 if the data does
+ * not start with a complete transaction.
+ */
+size_t GetSerializedTransactionSize(const char* pbegin, const char* pend);
+
+#endif // BITCOIN_BLOCKFILEMAP_H
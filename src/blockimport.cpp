@@ -0,0 +1,209 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+
+#include "chainparams.h"
+#include "clientversion.h"
+#include "consensus/consensus.h"
+#include "consensus/validation.h"
+#include "main.h"
+#include "streams.h"
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+CBlockImportPipeline::CBlockImportPipeline(const CChainParams& chainparamsIn, int nThreadsIn, size_t nMaxBytesIn) :
+    chainparams(chainparamsIn), nThreads(std::max(nThreadsIn, 1)), nMaxBytes(nMaxBytesIn),
+    nNextSource(0), nHead(0), nBytes(0), fStarted(false), fInterrupt(false)
+{
+}
+
+CBlockImportPipeline::~CBlockImportPipeline()
+{
+    Stop();
+    // Files never claimed by a worker
+    for (unsigned int i = 0; i < sources.size(); i++) {
+        if (sources[i].file)
+            fclose(sources[i].file);
+    }
+}
+
+void CBlockImportPipeline::AddFile(FILE* file)
+{
+    assert(!fStarted);
+    sources.push_back(Source(file, -1));
+}
+
+void CBlockImportPipeline::AddBlockFile(int nFile)
+{
+    assert(!fStarted);
+    sources.push_back(Source(NULL, nFile));
+}
+
+void CBlockImportPipeline::Start()
+{
+    assert(!fStarted);
+    fStarted = true;
+    int nWorkers = std::min(nThreads, (int)sources.size());
+    for (int i = 0; i < nWorkers; i++)
+        threads.create_thread(boost::bind(&CBlockImportPipeline::Thread, this));
+}
+
+void CBlockImportPipeline::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fInterrupt = true;
+    }
+    condSpace.notify_all();
+    threads.join_all();
+}
+
+bool CBlockImportPipeline::Next(CImportedBlock& imported)
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (nHead < sources.size()) {
+        Source& source = sources[nHead];
+        if (!source.queue.empty()) {
+            std::swap(imported, source.queue.front());
+            source.queue.pop_front();
+            source.nBytes -= imported.nSize;
+            nBytes -= imported.nSize;
+            lock.unlock();
+            condSpace.notify_all();
+            return true;
+        }
+        if (source.fDone) {
+            nHead++;
+            // The next file is now at the head, so its worker may read on
+            condSpace.notify_all();
+            if (!source.strError.empty())
+                throw std::runtime_error(source.strError);
+            continue;
+        }
+        condReady.wait(lock);
+    }
+    return false;
+}
+
+void CBlockImportPipeline::Thread()
+{
+    RenameThread("bitcoin-import");
+    while (true) {
+        unsigned int nSource;
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fInterrupt || nNextSource >= sources.size())
+                return;
+            nSource = nNextSource++;
+        }
+        ReadSource(nSource);
+    }
+}
+
+bool CBlockImportPipeline::Push(unsigned int nSource, CImportedBlock& imported)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        Source& source = sources[nSource];
+        // The head file only waits for its own blocks; any other file waits for all queued blocks
+        while (!fInterrupt && (nSource == nHead ? source.nBytes : nBytes) >= nMaxBytes)
+            condSpace.wait(lock);
+        if (fInterrupt)
+            return false;
+        source.queue.push_back(CImportedBlock());
+        std::swap(source.queue.back(), imported);
+        source.nBytes += source.queue.back().nSize;
+        nBytes += source.queue.back().nSize;
+    }
+    condReady.notify_all();
+    return true;
+}
+
+void CBlockImportPipeline::Finish(unsigned int nSource, const std::string& strError)
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        sources[nSource].fDone = true;
+        sources[nSource].strError = strError;
+    }
+    condReady.notify_all();
+}
+
+void CBlockImportPipeline::ReadSource(unsigned int nSource)
+{
+    FILE* fileIn;
+    int nFile;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fileIn = sources[nSource].file;
+        sources[nSource].file = NULL;
+        nFile = sources[nSource].nFile;
+    }
+    if (nFile >= 0) {
+        LogPrint("reindex", "Reading block file blk%05u.dat...\n", (unsigned int)nFile);
+        fileIn = OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+    }
+    if (!fileIn) {
+        // This error is logged in OpenBlockFile
+        Finish(nSource, "");
+        return;
+    }
+
+    std::string strError;
+    try {
+        // This takes over fileIn and calls fclose() on it in the CBufferedFile destructor
+        CBufferedFile blkdat(fileIn, 2*MAX_BLOCK_SERIALIZED_SIZE, MAX_BLOCK_SERIALIZED_SIZE+8, SER_DISK, CLIENT_VERSION);
+        uint64_t nRewind = blkdat.GetPos();
+        while (!blkdat.eof()) {
+            blkdat.SetPos(nRewind);
+            nRewind++; // start one byte further next time, in case of failure
+            blkdat.SetLimit(); // remove former limit
+            unsigned int nSize = 0;
+            try {
+                // locate a header
+                unsigned char buf[MESSAGE_START_SIZE];
+                blkdat.FindByte(chainparams.MessageStart()[0]);
+                nRewind = blkdat.GetPos()+1;
+                blkdat >> FLATDATA(buf);
+                if (memcmp(buf, chainparams.MessageStart(), MESSAGE_START_SIZE))
+                    continue;
+                // read size
+                blkdat >> nSize;
+                if (nSize < 80 || nSize > MAX_BLOCK_SERIALIZED_SIZE)
+                    continue;
+            } catch (const std::exception&) {
+                // no valid block header found; don't complain
+                break;
+            }
+            CImportedBlock imported;
+            try {
+                // read block
+                uint64_t nBlockPos = blkdat.GetPos();
+                blkdat.SetLimit(nBlockPos + nSize);
+                blkdat.SetPos(nBlockPos);
+                blkdat >> imported.block;
+                nRewind = blkdat.GetPos();
+                if (nFile >= 0)
+                    imported.pos = CDiskBlockPos(nFile, nBlockPos);
+            } catch (const std::exception& e) {
+                LogPrintf("%s: Deserialize or I/O error - %s\n", __func__, e.what());
+                continue;
+            }
+            imported.hash = imported.block.GetHash();
+            imported.nSource = nSource;
+            imported.nSize = nSize;
+            // Done here rather than when the block is accepted, as the result is cached in the block
+            CValidationState state;
+            CheckBlock(imported.block, state, chainparams.GetConsensus());
+
+            if (!Push(nSource, imported))
+                return;
+        }
+    } catch (const std::runtime_error& e) {
+        strError = std::string("System error: ") + e.what();
+    }
+    Finish(nSource, strError);
+}
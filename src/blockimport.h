@@ -0,0 +1,122 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_BLOCKIMPORT_H
+#define BITCOIN_BLOCKIMPORT_H
+
+#include "chain.h"
+#include "primitives/block.h"
+#include "uint256.h"
+
+#include <deque>
+#include <stdio.h>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CChainParams;
+
+//! -importthreads default (0 = one per core, up to MAX_IMPORT_THREADS)
+static const int DEFAULT_IMPORT_THREADS = 0;
+//! Maximum number of threads reading block files during -reindex and -loadblock
+static const int MAX_IMPORT_THREADS = 8;
+//! Serialized size of the blocks read ahead of validation, in bytes
+static const size_t DEFAULT_IMPORT_QUEUE_MAXMEM = 128 * 1024 * 1024;
+
+/** A block read from a file, waiting to be accepted */
+struct CImportedBlock
+{
+    CBlock block;
+    uint256 hash;
+    //! Position in a numbered block file, or null for external files
+    CDiskBlockPos pos;
+    //! Index of the file the block was read from, in the order the files were added
+    unsigned int nSource;
+    //! Serialized size
+    unsigned int nSize;
+
+    CImportedBlock() : nSource(0), nSize(0) {}
+};
+
+/**
+ * Reads blocks from a list of files on worker threads, while the blocks read
+ * so far are validated on the calling thread.
+ *
+ * Each worker claims the next unread file, scans it for blocks, deserializes
+ * them, computes their hash and runs the context free CheckBlock, which
+ * caches its result in the block. The blocks are handed out by Next in file
+ * order and, within a file, in the order they were found, so the caller sees
+ * exactly the sequence a single threaded scan would produce.
+ *
+ * Workers stop reading ahead once nMaxBytes of blocks are waiting. The worker
+ * reading the file at the head of the order only waits for its own blocks, so
+ * the files are always read to the end.
+ */
+class CBlockImportPipeline
+{
+public:
+    CBlockImportPipeline(const CChainParams& chainparams, int nThreadsIn, size_t nMaxBytesIn = DEFAULT_IMPORT_QUEUE_MAXMEM);
+    ~CBlockImportPipeline();
+
+    /** Add a file to read, taking ownership of it. Blocks are read from the current position. */
+    void AddFile(FILE* file);
+    /** Add a numbered block file to read (for -reindex); it is opened by the worker reading it */
+    void AddBlockFile(int nFile);
+
+    /** Start the worker threads. No files can be added afterwards. */
+    void Start();
+    /** Stop the worker threads, discarding the blocks not handed out yet */
+    void Stop();
+
+    /**
+     * Get the next block. Waits for it to be read; this is an interruption
+     * point. Returns false when all files have been read. Throws
+     * std::runtime_error when a file could not be read, as the caller is next
+     * in line for its blocks.
+     */
+    bool Next(CImportedBlock& imported);
+
+private:
+    struct Source {
+        FILE* file;
+        int nFile;
+        std::deque<CImportedBlock> queue;
+        size_t nBytes;
+        bool fDone;
+        std::string strError;
+
+        Source(FILE* fileIn, int nFileIn) : file(fileIn), nFile(nFileIn), nBytes(0), fDone(false) {}
+    };
+
+    const CChainParams& chainparams;
+    int nThreads;
+    size_t nMaxBytes;
+
+    boost::mutex mutex;
+    //! Signalled when blocks become available
+    boost::condition_variable condReady;
+    //! Signalled when blocks have been taken, or the workers should stop
+    boost::condition_variable condSpace;
+    std::vector<Source> sources;
+    //! Next file to be claimed by a worker
+    unsigned int nNextSource;
+    //! File whose blocks are handed out next
+    unsigned int nHead;
+    //! Serialized size of all queued blocks
+    size_t nBytes;
+    bool fStarted;
+    bool fInterrupt;
+    boost::thread_group threads;
+
+    void Thread();
+    void ReadSource(unsigned int nSource);
+    /** Queue a block read from source nSource. Returns false if the workers should stop. */
+    bool Push(unsigned int nSource, CImportedBlock& imported);
+    void Finish(unsigned int nSource, const std::string& strError);
+};
+
+#endif // BITCOIN_BLOCKIMPORT_H
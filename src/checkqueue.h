@@ -6,31 +6,71 @@
 #define BITCOIN_CHECKQUEUE_H
 
 #include <algorithm>
+#include <assert.h>
+#include <atomic>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <queue>
+#include <stdint.h>
+#include <utility>
 #include <vector>
 
 #include <boost/foreach.hpp>
 #include <boost/thread/condition_variable.hpp>
 #include <boost/thread/locks.hpp>
 #include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
 
 template <typename T>
 class CCheckQueueControl;
 
-/** 
+/**
  * Queue for verifications that have to be performed.
   * The verifications are represented by a type T, which must provide an
-  * operator(), returning a bool.
+  * operator(), returning a bool, a swap() and a GetCost() estimating how
+  * expensive the verification is, in arbitrary units.
   *
   * One thread (the master) is assumed to push batches of verifications
   * onto the queue, where they are processed by N-1 worker threads. When
   * the master is done adding work, it temporarily joins the worker pool
   * as an N'th worker, until all jobs are done.
+  *
+  * Every worker owns a deque of verifications behind a lock of its own. Add
+  * spreads each batch over the deques, most expensive verifications first,
+  * each going to the deque with the least work queued. The master has a deque
+  * too, which only gets work when there are no workers.
+  * A worker takes verifications from the front of its own deque, and when
+  * that is empty steals a batch from the back of the deque with the most
+  * work queued. The shared mutex is only taken to sleep when there is no
+  * work at all, and to wake sleeping workers.
+  *
+  * Once a verification fails the remaining ones are dropped without being
+  * run, as the result can't become true anymore.
   */
 template <typename T>
 class CCheckQueue
 {
 private:
-    //! Mutex to protect the inner state
+    struct Job {
+        T check;
+        unsigned int nCost;
+    };
+
+    //! A deque of verifications owned by one worker
+    struct WorkerQueue {
+        boost::mutex mutex;
+        std::deque<Job> jobs;
+        //! Total cost of the jobs, read without the lock to pick deques
+        std::atomic<int64_t> nCost;
+        //! Keeps the next queue's mutex a cache line away from this one's
+        //! nCost, however new[] aligned the array
+        char padding[64];
+
+        WorkerQueue() : nCost(0) {}
+    };
+
+    //! Mutex for sleeping and waking up; protects nIdle
     boost::mutex mutex;
 
     //! Worker threads block on this when out of work
@@ -39,122 +79,216 @@ private:
     //! Master thread blocks on this when out of work
     boost::condition_variable condMaster;
 
-    //! The queue of elements to be processed.
-    //! As the order of booleans doesn't matter, it is used as a LIFO (stack)
-    std::vector<T> queue;
+    //! One deque per worker; the master uses the first
+    std::unique_ptr<WorkerQueue[]> queues;
 
-    //! The number of workers (including the master) that are idle.
-    int nIdle;
+    //! The maximum number of worker threads (excluding the master)
+    const unsigned int nMaxWorkers;
+
+    //! The number of worker threads that have started (excluding the master)
+    std::atomic<unsigned int> nWorkers;
 
-    //! The total number of workers (including the master).
-    int nTotal;
+    //! The number of workers that are sleeping.
+    int nIdle;
 
     //! The temporary evaluation result.
-    bool fAllOk;
+    std::atomic<bool> fAllOk;
 
     /**
      * Number of verifications that haven't completed yet.
-     * This includes elements that are no longer queued, but still in the
-     * worker's own batches.
+     * This includes elements that are no longer queued, but being run.
      */
-    unsigned int nTodo;
+    std::atomic<unsigned int> nTodo;
 
-    //! Whether we're shutting down.
-    bool fQuit;
+    //! Number of verifications sitting in the deques
+    std::atomic<unsigned int> nQueued;
 
-    //! The maximum number of elements to be processed in one batch
+    //! The maximum number of elements to be stolen at once
     unsigned int nBatchSize;
 
+    /** Take the first job of deque nQueue. */
+    bool Pop(unsigned int nQueue, T& check)
+    {
+        WorkerQueue& queue = queues[nQueue];
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        if (queue.jobs.empty())
+            return false;
+        Job& job = queue.jobs.front();
+        check.swap(job.check);
+        queue.nCost -= job.nCost;
+        queue.jobs.pop_front();
+        nQueued--;
+        return true;
+    }
+
+    /** Move up to half of the jobs of the busiest other deque to deque nQueue. */
+    bool Steal(unsigned int nQueue)
+    {
+        unsigned int nQueues = nWorkers + 1;
+        unsigned int nVictim = nQueue;
+        int64_t nVictimCost = 0;
+        for (unsigned int i = 0; i < nQueues; i++) {
+            int64_t nCost = queues[i].nCost.load(std::memory_order_relaxed);
+            if (i != nQueue && nCost > nVictimCost) {
+                nVictim = i;
+                nVictimCost = nCost;
+            }
+        }
+        if (nVictim == nQueue)
+            return false;
+
+        std::vector<Job> vStolen;
+        {
+            WorkerQueue& victim = queues[nVictim];
+            boost::unique_lock<boost::mutex> lock(victim.mutex);
+            if (victim.jobs.empty())
+                return false;
+            // The cheapest jobs are at the back; the owner keeps working on the expensive ones
+            size_t nSteal = std::max((size_t)1, std::min((size_t)nBatchSize, victim.jobs.size() / 2));
+            vStolen.resize(nSteal);
+            for (size_t i = 0; i < nSteal; i++) {
+                Job& job = victim.jobs.back();
+                vStolen[i].check.swap(job.check);
+                vStolen[i].nCost = job.nCost;
+                victim.nCost -= job.nCost;
+                victim.jobs.pop_back();
+            }
+        }
+        WorkerQueue& queue = queues[nQueue];
+        boost::unique_lock<boost::mutex> lock(queue.mutex);
+        // Stolen in increasing cost order; keep the most expensive at the front
+        for (size_t i = 0; i < vStolen.size(); i++) {
+            queue.jobs.push_front(Job());
+            queue.jobs.front().check.swap(vStolen[i].check);
+            queue.jobs.front().nCost = vStolen[i].nCost;
+            queue.nCost += vStolen[i].nCost;
+        }
+        return true;
+    }
+
+    /** Run one job, from deque nQueue or stolen from another one. Returns false if there was none. */
+    bool RunOne(unsigned int nQueue, T& check)
+    {
+        if (!Pop(nQueue, check) && !(Steal(nQueue) && Pop(nQueue, check)))
+            return false;
+        // After a failure the remaining jobs are only dropped
+        if (fAllOk.load(std::memory_order_relaxed) && !check())
+            fAllOk = false;
+        T().swap(check);
+        if (--nTodo == 0) {
+            // We processed the last element; inform the master it can exit and return the result
+            boost::unique_lock<boost::mutex> lock(mutex);
+            condMaster.notify_one();
+        }
+        return true;
+    }
+
     /** Internal function that does bulk of the verification work. */
-    bool Loop(bool fMaster = false)
+    bool Loop(unsigned int nQueue, bool fMaster = false)
     {
-        boost::condition_variable& cond = fMaster ? condMaster : condWorker;
-        std::vector<T> vChecks;
-        vChecks.reserve(nBatchSize);
-        unsigned int nNow = 0;
-        bool fOk = true;
+        T check;
         do {
-            {
-                boost::unique_lock<boost::mutex> lock(mutex);
-                // first do the clean-up of the previous loop run (allowing us to do it in the same critsect)
-                if (nNow) {
-                    fAllOk &= fOk;
-                    nTodo -= nNow;
-                    if (nTodo == 0 && !fMaster)
-                        // We processed the last element; inform the master it can exit and return the result
-                        condMaster.notify_one();
-                } else {
-                    // first iteration
-                    nTotal++;
+            if (RunOne(nQueue, check))
+                continue;
+            boost::unique_lock<boost::mutex> lock(mutex);
+            if (fMaster) {
+                if (nTodo == 0) {
+                    bool fRet = fAllOk;
+                    // reset the status for new work later
+                    fAllOk = true;
+                    // return the current status
+                    return fRet;
                 }
-                // logically, the do loop starts here
-                while (queue.empty()) {
-                    if ((fMaster || fQuit) && nTodo == 0) {
-                        nTotal--;
-                        bool fRet = fAllOk;
-                        // reset the status for new work later
-                        if (fMaster)
-                            fAllOk = true;
-                        // return the current status
-                        return fRet;
-                    }
+                // Jobs being moved by a thief, or being run by the workers
+                if (nQueued == 0)
+                    condMaster.wait(lock);
+            } else {
+                while (nQueued == 0) {
                     nIdle++;
-                    cond.wait(lock); // wait
+                    condWorker.wait(lock); // wait
                     nIdle--;
                 }
-                // Decide how many work units to process now.
-                // * Do not try to do everything at once, but aim for increasingly smaller batches so
-                //   all workers finish approximately simultaneously.
-                // * Try to account for idle jobs which will instantly start helping.
-                // * Don't do batches smaller than 1 (duh), or larger than nBatchSize.
-                nNow = std::max(1U, std::min(nBatchSize, (unsigned int)queue.size() / (nTotal + nIdle + 1)));
-                vChecks.resize(nNow);
-                for (unsigned int i = 0; i < nNow; i++) {
-                    // We want the lock on the mutex to be as short as possible, so swap jobs from the global
-                    // queue to the local batch vector instead of copying.
-                    vChecks[i].swap(queue.back());
-                    queue.pop_back();
-                }
-                // Check whether we need to do work at all
-                fOk = fAllOk;
             }
-            // execute work
-            BOOST_FOREACH (T& check, vChecks)
-                if (fOk)
-                    fOk = check();
-            vChecks.clear();
         } while (true);
     }
 
 public:
     //! Create a new check queue
-    CCheckQueue(unsigned int nBatchSizeIn) : nIdle(0), nTotal(0), fAllOk(true), nTodo(0), fQuit(false), nBatchSize(nBatchSizeIn) {}
+    CCheckQueue(unsigned int nBatchSizeIn, unsigned int nMaxWorkersIn) :
+        queues(new WorkerQueue[nMaxWorkersIn + 1]), nMaxWorkers(nMaxWorkersIn), nWorkers(0), nIdle(0),
+        fAllOk(true), nTodo(0), nQueued(0), nBatchSize(nBatchSizeIn) {}
 
     //! Worker thread
     void Thread()
     {
-        Loop();
+        unsigned int nQueue = ++nWorkers;
+        assert(nQueue <= nMaxWorkers);
+        Loop(nQueue);
     }
 
     //! Wait until execution finishes, and return whether all evaluations were successful.
     bool Wait()
     {
-        return Loop(true);
+        return Loop(0, true);
     }
 
     //! Add a batch of checks to the queue
     void Add(std::vector<T>& vChecks)
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        BOOST_FOREACH (T& check, vChecks) {
-            queue.push_back(T());
-            check.swap(queue.back());
+        if (vChecks.empty())
+            return;
+        // The result is already known
+        if (!fAllOk) {
+            vChecks.clear();
+            return;
         }
+
+        std::vector<std::pair<unsigned int, unsigned int> > vOrder(vChecks.size());
+        for (unsigned int i = 0; i < vChecks.size(); i++)
+            vOrder[i] = std::make_pair(std::max(1U, vChecks[i].GetCost()), i);
+        std::sort(vOrder.rbegin(), vOrder.rend());
+
+        // The master only gets work of its own when there are no workers.
+        // Each check goes to the deque with the least work, as it was when
+        // this batch started plus what the batch gave it so far.
+        unsigned int nQueues = nWorkers + 1;
+        unsigned int nFirst = nQueues > 1 ? 1 : 0;
+        typedef std::pair<int64_t, unsigned int> QueueCost;
+        std::priority_queue<QueueCost, std::vector<QueueCost>, std::greater<QueueCost> > heap;
+        for (unsigned int i = nFirst; i < nQueues; i++)
+            heap.push(std::make_pair(queues[i].nCost.load(std::memory_order_relaxed), i));
+        std::vector<std::vector<unsigned int> > vAssigned(nQueues);
+        for (unsigned int i = 0; i < vOrder.size(); i++) {
+            QueueCost least = heap.top();
+            heap.pop();
+            vAssigned[least.second].push_back(i);
+            least.first += vOrder[i].first;
+            heap.push(least);
+        }
+
         nTodo += vChecks.size();
-        if (vChecks.size() == 1)
-            condWorker.notify_one();
-        else if (vChecks.size() > 1)
-            condWorker.notify_all();
+        for (unsigned int nQueue = nFirst; nQueue < nQueues; nQueue++) {
+            if (vAssigned[nQueue].empty())
+                continue;
+            WorkerQueue& queue = queues[nQueue];
+            boost::unique_lock<boost::mutex> lock(queue.mutex);
+            BOOST_FOREACH(unsigned int i, vAssigned[nQueue]) {
+                queue.jobs.push_back(Job());
+                queue.jobs.back().check.swap(vChecks[vOrder[i].second]);
+                queue.jobs.back().nCost = vOrder[i].first;
+                queue.nCost += vOrder[i].first;
+            }
+            nQueued += vAssigned[nQueue].size();
+        }
+        vChecks.clear();
+
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (nIdle > 0) {
+            if (vOrder.size() == 1)
+                condWorker.notify_one();
+            else
+                condWorker.notify_all();
+        }
     }
 
     ~CCheckQueue()
@@ -163,13 +297,12 @@ public:
 
     bool IsIdle()
     {
-        boost::unique_lock<boost::mutex> lock(mutex);
-        return (nTotal == nIdle && nTodo == 0 && fAllOk == true);
+        return (nTodo == 0 && fAllOk == true);
     }
 
 };
 
-/** 
+/**
  * RAII-style controller object for a CCheckQueue that guarantees the passed
  * queue is finished before continuing.
  */
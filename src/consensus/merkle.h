@@ -12,7 +12,17 @@
 #include "primitives/block.h"
 #include "uint256.h"
 
-uint256 ComputeMerkleRoot(const std::vector<uint256>& leaves, bool* mutated = NULL);
+/*
+ * Compute the Merkle root of a list of hashes. Each level of the tree is
+ * hashed in one batch. *mutated is set to true if two identical hashes were
+ * paired at any level.
+ */
+uint256 ComputeMerkleRoot(std::vector<uint256> hashes, bool* mutated = NULL);
+/*
+ * Compute all levels of the Merkle tree over leaves: the leaves themselves
+ * first, the root last.
+ */
+std::vector<std::vector<uint256> > ComputeMerkleTree(const std::vector<uint256>& leaves);
 std::vector<uint256> ComputeMerkleBranch(const std::vector<uint256>& leaves, uint32_t position);
 uint256 ComputeMerkleRootFromBranch(const uint256& leaf, const std::vector<uint256>& branch, uint32_t position);
 
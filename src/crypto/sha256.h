@@ -7,6 +7,8 @@
 
 #include <stdint.h>
 #include <stdlib.h>
+#include <string>
+#include <vector>
 
 /** A hasher class for SHA-256. */
 class CSHA256
@@ -25,4 +27,34 @@ public:
     CSHA256& Reset();
 };
 
+/** Autodetect the best available SHA256 implementation, and check it.
+ *  Returns the name of the implementation.
+ */
+std::string SHA256AutoDetect();
+
+/** A double-SHA256 implementation for 64-byte blobs, hashing a fixed number of them per call. */
+struct SHA256D64Kernel
+{
+    std::string name;
+    size_t ways;
+    void (*transform)(unsigned char* output, const unsigned char* input);
+
+    SHA256D64Kernel(const std::string& nameIn, size_t waysIn, void (*transformIn)(unsigned char*, const unsigned char*)) :
+        name(nameIn), ways(waysIn), transform(transformIn) {}
+};
+
+/** The double-SHA256 implementations that are compiled in and supported by
+ *  this CPU, whether or not SHA256AutoDetect selects them. The portable one
+ *  comes first. Meant for tests.
+ */
+std::vector<SHA256D64Kernel> SHA256D64Kernels();
+
+/** Compute multiple double-SHA256's of 64-byte blobs.
+ *  output:  pointer to a blocks*32 byte output buffer
+ *  input:   pointer to a blocks*64 byte input buffer
+ *  blocks:  the number of hashes to compute.
+ *  The output may overwrite the input in place.
+ */
+void SHA256D64(unsigned char* output, const unsigned char* input, size_t blocks);
+
 #endif // BITCOIN_CRYPTO_SHA256_H
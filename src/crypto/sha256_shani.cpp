@@ -0,0 +1,161 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+//
+// SHA-256 using the Intel SHA extensions. The state is kept as two vectors,
+// ABEF and CDGH, as the sha256rnds2 instruction expects.
+
+#ifdef ENABLE_SHANI
+
+#include <stddef.h>
+#include <stdint.h>
+#include <immintrin.h>
+
+namespace {
+
+//! Round constants
+const uint32_t K[64] = {
+    0x428a2f98ul, 0x71374491ul, 0xb5c0fbcful, 0xe9b5dba5ul, 0x3956c25bul, 0x59f111f1ul, 0x923f82a4ul, 0xab1c5ed5ul,
+    0xd807aa98ul, 0x12835b01ul, 0x243185beul, 0x550c7dc3ul, 0x72be5d74ul, 0x80deb1feul, 0x9bdc06a7ul, 0xc19bf174ul,
+    0xe49b69c1ul, 0xefbe4786ul, 0x0fc19dc6ul, 0x240ca1ccul, 0x2de92c6ful, 0x4a7484aaul, 0x5cb0a9dcul, 0x76f988daul,
+    0x983e5152ul, 0xa831c66dul, 0xb00327c8ul, 0xbf597fc7ul, 0xc6e00bf3ul, 0xd5a79147ul, 0x06ca6351ul, 0x14292967ul,
+    0x27b70a85ul, 0x2e1b2138ul, 0x4d2c6dfcul, 0x53380d13ul, 0x650a7354ul, 0x766a0abbul, 0x81c2c92eul, 0x92722c85ul,
+    0xa2bfe8a1ul, 0xa81a664bul, 0xc24b8b70ul, 0xc76c51a3ul, 0xd192e819ul, 0xd6990624ul, 0xf40e3585ul, 0x106aa070ul,
+    0x19a4c116ul, 0x1e376c08ul, 0x2748774cul, 0x34b0bcb5ul, 0x391c0cb3ul, 0x4ed8aa4aul, 0x5b9cca4ful, 0x682e6ff3ul,
+    0x748f82eeul, 0x78a5636ful, 0x84c87814ul, 0x8cc70208ul, 0x90befffaul, 0xa4506cebul, 0xbef9a3f7ul, 0xc67178f2ul
+};
+
+//! Byte order swap of each 32-bit word
+__m128i inline ByteSwapMask() { return _mm_set_epi64x(0x0c0d0e0f08090a0bull, 0x0405060700010203ull); }
+
+/** Four rounds, consuming message words 4*i to 4*i+3. */
+void inline QuadRound(__m128i& abef, __m128i& cdgh, __m128i m, int i)
+{
+    __m128i msg = _mm_add_epi32(m, _mm_loadu_si128((const __m128i*)&K[4 * i]));
+    cdgh = _mm_sha256rnds2_epu32(cdgh, abef, msg);
+    abef = _mm_sha256rnds2_epu32(abef, cdgh, _mm_shuffle_epi32(msg, 0x0e));
+}
+
+/**
+ * The next four message words, from the previous sixteen: m0 holds the
+ * oldest four, m3 the most recent.
+ */
+__m128i inline NextMessage(__m128i m0, __m128i m1, __m128i m2, __m128i m3)
+{
+    return _mm_sha256msg2_epu32(_mm_add_epi32(_mm_sha256msg1_epu32(m0, m1), _mm_alignr_epi8(m3, m2, 4)), m3);
+}
+
+/**
+ * A SHA-256 transformation of N independent states, with the message in m
+ * (four words per vector). The states are interleaved so that the rounds of
+ * one can execute while the others wait for their results.
+ */
+template<int N>
+void inline Transform(__m128i (&abef)[N], __m128i (&cdgh)[N], __m128i (&m)[N][4])
+{
+    __m128i abef_save[N], cdgh_save[N];
+    for (int l = 0; l < N; l++) {
+        abef_save[l] = abef[l];
+        cdgh_save[l] = cdgh[l];
+    }
+    for (int i = 0; i < 16; i++) {
+        for (int l = 0; l < N; l++) {
+            if (i >= 4)
+                m[l][i & 3] = NextMessage(m[l][i & 3], m[l][(i + 1) & 3], m[l][(i + 2) & 3], m[l][(i + 3) & 3]);
+            QuadRound(abef[l], cdgh[l], m[l][i & 3], i);
+        }
+    }
+    for (int l = 0; l < N; l++) {
+        abef[l] = _mm_add_epi32(abef[l], abef_save[l]);
+        cdgh[l] = _mm_add_epi32(cdgh[l], cdgh_save[l]);
+    }
+}
+
+/** Convert the state words s[0..3], s[4..7] to ABEF/CDGH order. */
+void inline Shuffle(__m128i dcba, __m128i hgfe, __m128i& abef, __m128i& cdgh)
+{
+    __m128i cdab = _mm_shuffle_epi32(dcba, 0xb1);
+    __m128i efgh = _mm_shuffle_epi32(hgfe, 0x1b);
+    abef = _mm_alignr_epi8(cdab, efgh, 8);
+    cdgh = _mm_blend_epi16(efgh, cdab, 0xf0);
+}
+
+/** Convert ABEF/CDGH back to the state words s[0..3], s[4..7]. */
+void inline Unshuffle(__m128i abef, __m128i cdgh, __m128i& dcba, __m128i& hgfe)
+{
+    __m128i feba = _mm_shuffle_epi32(abef, 0x1b);
+    __m128i dchg = _mm_shuffle_epi32(cdgh, 0xb1);
+    dcba = _mm_blend_epi16(feba, dchg, 0xf0);
+    hgfe = _mm_alignr_epi8(dchg, feba, 8);
+}
+
+void inline Initialize(__m128i& abef, __m128i& cdgh)
+{
+    Shuffle(_mm_set_epi32(0xa54ff53aul, 0x3c6ef372ul, 0xbb67ae85ul, 0x6a09e667ul),
+            _mm_set_epi32(0x5be0cd19ul, 0x1f83d9abul, 0x9b05688cul, 0x510e527ful), abef, cdgh);
+}
+
+/** Load a 64-byte big endian message */
+void inline Load(__m128i (&m)[4], const unsigned char* chunk)
+{
+    for (int i = 0; i < 4; i++)
+        m[i] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i*)(chunk + 16 * i)), ByteSwapMask());
+}
+
+} // namespace
+
+namespace sha256_shani {
+void Transform(uint32_t* s, const unsigned char* chunk, size_t blocks)
+{
+    __m128i abef[1], cdgh[1], m[1][4];
+    Shuffle(_mm_loadu_si128((const __m128i*)s), _mm_loadu_si128((const __m128i*)(s + 4)), abef[0], cdgh[0]);
+    while (blocks--) {
+        Load(m[0], chunk);
+        ::Transform<1>(abef, cdgh, m);
+        chunk += 64;
+    }
+    __m128i dcba, hgfe;
+    Unshuffle(abef[0], cdgh[0], dcba, hgfe);
+    _mm_storeu_si128((__m128i*)s, dcba);
+    _mm_storeu_si128((__m128i*)(s + 4), hgfe);
+}
+} // namespace sha256_shani
+
+namespace sha256d64_shani {
+void Transform_2way(unsigned char* out, const unsigned char* in)
+{
+    __m128i abef[2], cdgh[2], m[2][4];
+    __m128i dcba, hgfe;
+
+    // First hash: the input, then its padding
+    for (int l = 0; l < 2; l++) {
+        Initialize(abef[l], cdgh[l]);
+        Load(m[l], in + 64 * l);
+    }
+    ::Transform<2>(abef, cdgh, m);
+    for (int l = 0; l < 2; l++) {
+        m[l][0] = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+        m[l][1] = _mm_setzero_si128();
+        m[l][2] = _mm_setzero_si128();
+        m[l][3] = _mm_set_epi32(512, 0, 0, 0);
+    }
+    ::Transform<2>(abef, cdgh, m);
+
+    // Second hash: the first hash, followed by its padding
+    for (int l = 0; l < 2; l++) {
+        Unshuffle(abef[l], cdgh[l], m[l][0], m[l][1]);
+        m[l][2] = _mm_set_epi32(0, 0, 0, 0x80000000ul);
+        m[l][3] = _mm_set_epi32(256, 0, 0, 0);
+        Initialize(abef[l], cdgh[l]);
+    }
+    ::Transform<2>(abef, cdgh, m);
+
+    for (int l = 0; l < 2; l++) {
+        Unshuffle(abef[l], cdgh[l], dcba, hgfe);
+        _mm_storeu_si128((__m128i*)(out + 32 * l), _mm_shuffle_epi8(dcba, ByteSwapMask()));
+        _mm_storeu_si128((__m128i*)(out + 32 * l + 16), _mm_shuffle_epi8(hgfe, ByteSwapMask()));
+    }
+}
+} // namespace sha256d64_shani
+
+#endif
@@ -56,6 +56,11 @@ public:
      */
     CDBBatch(const CDBWrapper &parent) : parent(parent) { };
 
+    void Clear()
+    {
+        batch.Clear();
+    }
+
     template <typename K, typename V>
     void Write(const K& key, const V& value)
     {
@@ -85,6 +90,31 @@ public:
     }
 };
 
+/**
+ * A consistent, read-only view of a CDBWrapper as of the moment it was taken.
+ * Reads and iterators given the snapshot do not see writes committed after it,
+ * so several of them together observe a single state of the database. The
+ * snapshot must not outlive its parent.
+ */
+class CDBSnapshot
+{
+    friend class CDBWrapper;
+
+private:
+    const CDBWrapper &parent;
+    const leveldb::Snapshot *psnapshot;
+
+    CDBSnapshot(const CDBSnapshot&);
+    void operator=(const CDBSnapshot&);
+
+public:
+    /**
+     * @param[in] parent    CDBWrapper to take the snapshot of
+     */
+    CDBSnapshot(const CDBWrapper &parent);
+    ~CDBSnapshot();
+};
+
 class CDBIterator
 {
 private:
@@ -105,6 +135,8 @@ public:
 
     void SeekToFirst();
 
+    void SeekToLast();
+
     template<typename K> void Seek(const K& key) {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
@@ -115,6 +147,8 @@ public:
 
     void Next();
 
+    void Prev();
+
     template<typename K> bool GetKey(K& key) {
         leveldb::Slice slKey = piter->key();
         try {
@@ -151,6 +185,7 @@ public:
 class CDBWrapper
 {
     friend const std::vector<unsigned char>& dbwrapper_private::GetObfuscateKey(const CDBWrapper &w);
+    friend class CDBSnapshot;
 private:
     //! custom environment this database is using (may be NULL in case of default environment)
     leveldb::Env* penv;
@@ -184,6 +219,9 @@ private:
 
     std::vector<unsigned char> CreateObfuscateKey() const;
 
+    //! Return options, pinned to psnapshot if it is not NULL
+    leveldb::ReadOptions GetReadOptions(const leveldb::ReadOptions &base, const CDBSnapshot *psnapshot) const;
+
 public:
     /**
      * @param[in] path          Location in the filesystem where leveldb data will be stored.
@@ -194,12 +232,19 @@ public:
      *                          with a zero'd byte array.
      * @param[in] compression   Enable snappy compression for the database
      * @param[in] maxOpenFiles  The maximum number of open files for the database
+     * @param[in] bloomBits     Bits per key of the bloom filter used for point reads
+     * @param[in] nWriteBufferSize  Size of the write buffer. If zero, nCacheSize is split between
+     *                          the block cache and the write buffers, otherwise nCacheSize is
+     *                          used entirely for the block cache.
      */
-    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, bool compression = false, int maxOpenFiles = 64);
+    CDBWrapper(const boost::filesystem::path& path, size_t nCacheSize, bool fMemory = false, bool fWipe = false, bool obfuscate = false, bool compression = false, int maxOpenFiles = 64, int bloomBits = 10, size_t nWriteBufferSize = 0);
     ~CDBWrapper();
 
+    /**
+     * @param[in] psnapshot     If not NULL, read the value as of this snapshot of the database.
+     */
     template <typename K, typename V>
-    bool Read(const K& key, V& value) const
+    bool Read(const K& key, V& value, const CDBSnapshot *psnapshot = NULL) const
     {
         CDataStream ssKey(SER_DISK, CLIENT_VERSION);
         ssKey.reserve(ssKey.GetSerializeSize(key));
@@ -207,7 +252,7 @@ public:
         leveldb::Slice slKey(&ssKey[0], ssKey.size());
 
         std::string strValue;
-        leveldb::Status status = pdb->Get(readoptions, slKey, &strValue);
+        leveldb::Status status = pdb->Get(GetReadOptions(readoptions, psnapshot), slKey, &strValue);
         if (!status.ok()) {
             if (status.IsNotFound())
                 return false;
@@ -273,9 +318,12 @@ public:
         return WriteBatch(batch, true);
     }
 
-    CDBIterator *NewIterator()
+    /**
+     * @param[in] psnapshot     If not NULL, iterate over the database as of this snapshot.
+     */
+    CDBIterator *NewIterator(const CDBSnapshot *psnapshot = NULL) const
     {
-        return new CDBIterator(*this, pdb->NewIterator(iteroptions));
+        return new CDBIterator(*this, pdb->NewIterator(GetReadOptions(iteroptions, psnapshot)));
     }
 
     /**
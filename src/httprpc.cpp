@@ -7,6 +7,7 @@
 #include "base58.h"
 #include "chainparams.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/protocol.h"
 #include "rpc/server.h"
 #include "random.h"
@@ -19,11 +20,48 @@
 #include "utilstrencodings.h"
 
 #include <boost/algorithm/string.hpp> // boost::trim
+#include <boost/bind.hpp>
 #include <boost/foreach.hpp> //BOOST_FOREACH
 
 /** WWW-Authenticate to present with 401 Unauthorized response */
 static const char* WWW_AUTH_HEADER_DATA = "Basic realm=\"jsonrpc\"";
 
+/** Largest request body that is parsed to determine the priority of the request */
+static const size_t MAX_CLASSIFIED_BODY_SIZE = 64 * 1024;
+
+/** Default priorities of RPC methods; others have normal priority */
+static const struct {
+    const char* method;
+    HTTPPriority priority;
+} rpcPriorityDefaults[] = {
+    // Answered from memory, typically used for health checks and polling
+    { "getbestblockhash",       HTTP_PRIORITY_HIGH },
+    { "getblockcount",          HTTP_PRIORITY_HIGH },
+    { "getblockhash",           HTTP_PRIORITY_HIGH },
+    { "getconnectioncount",     HTTP_PRIORITY_HIGH },
+    { "getdifficulty",          HTTP_PRIORITY_HIGH },
+    { "gethttpqueueinfo",       HTTP_PRIORITY_HIGH },
+    { "getinfo",                HTTP_PRIORITY_HIGH },
+    { "getmempoolinfo",         HTTP_PRIORITY_HIGH },
+    { "getnetworkinfo",         HTTP_PRIORITY_HIGH },
+    { "getspentindexcacheinfo", HTTP_PRIORITY_HIGH },
+    { "ping",                   HTTP_PRIORITY_HIGH },
+    // Scan indexes, the block index, the mempool or the UTXO set
+    { "getaddressbalance",      HTTP_PRIORITY_LOW },
+    { "getaddressdeltas",       HTTP_PRIORITY_LOW },
+    { "getaddressmempool",      HTTP_PRIORITY_LOW },
+    { "getaddresssummary",      HTTP_PRIORITY_LOW },
+    { "getaddresstxids",        HTTP_PRIORITY_LOW },
+    { "getaddressutxos",        HTTP_PRIORITY_LOW },
+    { "getblockdeltas",         HTTP_PRIORITY_LOW },
+    { "getblockdeltasrange",    HTTP_PRIORITY_LOW },
+    { "getblockhashes",         HTTP_PRIORITY_LOW },
+    { "getchaintips",           HTTP_PRIORITY_LOW },
+    { "getrawmempool",          HTTP_PRIORITY_LOW },
+    { "gettxoutsetinfo",        HTTP_PRIORITY_LOW },
+    { "verifychain",            HTTP_PRIORITY_LOW },
+};
+
 /** Simple one-shot callback timer to be used by the RPC mechanism to e.g.
  * re-lock the wellet.
  */
@@ -65,6 +103,8 @@ private:
 static std::string strRPCUserColonPass;
 /* Stored RPC timer interface (for unregistration) */
 static HTTPRPCTimerInterface* httpRPCTimerInterface = 0;
+/* Priority of RPC methods, from rpcPriorityDefaults and -rpcpriority */
+static std::map<std::string, HTTPPriority> mapRPCPriority;
 
 static void JSONErrorReply(HTTPRequest* req, const UniValue& objError, const UniValue& id)
 {
@@ -144,6 +184,43 @@ static bool RPCAuthorized(const std::string& strAuth)
     return multiUserAuthorized(strUserPass);
 }
 
+static HTTPPriority JSONRPCMethodPriority(const UniValue& request)
+{
+    if (!request.isObject())
+        return HTTP_PRIORITY_NORMAL;
+    const UniValue& method = find_value(request.get_obj(), "method");
+    if (!method.isStr())
+        return HTTP_PRIORITY_NORMAL;
+    std::map<std::string, HTTPPriority>::const_iterator it = mapRPCPriority.find(method.get_str());
+    return it == mapRPCPriority.end() ? HTTP_PRIORITY_NORMAL : it->second;
+}
+
+/** Determine the priority of a JSON-RPC request from its method, or the lowest priority of the methods of a batch */
+static HTTPPriority JSONRPCRequestPriority(HTTPRequest* req, const std::string &)
+{
+    // Failed logins are delayed on the worker, keep them from occupying the other lanes
+    std::pair<bool, std::string> authHeader = req->GetHeader("authorization");
+    if (!authHeader.first || !RPCAuthorized(authHeader.second))
+        return HTTP_PRIORITY_LOW;
+
+    // Parsing large batches here would stall the event loop
+    std::string strBody;
+    if (!req->PeekBody(strBody, MAX_CLASSIFIED_BODY_SIZE))
+        return HTTP_PRIORITY_LOW;
+    UniValue valRequest;
+    if (!valRequest.read(strBody))
+        return HTTP_PRIORITY_NORMAL;
+
+    if (!valRequest.isArray())
+        return JSONRPCMethodPriority(valRequest);
+    if (valRequest.empty())
+        return HTTP_PRIORITY_NORMAL;
+    HTTPPriority priority = HTTP_PRIORITY_HIGH;
+    for (unsigned int i = 0; i < valRequest.size(); i++)
+        priority = std::max(priority, JSONRPCMethodPriority(valRequest[i]));
+    return priority;
+}
+
 static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
 {
     // JSONRPC handles only POST
@@ -179,24 +256,37 @@ static bool HTTPReq_JSONRPC(HTTPRequest* req, const std::string &)
         if (!valRequest.read(req->ReadBody()))
             throw JSONRPCError(RPC_PARSE_ERROR, "Parse error");
 
-        std::string strReply;
         // singleton request
         if (valRequest.isObject()) {
             jreq.parse(valRequest);
 
             UniValue result = tableRPC.execute(jreq.strMethod, jreq.params);
 
-            // Send reply
-            strReply = JSONRPCReply(result, NullUniValue, jreq.id);
+            // Send reply. It is streamed from the result, large results are
+            // never copied into a reply object or string as a whole.
+            req->WriteHeader("Content-Type", "application/json");
+            HTTPReplyStream stream(req, HTTP_OK);
+            CJSONStreamWriter writer(boost::bind(&HTTPReplyStream::Write, &stream, _1));
+            writer.BeginObject();
+            writer.Key("result");
+            writer.Value(result);
+            writer.Key("error");
+            writer.Value(NullUniValue);
+            writer.Key("id");
+            writer.Value(jreq.id);
+            writer.EndObject();
+            writer.Raw("\n");
+            stream.End();
 
         // array of requests
-        } else if (valRequest.isArray())
-            strReply = JSONRPCExecBatch(valRequest.get_array());
-        else
+        } else if (valRequest.isArray()) {
+            req->WriteHeader("Content-Type", "application/json");
+            HTTPReplyStream stream(req, HTTP_OK);
+            CJSONStreamWriter writer(boost::bind(&HTTPReplyStream::Write, &stream, _1));
+            JSONRPCExecBatch(valRequest.get_array(), writer);
+            stream.End();
+        } else
             throw JSONRPCError(RPC_PARSE_ERROR, "Top-level object parse error");
-
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strReply);
     } catch (const UniValue& objError) {
         JSONErrorReply(req, objError, jreq.id);
         return false;
@@ -225,13 +315,41 @@ static bool InitRPCAuthentication()
     return true;
 }
 
+static bool InitRPCPriorities()
+{
+    mapRPCPriority.clear();
+    for (unsigned int i = 0; i < ARRAYLEN(rpcPriorityDefaults); i++)
+        mapRPCPriority[rpcPriorityDefaults[i].method] = rpcPriorityDefaults[i].priority;
+
+    if (mapMultiArgs.count("-rpcpriority")) {
+        BOOST_FOREACH(const std::string& strPriority, mapMultiArgs["-rpcpriority"]) {
+            size_t nColon = strPriority.find(':');
+            std::string strMethod = strPriority.substr(0, nColon);
+            std::string strClass = nColon == std::string::npos ? "" : strPriority.substr(nColon + 1);
+            int p = 0;
+            while (p < HTTP_PRIORITY_COUNT && strClass != HTTPPriorityName((HTTPPriority)p))
+                p++;
+            if (strMethod.empty() || p == HTTP_PRIORITY_COUNT) {
+                uiInterface.ThreadSafeMessageBox(
+                    strprintf(_("Invalid -rpcpriority specification: %s. Use <method>:<high|normal|low>."), strPriority),
+                    "", CClientUIInterface::MSG_ERROR);
+                return false;
+            }
+            mapRPCPriority[strMethod] = (HTTPPriority)p;
+        }
+    }
+    return true;
+}
+
 bool StartHTTPRPC()
 {
     LogPrint("rpc", "Starting HTTP RPC server\n");
     if (!InitRPCAuthentication())
         return false;
+    if (!InitRPCPriorities())
+        return false;
 
-    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC);
+    RegisterHTTPHandler("/", true, HTTPReq_JSONRPC, JSONRPCRequestPriority);
 
     assert(EventBase());
     httpRPCTimerInterface = new HTTPRPCTimerInterface(EventBase());
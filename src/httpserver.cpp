@@ -60,17 +60,33 @@ private:
     HTTPRequestHandler func;
 };
 
-/** Simple work queue for distributing work over multiple threads.
+/** Work queue for distributing work over multiple threads, with a lane for
+ * each priority class. Workers take items from the highest priority lane
+ * first, and lower priority lanes may only occupy part of the workers: normal
+ * and low priority items leave one worker free for high priority ones, and
+ * low priority items use at most half of the workers. A few expensive
+ * requests thus cannot delay cheap ones.
  * Work items are simply callable objects.
  */
 template <typename WorkItem>
 class WorkQueue
 {
 private:
+    struct Entry
+    {
+        std::unique_ptr<WorkItem> item;
+        int64_t nTimeQueued;
+    };
+    struct Lane
+    {
+        std::deque<Entry> queue;
+        HTTPWorkQueueLaneStats stats;
+    };
+
     /** Mutex protects entire object */
     CWaitableCriticalSection cs;
     CConditionVariable cond;
-    std::deque<std::unique_ptr<WorkItem>> queue;
+    Lane lanes[HTTP_PRIORITY_COUNT];
     bool running;
     size_t maxDepth;
     int numThreads;
@@ -93,11 +109,51 @@ private:
         }
     };
 
+    /** Maximum number of workers that items of this priority and lower may occupy together */
+    int MaxRunning(int priority) const
+    {
+        switch (priority) {
+        case HTTP_PRIORITY_HIGH:
+            return std::max(numThreads, 1);
+        case HTTP_PRIORITY_NORMAL:
+            return std::max(numThreads - 1, 1);
+        default:
+            return std::max(numThreads / 2, 1);
+        }
+    }
+
+    /** Number of workers running items of this priority and lower */
+    int RunningAtOrBelow(int priority) const
+    {
+        int count = 0;
+        for (int p = priority; p < HTTP_PRIORITY_COUNT; p++)
+            count += lanes[p].stats.nRunning;
+        return count;
+    }
+
+    /** Take the next item a worker may run, if any. cs must be held. */
+    bool Pop(Entry& entry, int& priority)
+    {
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++) {
+            if (RunningAtOrBelow(p) >= MaxRunning(p))
+                return false; // The limit of this lane holds for the lower ones as well
+            if (lanes[p].queue.empty())
+                continue;
+            entry = std::move(lanes[p].queue.front());
+            lanes[p].queue.pop_front();
+            priority = p;
+            return true;
+        }
+        return false;
+    }
+
 public:
     WorkQueue(size_t maxDepth) : running(true),
                                  maxDepth(maxDepth),
                                  numThreads(0)
     {
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++)
+            memset(&lanes[p].stats, 0, sizeof(lanes[p].stats));
     }
     /** Precondition: worker threads have all stopped
      * (call WaitExit)
@@ -105,14 +161,19 @@ public:
     ~WorkQueue()
     {
     }
-    /** Enqueue a work item */
-    bool Enqueue(WorkItem* item)
+    /** Enqueue a work item in the lane of its priority */
+    bool Enqueue(WorkItem* item, HTTPPriority priority)
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        if (queue.size() >= maxDepth) {
+        Lane& lane = lanes[priority];
+        if (lane.queue.size() >= maxDepth) {
+            lane.stats.nRejected++;
             return false;
         }
-        queue.emplace_back(std::unique_ptr<WorkItem>(item));
+        Entry entry;
+        entry.item.reset(item);
+        entry.nTimeQueued = GetTimeMicros();
+        lane.queue.push_back(std::move(entry));
         cond.notify_one();
         return true;
     }
@@ -121,17 +182,29 @@ public:
     {
         ThreadCounter count(*this);
         while (running) {
-            std::unique_ptr<WorkItem> i;
+            Entry entry;
+            int priority;
             {
                 boost::unique_lock<boost::mutex> lock(cs);
-                while (running && queue.empty())
+                while (running && !Pop(entry, priority))
                     cond.wait(lock);
                 if (!running)
                     break;
-                i = std::move(queue.front());
-                queue.pop_front();
+                HTTPWorkQueueLaneStats& stats = lanes[priority].stats;
+                stats.nWaitLast = GetTimeMicros() - entry.nTimeQueued;
+                stats.nWaitTotal += stats.nWaitLast;
+                stats.nWaitMax = std::max(stats.nWaitMax, stats.nWaitLast);
+                stats.nRunning++;
+            }
+            (*entry.item)();
+            entry.item.reset();
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                lanes[priority].stats.nRunning--;
+                lanes[priority].stats.nProcessed++;
+                // Items held back by the limits may be runnable now
+                cond.notify_all();
             }
-            (*i)();
         }
     }
     /** Interrupt and exit loops */
@@ -153,20 +226,40 @@ public:
     size_t Depth()
     {
         boost::unique_lock<boost::mutex> lock(cs);
-        return queue.size();
+        size_t depth = 0;
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++)
+            depth += lanes[p].queue.size();
+        return depth;
+    }
+
+    /** Return the state of each lane */
+    std::vector<HTTPWorkQueueLaneStats> Stats()
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        std::vector<HTTPWorkQueueLaneStats> vStats;
+        for (int p = 0; p < HTTP_PRIORITY_COUNT; p++) {
+            vStats.push_back(lanes[p].stats);
+            vStats.back().nQueued = lanes[p].queue.size();
+            vStats.back().nMaxQueued = maxDepth;
+            vStats.back().nMaxRunning = MaxRunning(p);
+        }
+        return vStats;
     }
 };
 
 struct HTTPPathHandler
 {
     HTTPPathHandler() {}
-    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler):
-        prefix(prefix), exactMatch(exactMatch), handler(handler)
+    HTTPPathHandler(std::string prefix, bool exactMatch, HTTPRequestHandler handler, HTTPPriority priority, HTTPRequestClassifier classifier):
+        prefix(prefix), exactMatch(exactMatch), handler(handler), priority(priority), classifier(classifier)
     {
     }
     std::string prefix;
     bool exactMatch;
     HTTPRequestHandler handler;
+    //! Priority of requests, unless a classifier is set
+    HTTPPriority priority;
+    HTTPRequestClassifier classifier;
 };
 
 /** HTTP module state */
@@ -242,6 +335,20 @@ static std::string RequestMethodString(HTTPRequest::RequestMethod m)
     }
 }
 
+const char* HTTPPriorityName(HTTPPriority priority)
+{
+    switch (priority) {
+    case HTTP_PRIORITY_HIGH:
+        return "high";
+    case HTTP_PRIORITY_NORMAL:
+        return "normal";
+    case HTTP_PRIORITY_LOW:
+        return "low";
+    default:
+        return "unknown";
+    }
+}
+
 /** HTTP request callback */
 static void http_request_cb(struct evhttp_request* req, void* arg)
 {
@@ -281,12 +388,13 @@ static void http_request_cb(struct evhttp_request* req, void* arg)
 
     // Dispatch to worker thread
     if (i != iend) {
+        HTTPPriority priority = i->classifier ? i->classifier(hreq.get(), path) : i->priority;
         std::unique_ptr<HTTPWorkItem> item(new HTTPWorkItem(std::move(hreq), path, i->handler));
         assert(workQueue);
-        if (workQueue->Enqueue(item.get()))
+        if (workQueue->Enqueue(item.get(), priority))
             item.release(); /* if true, queue took ownership */
         else {
-            LogPrintf("WARNING: request rejected because http work queue depth exceeded, it can be increased with the -rpcworkqueue= setting\n");
+            LogPrintf("WARNING: request rejected because http work queue depth exceeded for %s priority requests, it can be increased with the -rpcworkqueue= setting\n", HTTPPriorityName(priority));
             item->req->WriteReply(HTTP_INTERNAL, "Work queue depth exceeded");
         }
     } else {
@@ -451,6 +559,13 @@ bool StartHTTPServer()
     return true;
 }
 
+std::vector<HTTPWorkQueueLaneStats> GetHTTPWorkQueueStats()
+{
+    if (!workQueue)
+        return std::vector<HTTPWorkQueueLaneStats>();
+    return workQueue->Stats();
+}
+
 void InterruptHTTPServer()
 {
     LogPrint("http", "Interrupting HTTP server\n");
@@ -473,6 +588,7 @@ void StopHTTPServer()
         LogPrint("http", "Waiting for HTTP worker threads to exit\n");
         workQueue->WaitExit();
         delete workQueue;
+        workQueue = 0;
     }
     if (eventBase) {
         LogPrint("http", "Waiting for HTTP event thread to exit\n");
@@ -540,7 +656,11 @@ HTTPRequest::HTTPRequest(struct evhttp_request* req) : req(req),
 }
 HTTPRequest::~HTTPRequest()
 {
-    if (!replySent) {
+    if (chunked) {
+        // Handler stopped in the middle of a chunked reply, the client will see it truncated
+        LogPrintf("%s: Unfinished chunked reply\n", __func__);
+        EndChunkedReply();
+    } else if (!replySent) {
         // Keep track of whether reply was sent to avoid request leaks
         LogPrintf("%s: Unhandled request\n", __func__);
         WriteReply(HTTP_INTERNAL, "Unhandled request");
@@ -579,6 +699,21 @@ std::string HTTPRequest::ReadBody()
     return rv;
 }
 
+bool HTTPRequest::PeekBody(std::string& body, size_t nMaxSize)
+{
+    body.clear();
+    struct evbuffer* buf = evhttp_request_get_input_buffer(req);
+    if (!buf)
+        return true;
+    size_t size = evbuffer_get_length(buf);
+    if (size > nMaxSize)
+        return false;
+    body.resize(size);
+    if (size > 0 && evbuffer_copyout(buf, &body[0], size) != (ev_ssize_t)size)
+        return false;
+    return true;
+}
+
 void HTTPRequest::WriteHeader(const std::string& hdr, const std::string& value)
 {
     struct evkeyvalq* headers = evhttp_request_get_output_headers(req);
@@ -605,6 +740,202 @@ void HTTPRequest::WriteReply(int nStatus, const std::string& strReply)
     req = 0; // transferred back to main thread
 }
 
+/** Callback of evbuffer when a referenced reply body is no longer needed */
+static void http_reference_cleanup_cb(const void* data, size_t size, void* arg)
+{
+    delete static_cast<std::shared_ptr<const void>*>(arg);
+}
+
+void HTTPRequest::WriteReply(int nStatus, const char* data, size_t size, const std::shared_ptr<const void>& pin)
+{
+    assert(!replySent && req);
+    struct evbuffer* evb = evhttp_request_get_output_buffer(req);
+    assert(evb);
+    std::shared_ptr<const void>* ppin = new std::shared_ptr<const void>(pin);
+    if (evbuffer_add_reference(evb, data, size, http_reference_cleanup_cb, ppin) != 0) {
+        delete ppin;
+        evbuffer_add(evb, data, size);
+    }
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(evhttp_send_reply, req, nStatus, (const char*)NULL, (struct evbuffer *)NULL));
+    ev->trigger(0);
+    replySent = true;
+    req = 0; // transferred back to main thread
+}
+
+/** State of a chunked reply, shared by the worker producing it and the main http thread sending it */
+struct HTTPChunkedReply
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    //! Bytes of chunks triggered but not yet handed to evhttp
+    size_t nQueued;
+    //! Bytes handed to evhttp that are not yet written to the client
+    size_t nUnflushed;
+    //! The client connection was closed
+    bool fClosed;
+
+    HTTPChunkedReply() : nQueued(0), nUnflushed(0), fClosed(false) {}
+};
+
+/** Callback of evhttp when the connection of a chunked reply closes */
+static void http_chunked_close_cb(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPChunkedReply* chunked = static_cast<HTTPChunkedReply*>(arg);
+    boost::unique_lock<boost::mutex> lock(chunked->cs);
+    chunked->fClosed = true;
+    chunked->cond.notify_all();
+}
+
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+/** Callback of evhttp when the output of the connection has been written out */
+static void http_chunk_flushed_cb(struct evhttp_connection* evcon, void* arg)
+{
+    HTTPChunkedReply* chunked = static_cast<HTTPChunkedReply*>(arg);
+    boost::unique_lock<boost::mutex> lock(chunked->cs);
+    chunked->nUnflushed = 0;
+    chunked->cond.notify_all();
+}
+#endif
+
+/* The functions below run in the main http thread. If the client went away,
+ * evhttp detaches the request from its connection and these are no-ops, except
+ * that evhttp_send_reply_end frees the request.
+ */
+static void http_chunked_start(struct evhttp_request* req, int nStatus, std::shared_ptr<HTTPChunkedReply> chunked)
+{
+    evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon) {
+        evhttp_connection_set_closecb(evcon, http_chunked_close_cb, chunked.get());
+    } else {
+        // The client is already gone, so the close callback will never come
+        http_chunked_close_cb(NULL, chunked.get());
+    }
+    evhttp_send_reply_start(req, nStatus, NULL);
+}
+
+static void http_chunked_send(struct evhttp_request* req, struct evbuffer* buf, std::shared_ptr<HTTPChunkedReply> chunked)
+{
+    size_t nSize = evbuffer_get_length(buf);
+    if (!evhttp_request_get_connection(req)) {
+        // The client is gone and no flush callback would come: stop the producer
+        evbuffer_free(buf);
+        boost::unique_lock<boost::mutex> lock(chunked->cs);
+        chunked->nQueued -= nSize;
+        chunked->fClosed = true;
+        chunked->cond.notify_all();
+        return;
+    }
+#if LIBEVENT_VERSION_NUMBER >= 0x02010100
+    // Flow control follows the socket: the producer waits until the chunks are written out
+    evhttp_send_reply_chunk_with_cb(req, buf, http_chunk_flushed_cb, chunked.get());
+    size_t nUnflushed = nSize;
+#else
+    // Without write callbacks only the chunks not yet handed to evhttp are bounded
+    evhttp_send_reply_chunk(req, buf);
+    size_t nUnflushed = 0;
+#endif
+    evbuffer_free(buf);
+
+    boost::unique_lock<boost::mutex> lock(chunked->cs);
+    chunked->nQueued -= nSize;
+    chunked->nUnflushed += nUnflushed;
+    chunked->cond.notify_all();
+}
+
+static void http_chunked_end(struct evhttp_request* req, std::shared_ptr<HTTPChunkedReply> chunked)
+{
+    // The reply state goes away after this, evhttp must not call back into it
+    evhttp_connection* evcon = evhttp_request_get_connection(req);
+    if (evcon)
+        evhttp_connection_set_closecb(evcon, NULL, NULL);
+    evhttp_send_reply_end(req);
+}
+
+void HTTPRequest::StartChunkedReply(int nStatus)
+{
+    assert(!replySent && req && !chunked);
+    chunked.reset(new HTTPChunkedReply());
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_chunked_start, req, nStatus, chunked));
+    ev->trigger(0);
+    replySent = true;
+}
+
+bool HTTPRequest::WriteChunk(const std::string& strChunk)
+{
+    assert(req && chunked);
+    if (strChunk.empty())
+        return true;
+    {
+        boost::unique_lock<boost::mutex> lock(chunked->cs);
+        while (!chunked->fClosed && chunked->nQueued + chunked->nUnflushed > HTTP_REPLY_MAX_PENDING)
+            chunked->cond.wait(lock);
+        if (chunked->fClosed)
+            return false;
+        chunked->nQueued += strChunk.size();
+    }
+    struct evbuffer* buf = evbuffer_new();
+    assert(buf);
+    evbuffer_add(buf, strChunk.data(), strChunk.size());
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_chunked_send, req, buf, chunked));
+    ev->trigger(0);
+    return true;
+}
+
+void HTTPRequest::EndChunkedReply()
+{
+    assert(req && chunked);
+    HTTPEvent* ev = new HTTPEvent(eventBase, true,
+        boost::bind(http_chunked_end, req, chunked));
+    ev->trigger(0);
+    chunked.reset();
+    req = 0; // transferred back to main thread
+}
+
+HTTPReplyStream::HTTPReplyStream(HTTPRequest* req, int nStatus, size_t nChunkSize) :
+    req(req), nStatus(nStatus), nChunkSize(nChunkSize), fChunked(false), fEnded(false), fGood(true)
+{
+}
+
+HTTPReplyStream::~HTTPReplyStream()
+{
+    if (!fEnded)
+        End();
+}
+
+bool HTTPReplyStream::Write(const std::string& str)
+{
+    assert(!fEnded);
+    if (!fGood)
+        return false;
+    buffer += str;
+    if (buffer.size() >= nChunkSize) {
+        if (!fChunked) {
+            req->StartChunkedReply(nStatus);
+            fChunked = true;
+        }
+        fGood = req->WriteChunk(buffer);
+        buffer.clear();
+    }
+    return fGood;
+}
+
+void HTTPReplyStream::End()
+{
+    assert(!fEnded);
+    fEnded = true;
+    if (fChunked) {
+        if (fGood)
+            req->WriteChunk(buffer);
+        req->EndChunkedReply();
+    } else {
+        req->WriteReply(nStatus, buffer);
+    }
+    std::string().swap(buffer);
+}
+
 CService HTTPRequest::GetPeer()
 {
     evhttp_connection* con = evhttp_request_get_connection(req);
@@ -645,10 +976,16 @@ HTTPRequest::RequestMethod HTTPRequest::GetRequestMethod()
     }
 }
 
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler)
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, HTTPPriority priority)
+{
+    LogPrint("http", "Registering HTTP handler for %s (exactmatch %d, priority %s)\n", prefix, exactMatch, HTTPPriorityName(priority));
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, priority, HTTPRequestClassifier()));
+}
+
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier)
 {
-    LogPrint("http", "Registering HTTP handler for %s (exactmatch %d)\n", prefix, exactMatch);
-    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler));
+    LogPrint("http", "Registering HTTP handler for %s (exactmatch %d, classified)\n", prefix, exactMatch);
+    pathHandlers.push_back(HTTPPathHandler(prefix, exactMatch, handler, HTTP_PRIORITY_NORMAL, classifier));
 }
 
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch)
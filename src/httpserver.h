@@ -5,7 +5,9 @@
 #ifndef BITCOIN_HTTPSERVER_H
 #define BITCOIN_HTTPSERVER_H
 
+#include <memory>
 #include <string>
+#include <vector>
 #include <stdint.h>
 #include <boost/thread.hpp>
 #include <boost/scoped_ptr.hpp>
@@ -15,9 +17,15 @@ static const int DEFAULT_HTTP_THREADS=4;
 static const int DEFAULT_HTTP_WORKQUEUE=16;
 static const int DEFAULT_HTTP_SERVER_TIMEOUT=30;
 
+/** Size of the chunks a streamed reply is sent in */
+static const size_t HTTP_REPLY_CHUNK_SIZE = 64 * 1024;
+/** Maximum number of bytes of a chunked reply waiting to be sent to the client before the producer blocks */
+static const size_t HTTP_REPLY_MAX_PENDING = 16 * HTTP_REPLY_CHUNK_SIZE;
+
 struct evhttp_request;
 struct event_base;
 class CService;
+struct HTTPChunkedReply;
 class HTTPRequest;
 
 /** Initialize HTTP server.
@@ -34,16 +42,57 @@ void InterruptHTTPServer();
 /** Stop HTTP server */
 void StopHTTPServer();
 
+/** Priority class of a request. Each class has its own lane in the work queue. */
+enum HTTPPriority
+{
+    HTTP_PRIORITY_HIGH,   //!< Cheap requests that should never wait behind others, e.g. health checks
+    HTTP_PRIORITY_NORMAL,
+    HTTP_PRIORITY_LOW,    //!< Expensive requests such as index scans
+    HTTP_PRIORITY_COUNT
+};
+
+/** Name of a priority class, as used in logging and RPC output */
+const char* HTTPPriorityName(HTTPPriority priority);
+
 /** Handler for requests to a certain HTTP path */
 typedef boost::function<void(HTTPRequest* req, const std::string &)> HTTPRequestHandler;
+/** Determine the priority of a request to a certain HTTP path.
+ * This runs on the event loop thread when the request is received, so it must be cheap.
+ */
+typedef boost::function<HTTPPriority(HTTPRequest* req, const std::string &)> HTTPRequestClassifier;
 /** Register handler for prefix.
  * If multiple handlers match a prefix, the first-registered one will
  * be invoked.
  */
-void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler);
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, HTTPPriority priority = HTTP_PRIORITY_NORMAL);
+/** Register handler for prefix, with the priority of each request determined by a classifier */
+void RegisterHTTPHandler(const std::string &prefix, bool exactMatch, const HTTPRequestHandler &handler, const HTTPRequestClassifier &classifier);
 /** Unregister handler for prefix */
 void UnregisterHTTPHandler(const std::string &prefix, bool exactMatch);
 
+/** State of one lane of the work queue */
+struct HTTPWorkQueueLaneStats
+{
+    size_t nQueued;
+    size_t nMaxQueued;
+    //! Requests of this lane being handled by worker threads
+    int nRunning;
+    //! Maximum number of worker threads this lane may occupy
+    int nMaxRunning;
+    uint64_t nProcessed;
+    //! Requests rejected because the lane was full
+    uint64_t nRejected;
+    //! Time requests spent in the queue before a worker picked them up, in microseconds
+    int64_t nWaitTotal;
+    int64_t nWaitMax;
+    int64_t nWaitLast;
+};
+
+/** Return the state of each lane of the work queue, indexed by HTTPPriority.
+ * Empty if the HTTP server is not running.
+ */
+std::vector<HTTPWorkQueueLaneStats> GetHTTPWorkQueueStats();
+
 /** Return evhttp event base. This can be used by submodules to
  * queue timers or custom events.
  */
@@ -57,6 +106,8 @@ class HTTPRequest
 private:
     struct evhttp_request* req;
     bool replySent;
+    //! Set while a chunked reply is in progress
+    std::shared_ptr<HTTPChunkedReply> chunked;
 
 public:
     HTTPRequest(struct evhttp_request* req);
@@ -96,6 +147,12 @@ public:
      */
     std::string ReadBody();
 
+    /**
+     * Get a copy of the request body without consuming it.
+     * Returns false if the body is larger than nMaxSize.
+     */
+    bool PeekBody(std::string& body, size_t nMaxSize);
+
     /**
      * Write output header.
      *
@@ -112,6 +169,71 @@ public:
      * main thread, do not call any other HTTPRequest methods after calling this.
      */
     void WriteReply(int nStatus, const std::string& strReply = "");
+
+    /**
+     * Write HTTP reply whose body is sent from memory owned by someone else,
+     * without copying it. pin keeps [data, data + size) valid until the body
+     * has been sent.
+     *
+     * @note Same restrictions as the other WriteReply.
+     */
+    void WriteReply(int nStatus, const char* data, size_t size, const std::shared_ptr<const void>& pin);
+
+    /**
+     * Start a reply whose body is sent in parts with WriteChunk, using chunked
+     * transfer encoding. This sends the status and headers.
+     *
+     * @note Can be called only once, instead of WriteReply. The reply must be
+     * finished with EndChunkedReply.
+     */
+    void StartChunkedReply(int nStatus);
+
+    /**
+     * Send the next part of a chunked reply. Blocks while more than
+     * HTTP_REPLY_MAX_PENDING bytes are waiting to be sent to the client.
+     * Returns false if the client has gone away, in which case the data is
+     * dropped and producing the rest of the reply is pointless.
+     */
+    bool WriteChunk(const std::string& strChunk);
+
+    /**
+     * Finish a chunked reply.
+     *
+     * @note As with WriteReply, do not call any other HTTPRequest methods after calling this.
+     */
+    void EndChunkedReply();
+};
+
+/**
+ * Sends the body of a reply while it is being produced. Output is collected up
+ * to nChunkSize bytes: a reply that ends within that is sent as an ordinary
+ * reply, a larger one switches to a chunked reply so that it never has to be
+ * held in memory as a whole.
+ */
+class HTTPReplyStream
+{
+private:
+    HTTPRequest* req;
+    int nStatus;
+    size_t nChunkSize;
+    std::string buffer;
+    bool fChunked;
+    bool fEnded;
+    bool fGood;
+
+public:
+    /**
+     * @param[in] req       Request to reply to. Write its headers before the first Write.
+     * @param[in] nStatus   HTTP status code of the reply
+     */
+    HTTPReplyStream(HTTPRequest* req, int nStatus, size_t nChunkSize = HTTP_REPLY_CHUNK_SIZE);
+    /** Ends the reply if End was not called */
+    ~HTTPReplyStream();
+
+    /** Append to the reply. Returns false once the client has gone away. */
+    bool Write(const std::string& str);
+    /** Send what is left and finish the reply */
+    void End();
 };
 
 /** Event handler closure.
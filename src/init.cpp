@@ -11,11 +11,14 @@
 
 #include "addrman.h"
 #include "amount.h"
+#include "blockfilemap.h"
+#include "blockimport.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
 #include "compat/sanity.h"
 #include "consensus/validation.h"
+#include "crypto/sha256.h"
 #include "httpserver.h"
 #include "httprpc.h"
 #include "key.h"
@@ -59,6 +62,7 @@
 
 #if ENABLE_ZMQ
 #include "zmq/zmqnotificationinterface.h"
+#include "zmq/zmqrpc.h"
 #endif
 
 using namespace std;
@@ -70,10 +74,6 @@ static const bool DEFAULT_DISABLE_SAFEMODE = false;
 static const bool DEFAULT_STOPAFTERBLOCKIMPORT = false;
 
 
-#if ENABLE_ZMQ
-static CZMQNotificationInterface* pzmqNotificationInterface = NULL;
-#endif
-
 #ifdef WIN32
 // Win32 LevelDB doesn't use filedescriptors, and the ones used for
 // accessing block files don't count towards the fd_set size limit
@@ -224,6 +224,10 @@ void Shutdown()
         pcoinsdbview = NULL;
         delete pblocktree;
         pblocktree = NULL;
+        delete pindexdb;
+        pindexdb = NULL;
+        delete pblockfilemap;
+        pblockfilemap = NULL;
     }
 #ifdef ENABLE_WALLET
     if (pwalletMain)
@@ -321,7 +325,9 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-dbcache=<n>", strprintf(_("Set database cache size in megabytes (%d to %d, default: %d)"), nMinDbCache, nMaxDbCache, nDefaultDbCache));
     if (showDebug)
         strUsage += HelpMessageOpt("-feefilter", strprintf("Tell other nodes to filter invs to us by our mempool min fee (default: %u)", DEFAULT_FEEFILTER));
+    strUsage += HelpMessageOpt("-importthreads=<n>", strprintf(_("Set the number of threads reading block files during -reindex (0 = auto, up to %d, default: %d)"), MAX_IMPORT_THREADS, DEFAULT_IMPORT_THREADS));
     strUsage += HelpMessageOpt("-loadblock=<file>", _("Imports blocks from external blk000??.dat file on startup"));
+    strUsage += HelpMessageOpt("-maxmappedblockfiles=<n>", strprintf(_("Memory map up to <n> block files to serve blocks and transactions from, 0 to read them with buffered I/O (default: %u)"), DEFAULT_MAX_MAPPED_BLOCK_FILES));
     strUsage += HelpMessageOpt("-maxorphantx=<n>", strprintf(_("Keep at most <n> unconnectable transactions in memory (default: %u)"), DEFAULT_MAX_ORPHAN_TRANSACTIONS));
     strUsage += HelpMessageOpt("-maxmempool=<n>", strprintf(_("Keep the transaction memory pool below <n> megabytes (default: %u)"), DEFAULT_MAX_MEMPOOL_SIZE));
     strUsage += HelpMessageOpt("-mempoolexpiry=<n>", strprintf(_("Do not keep transactions in the mempool longer than <n> hours (default: %u)"), DEFAULT_MEMPOOL_EXPIRY));
@@ -343,6 +349,13 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-addressindex", strprintf(_("Maintain a full address index, used to query for the balance, txids and unspent outputs for addresses (default: %u)"), DEFAULT_ADDRESSINDEX));
     strUsage += HelpMessageOpt("-timestampindex", strprintf(_("Maintain a timestamp index for block hashes, used to query blocks hashes by a range of timestamps (default: %u)"), DEFAULT_TIMESTAMPINDEX));
     strUsage += HelpMessageOpt("-spentindex", strprintf(_("Maintain a full spent index, used to query the spending txid and input index for an outpoint (default: %u)"), DEFAULT_SPENTINDEX));
+    strUsage += HelpMessageOpt("-indexdbcache=<n>", strprintf(_("Set index database cache size in megabytes (default: %d/8 of the -dbcache left after the block index cache, if any of the above indexes is enabled)"), nDefaultIndexDBCacheShare));
+    if (showDebug) {
+        strUsage += HelpMessageOpt("-indexdbwritebuffer=<n>", _("Set index database write buffer size in megabytes (default: 1/4 of -indexdbcache)"));
+        strUsage += HelpMessageOpt("-indexdbbloombits=<n>", strprintf("Set bits per key of the index database bloom filter (default: %u)", DEFAULT_INDEXDB_BLOOM_BITS));
+        strUsage += HelpMessageOpt("-indexdbmaxopenfiles=<n>", strprintf("Set maximum number of open files of the index database (default: %u)", DEFAULT_INDEXDB_MAX_OPEN_FILES));
+    }
+    strUsage += HelpMessageOpt("-spentindexcache=<n>", strprintf(_("Number of outpoints to keep in the in-memory spent index cache, 0 to disable (default: %u)"), DEFAULT_SPENTINDEX_CACHE_SIZE));
 
     strUsage += HelpMessageGroup(_("Connection options:"));
     strUsage += HelpMessageOpt("-addnode=<ip>", _("Add a node to connect to and attempt to keep the connection open"));
@@ -396,6 +409,10 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-zmqpubhashtx=<address>", _("Enable publish hash transaction in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawblock=<address>", _("Enable publish raw block in <address>"));
     strUsage += HelpMessageOpt("-zmqpubrawtx=<address>", _("Enable publish raw transaction in <address>"));
+    strUsage += HelpMessageOpt("-zmqpubaddresstx=<address>", _("Enable publish address index deltas of transactions in <address> (requires -addressindex)"));
+    strUsage += HelpMessageOpt("-zmqpubqueuesize=<n>", strprintf(_("Maximum number of notifications waiting to be published (default: %u)"), DEFAULT_ZMQ_PUBLISH_QUEUE_SIZE));
+    strUsage += HelpMessageOpt("-zmqpubqueuemaxmem=<n>", strprintf(_("Maximum size of the notifications waiting to be published in megabytes (default: %u)"), DEFAULT_ZMQ_PUBLISH_QUEUE_MAXMEM));
+    strUsage += HelpMessageOpt("-zmqpubdroppolicy=<policy>", strprintf(_("Notification to drop when the publish queue is full: newest or oldest (default: %s)"), DEFAULT_ZMQ_DROP_POLICY));
 #endif
 
     strUsage += HelpMessageGroup(_("Debugging/Testing options:"));
@@ -431,7 +448,7 @@ std::string HelpMessage(HelpMessageMode mode)
         strUsage += HelpMessageOpt("-mocktime=<n>", "Replace actual time with <n> seconds since epoch (default: 0)");
         strUsage += HelpMessageOpt("-limitfreerelay=<n>", strprintf("Continuously rate-limit free transactions to <n>*1000 bytes per minute (default: %u)", DEFAULT_LIMITFREERELAY));
         strUsage += HelpMessageOpt("-relaypriority", strprintf("Require high priority for relaying free or low-fee transactions (default: %u)", DEFAULT_RELAYPRIORITY));
-        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit size of signature cache to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
+        strUsage += HelpMessageOpt("-maxsigcachesize=<n>", strprintf("Limit sum of signature cache and script execution cache sizes to <n> MiB (default: %u)", DEFAULT_MAX_SIG_CACHE_SIZE));
         strUsage += HelpMessageOpt("-maxtipage=<n>", strprintf("Maximum tip age in seconds to consider node in initial block download (default: %u)", DEFAULT_MAX_TIP_AGE));
     }
     strUsage += HelpMessageOpt("-minrelaytxfee=<amt>", strprintf(_("Fees (in %s/kB) smaller than this are considered zero fee for relaying, mining and transaction creation (default: %s)"),
@@ -472,9 +489,12 @@ std::string HelpMessage(HelpMessageMode mode)
     strUsage += HelpMessageOpt("-rpcauth=<userpw>", _("Username and hashed password for JSON-RPC connections. The field <userpw> comes in the format: <USERNAME>:<SALT>$<HASH>. A canonical python script is included in share/rpcuser. This option can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcport=<port>", strprintf(_("Listen for JSON-RPC connections on <port> (default: %u or testnet: %u)"), BaseParams(CBaseChainParams::MAIN).RPCPort(), BaseParams(CBaseChainParams::TESTNET).RPCPort()));
     strUsage += HelpMessageOpt("-rpcallowip=<ip>", _("Allow JSON-RPC connections from specified source. Valid for <ip> are a single IP (e.g. 1.2.3.4), a network/netmask (e.g. 1.2.3.4/255.255.255.0) or a network/CIDR (e.g. 1.2.3.4/24). This option can be specified multiple times"));
+    strUsage += HelpMessageOpt("-rpcpriority=<method>:<class>", _("Set the priority class (high, normal or low) of requests for an RPC method. Each class has its own work queue, and low priority requests can occupy at most half of the RPC threads. Can be specified multiple times"));
     strUsage += HelpMessageOpt("-rpcthreads=<n>", strprintf(_("Set the number of threads to service RPC calls (default: %d)"), DEFAULT_HTTP_THREADS));
+    strUsage += HelpMessageOpt("-rpcbatchthreads=<n>", strprintf(_("Set the number of threads to execute the calls of JSON-RPC batches in parallel, 0 to execute them serially (default: %d)"), DEFAULT_RPC_BATCH_THREADS));
+    strUsage += HelpMessageOpt("-rpcbatchconcurrency=<n>", strprintf(_("Set the maximum number of calls of one JSON-RPC batch executed at the same time (default: %d)"), DEFAULT_RPC_BATCH_CONCURRENCY));
     if (showDebug) {
-        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
+        strUsage += HelpMessageOpt("-rpcworkqueue=<n>", strprintf("Set the depth of each priority lane of the work queue to service RPC calls (default: %d)", DEFAULT_HTTP_WORKQUEUE));
         strUsage += HelpMessageOpt("-rpcservertimeout=<n>", strprintf("Timeout during HTTP requests (default: %d)", DEFAULT_HTTP_SERVER_TIMEOUT));
     }
 
@@ -578,18 +598,11 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
 
     // -reindex
     if (fReindex) {
-        int nFile = 0;
-        while (true) {
-            CDiskBlockPos pos(nFile, 0);
-            if (!boost::filesystem::exists(GetBlockPosFilename(pos, "blk")))
-                break; // No block files left to reindex
-            FILE *file = OpenBlockFile(pos, true);
-            if (!file)
-                break; // This error is logged in OpenBlockFile
-            LogPrintf("Reindexing block file blk%05u.dat...\n", (unsigned int)nFile);
-            LoadExternalBlockFile(chainparams, file, &pos);
-            nFile++;
-        }
+        int nFiles = 0;
+        while (boost::filesystem::exists(GetBlockPosFilename(CDiskBlockPos(nFiles, 0), "blk")))
+            nFiles++;
+        LogPrintf("Reindexing %d block files...\n", nFiles);
+        LoadBlockFiles(chainparams, nFiles);
         pblocktree->WriteReindexing(false);
         fReindex = false;
         LogPrintf("Reindexing finished\n");
@@ -923,6 +936,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     }
 
     RegisterAllCoreRPCCommands(tableRPC);
+#if ENABLE_ZMQ
+    RegisterZMQRPCCommands(tableRPC);
+#endif
 #ifdef ENABLE_WALLET
     bool fDisableWallet = GetBoolArg("-disablewallet", false);
     if (!fDisableWallet)
@@ -981,6 +997,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
 
     // ********************************************************* Step 4: application initialization: dir lock, daemonize, pidfile, debug log
 
+    // Pick the fastest SHA256 implementation for this CPU; it is checked before use
+    std::string strSHA256Algo = SHA256AutoDetect();
+
     // Initialize elliptic curve code
     ECC_Start();
     globalVerifyHandle.reset(new ECCVerifyHandle());
@@ -1017,6 +1036,9 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         LogPrintf("Startup time: %s\n", DateTimeStrFormat("%Y-%m-%d %H:%M:%S", GetTime()));
     LogPrintf("Default data directory %s\n", GetDefaultDataDir().string());
     LogPrintf("Using data directory %s\n", strDataDir);
+    LogPrintf("Using the '%s' SHA256 implementation\n", strSHA256Algo);
+    InitSignatureCache();
+    InitScriptExecutionCache();
     LogPrintf("Using config file %s\n", GetConfigFile().string());
     LogPrintf("Using at most %i connections (%i file descriptors available)\n", nMaxConnections, nFD);
     std::ostringstream strErrors;
@@ -1175,6 +1197,12 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
         AddOneShot(strDest);
 
 #if ENABLE_ZMQ
+    if (mapArgs.count("-zmqpubaddresstx") && !GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX))
+        return InitError(_("-zmqpubaddresstx requires -addressindex"));
+    ZMQDropPolicy zmqDropPolicy;
+    if (!ParseZMQDropPolicy(GetArg("-zmqpubdroppolicy", DEFAULT_ZMQ_DROP_POLICY), zmqDropPolicy))
+        return InitError(strprintf(_("Unknown -zmqpubdroppolicy value: '%s'"), GetArg("-zmqpubdroppolicy", "")));
+
     pzmqNotificationInterface = CZMQNotificationInterface::CreateWithArguments(mapArgs);
 
     if (pzmqNotificationInterface) {
@@ -1225,18 +1253,32 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("* Using %d max open files\n", dbMaxOpenFiles);
     LogPrintf("* Compression is %s\n", dbCompression ? "enabled" : "disabled");
 
+    // index db settings
+    int indexDBMaxOpenFiles = GetArg("-indexdbmaxopenfiles", DEFAULT_INDEXDB_MAX_OPEN_FILES);
+    int indexDBBloomBits = GetArg("-indexdbbloombits", DEFAULT_INDEXDB_BLOOM_BITS);
+    if (indexDBBloomBits < 0)
+        return InitError(_("Invalid -indexdbbloombits value"));
+    size_t nSpentIndexCacheSize = std::max((int64_t)0, GetArg("-spentindexcache", DEFAULT_SPENTINDEX_CACHE_SIZE));
+
     // cache size calculations
     int64_t nTotalCache = (GetArg("-dbcache", nDefaultDbCache) << 20);
     nTotalCache = std::max(nTotalCache, nMinDbCache << 20); // total cache cannot be less than nMinDbCache
     nTotalCache = std::min(nTotalCache, nMaxDbCache << 20); // total cache cannot be greated than nMaxDbcache
     int64_t nBlockTreeDBCache = nTotalCache / 8;
-    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX)) {
-        // enable 3/4 of the cache if addressindex and/or spentindex is enabled
-        nBlockTreeDBCache = nTotalCache * 3 / 4;
-    } else {
-        nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
-    }
+    nBlockTreeDBCache = std::min(nBlockTreeDBCache, (GetBoolArg("-txindex", DEFAULT_TXINDEX) ? nMaxBlockDBAndTxIndexCache : nMaxBlockDBCache) << 20);
     nTotalCache -= nBlockTreeDBCache;
+    int64_t nIndexDBCache = std::min(nTotalCache / 8, nMaxBlockDBCache << 20);
+    if (GetBoolArg("-addressindex", DEFAULT_ADDRESSINDEX) || GetBoolArg("-spentindex", DEFAULT_SPENTINDEX) || GetBoolArg("-timestampindex", DEFAULT_TIMESTAMPINDEX)) {
+        // the insight indexes get the bulk of the cache by default
+        nIndexDBCache = nTotalCache * nDefaultIndexDBCacheShare / 8;
+    }
+    if (mapArgs.count("-indexdbcache"))
+        nIndexDBCache = GetArg("-indexdbcache", 0) << 20;
+    nIndexDBCache = std::max((int64_t)0, std::min(nIndexDBCache, nTotalCache * 7 / 8)); // leave something for the chain state
+    nTotalCache -= nIndexDBCache;
+    // an explicit write buffer is taken out of the index db cache, leaving at least half of it for the block cache
+    int64_t nIndexDBWriteBuffer = std::max((int64_t)0, GetArg("-indexdbwritebuffer", 0) << 20);
+    nIndexDBWriteBuffer = std::min(nIndexDBWriteBuffer, nIndexDBCache / 4);
     int64_t nCoinDBCache = std::min(nTotalCache / 2, (nTotalCache / 4) + (1 << 23)); // use 25%-50% of the remainder for disk cache
     nCoinDBCache = std::min(nCoinDBCache, nMaxCoinsDBCache << 20); // cap total coins db cache
     nTotalCache -= nCoinDBCache;
@@ -1244,9 +1286,18 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
     LogPrintf("Cache configuration:\n");
     LogPrintf("* Max cache setting possible %.1fMiB\n", nMaxDbCache);
     LogPrintf("* Using %.1fMiB for block index database\n", nBlockTreeDBCache * (1.0 / 1024 / 1024));
+    LogPrintf("* Using %.1fMiB for index database\n", nIndexDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for chain state database\n", nCoinDBCache * (1.0 / 1024 / 1024));
     LogPrintf("* Using %.1fMiB for in-memory UTXO set\n", nCoinCacheUsage * (1.0 / 1024 / 1024));
 
+    int nMaxMappedBlockFiles = GetArg("-maxmappedblockfiles", DEFAULT_MAX_MAPPED_BLOCK_FILES);
+    if (nMaxMappedBlockFiles < 0)
+        return InitError(_("Invalid -maxmappedblockfiles value"));
+    if (nMaxMappedBlockFiles > 0) {
+        pblockfilemap = new CBlockFileMap(nMaxMappedBlockFiles);
+        LogPrintf("* Mapping up to %d block files\n", nMaxMappedBlockFiles);
+    }
+
     bool fLoaded = false;
     while (!fLoaded) {
         bool fReset = fReindex;
@@ -1262,8 +1313,11 @@ bool AppInit2(boost::thread_group& threadGroup, CScheduler& scheduler)
                 delete pcoinsdbview;
                 delete pcoinscatcher;
                 delete pblocktree;
+                delete pindexdb;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex, dbCompression, dbMaxOpenFiles);
+                pindexdb = new CIndexDB(nIndexDBWriteBuffer > 0 ? nIndexDBCache - 2 * nIndexDBWriteBuffer : nIndexDBCache, false, fReindex,
+                                        indexDBMaxOpenFiles, indexDBBloomBits, nIndexDBWriteBuffer, nSpentIndexCacheSize);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex || fReindexChainState);
 
                 pcoinscatcher = new CCoinsViewErrorCatcher(pcoinsdbview);
@@ -32,8 +32,14 @@
 
 #include <boost/unordered_map.hpp>
 
+class CAddressIndexMergeCursor;
+class CBlockFileMap;
+class CBlockFileSpan;
 class CBlockIndex;
 class CBlockTreeDB;
+class CBlockUndo;
+class CDBSnapshot;
+class CIndexDB;
 class CBloomFilter;
 class CChainParams;
 class CInv;
@@ -81,7 +87,7 @@ static const unsigned int BLOCKFILE_CHUNK_SIZE = 0x1000000; // 16 MiB
 static const unsigned int UNDOFILE_CHUNK_SIZE = 0x100000; // 1 MiB
 
 /** Maximum number of script-checking threads allowed */
-static const int MAX_SCRIPTCHECK_THREADS = 16;
+static const int MAX_SCRIPTCHECK_THREADS = 64;
 /** -par default (number of script-checking threads, 0 = auto) */
 static const int DEFAULT_SCRIPTCHECK_THREADS = 0;
 /** Number of blocks that can be requested at any given time from a single peer. */
@@ -134,6 +140,9 @@ static const bool DEFAULT_TIMESTAMPINDEX = false;
 static const bool DEFAULT_SPENTINDEX = false;
 static const unsigned int DEFAULT_DB_MAX_OPEN_FILES = 1000;
 static const bool DEFAULT_DB_COMPRESSION = true;
+static const int DEFAULT_INDEXDB_MAX_OPEN_FILES = 1000;
+/** Bits per key of the index database bloom filter, a little above the block tree's as most reads are point lookups of absent spent index keys */
+static const int DEFAULT_INDEXDB_BLOOM_BITS = 12;
 static const unsigned int DEFAULT_BANSCORE_THRESHOLD = 100;
 
 static const bool DEFAULT_TESTSAFEMODE = false;
@@ -242,7 +251,9 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Translation to a filesystem path */
 boost::filesystem::path GetBlockPosFilename(const CDiskBlockPos &pos, const char *prefix);
 /** Import blocks from an external file */
-bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn, CDiskBlockPos *dbp = NULL);
+bool LoadExternalBlockFile(const CChainParams& chainparams, FILE* fileIn);
+/** Import blocks from block files blk00000.dat to blk<nFiles-1>.dat in place, reading several files at a time (-reindex) */
+bool LoadBlockFiles(const CChainParams& chainparams, int nFiles);
 /** Initialize a new block tree database + block data on disk */
 bool InitBlockIndex(const CChainParams& chainparams);
 /** Load the block tree and coins database from disk */
@@ -271,6 +282,8 @@ bool IsInitialBlockDownload();
 std::string GetWarnings(const std::string& strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible) */
 bool GetTransaction(const uint256 &hash, CTransaction &tx, const Consensus::Params& params, uint256 &hashBlock, bool fAllowSlow = false);
+/** Retrieve the serialized form of a confirmed transaction from a mapped block file, using the transaction index */
+bool GetRawTransactionFromDisk(const uint256 &hash, CBlockFileSpan& span, uint256 &hashBlock);
 /** Find the best known block, and make it the tip of the block chain */
 bool ActivateBestChain(CValidationState& state, const CChainParams& chainparams, const CBlock* pblock = NULL);
 CAmount GetBlockSubsidy(int nHeight, const Consensus::Params& consensusParams);
@@ -353,10 +366,18 @@ int64_t GetTransactionSigOpCost(const CTransaction& tx, const CCoinsViewCache& i
 /**
  * Check whether all inputs of this transaction are valid (no double spends, scripts & sigs, amounts)
  * This does not modify the UTXO set. If pvChecks is not NULL, script checks are pushed onto it
- * instead of being performed inline.
+ * instead of being performed inline. Transactions whose scripts were already found valid under
+ * flags are not checked again; if cacheFullScriptStore is set and the scripts are checked inline,
+ * a success is remembered for them. cacheSigStore does the same for individual signatures.
  */
 bool CheckInputs(const CTransaction& tx, CValidationState &state, const CCoinsViewCache &view, bool fScriptChecks,
-                 unsigned int flags, bool cacheStore, std::vector<CScriptCheck> *pvChecks = NULL);
+                 unsigned int flags, bool cacheSigStore, bool cacheFullScriptStore, std::vector<CScriptCheck> *pvChecks = NULL);
+
+/** Size the script execution cache according to -maxsigcachesize */
+void InitScriptExecutionCache();
+
+/** Script verification flags enforced in a block with this version and time on top of pindexPrev */
+unsigned int GetBlockScriptFlags(int32_t nVersion, int64_t nTime, const CBlockIndex* pindexPrev, const Consensus::Params& consensusparams);
 
 /** Apply the effects of this transaction on the UTXO set represented by view */
 void UpdateCoins(const CTransaction& tx, CCoinsViewCache& inputs, int nHeight);
@@ -426,6 +447,9 @@ public:
 
     bool operator()();
 
+    /** Estimated verification cost for CCheckQueue: signature operations, then script and witness size */
+    unsigned int GetCost() const;
+
     void swap(CScriptCheck &check) {
         scriptPubKey.swap(check.scriptPubKey);
         std::swap(ptxTo, check.ptxTo);
@@ -441,17 +465,35 @@ public:
 
 bool GetTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes);
 bool GetSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+/** Look up the spending inputs of many outputs at once, in order. Outputs that are not spent get a null value. */
+bool GetSpentIndexes(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values);
 bool HashOnchainActive(const uint256 &hash);
+/**
+ * Take a snapshot of the index database for queries that read it several times, and set pindexTip
+ * to the chain tip the snapshot reflects. Pass the snapshot to the address functions below so all
+ * their reads see that tip. Returns NULL if the address index is not enabled.
+ */
+CDBSnapshot *GetAddressIndexSnapshot(const CBlockIndex *&pindexTip);
 bool GetAddressIndex(uint160 addressHash, int type,
                      std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                     int start = 0, int end = 0);
+                     int start = 0, int end = 0, const CDBSnapshot *psnapshot = NULL);
 bool GetAddressUnspent(uint160 addressHash, int type,
-                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs);
+                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                       const CAddressUnspentFilter &filter = CAddressUnspentFilter(),
+                       const CDBSnapshot *psnapshot = NULL);
+/** Open a cursor merging the address index rows of several addresses in block order. Returns NULL if unavailable. */
+CAddressIndexMergeCursor *GetAddressIndexMergeCursor(const std::vector<std::pair<uint160, int> > &addresses, int start = 0, int end = 0,
+                                                     const CAddressIndexKey *pafter = NULL, const CDBSnapshot *psnapshot = NULL);
+bool GetAddressSummary(uint160 addressHash, int type, CAddressSummaryValue &summary,
+                       const CDBSnapshot *psnapshot = NULL);
 
 /** Functions for disk access for blocks */
 bool WriteBlockToDisk(const CBlock& block, CDiskBlockPos& pos, const CMessageHeader::MessageStartChars& messageStart);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos, const Consensus::Params& consensusParams);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex, const Consensus::Params& consensusParams);
+bool UndoReadFromDisk(CBlockUndo& blockundo, const CDiskBlockPos& pos, const uint256& hashBlock);
+/** Get the serialized form of a block from a mapped block file, without deserializing it */
+bool ReadRawBlockFromDisk(CBlockFileSpan& span, const CBlockIndex* pindex);
 
 /** Functions for validating blocks and updating the block tree */
 
@@ -518,6 +560,12 @@ extern CCoinsViewCache *pcoinsTip;
 /** Global variable that points to the active block tree (protected by cs_main) */
 extern CBlockTreeDB *pblocktree;
 
+/** Global variable that points to the address, spent and timestamp index database (protected by cs_main) */
+extern CIndexDB *pindexdb;
+
+/** Global variable that maps block files for reading, or NULL if mapping is disabled */
+extern CBlockFileMap *pblockfilemap;
+
 /**
  * Return the spend height, which is one more than the inputs.GetBestBlock().
  * While checking, GetBestBlock() refers to the parent block. (protected by cs_main)
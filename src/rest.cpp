@@ -3,20 +3,25 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "base58.h"
+#include "blockfilemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "primitives/block.h"
 #include "primitives/transaction.h"
 #include "main.h"
 #include "httpserver.h"
+#include "rpc/jsonstream.h"
 #include "rpc/server.h"
 #include "streams.h"
 #include "sync.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "utilstrencodings.h"
 #include "version.h"
 
 #include <boost/algorithm/string.hpp>
+#include <boost/bind.hpp>
 #include <boost/dynamic_bitset.hpp>
 
 #include <univalue.h>
@@ -72,6 +77,17 @@ static bool RESTERR(HTTPRequest* req, enum HTTPStatusCode status, string message
     return false;
 }
 
+/** Send a JSON reply, streamed from the value so large replies are not copied into one string */
+static void WriteJSONReply(HTTPRequest* req, const UniValue& value)
+{
+    req->WriteHeader("Content-Type", "application/json");
+    HTTPReplyStream stream(req, HTTP_OK);
+    CJSONStreamWriter writer(boost::bind(&HTTPReplyStream::Write, &stream, _1));
+    writer.Value(value);
+    writer.Raw("\n");
+    stream.End();
+}
+
 static enum RetFormat ParseDataFormat(std::string& param, const std::string& strReq)
 {
     const std::string::size_type pos = strReq.rfind('.');
@@ -215,6 +231,7 @@ static bool rest_block(HTTPRequest* req,
 
     CBlock block;
     CBlockIndex* pblockindex = NULL;
+    CBlockFileSpan span;
     {
         LOCK(cs_main);
         if (mapBlockIndex.count(hash) == 0)
@@ -224,8 +241,22 @@ static bool rest_block(HTTPRequest* req,
         if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
             return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not available (pruned data)");
 
-        if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-            return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        // The serialized formats are sent straight from the block file when it is mapped
+        if ((rf != RF_BINARY && rf != RF_HEX) || !ReadRawBlockFromDisk(span, pblockindex)) {
+            if (!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
+                return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
+        }
+    }
+
+    if (!span.empty()) {
+        if (rf == RF_BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, span.begin(), span.size(), span.GetPin());
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(span.begin(), span.end()) + "\n");
+        }
+        return true;
     }
 
     CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
@@ -248,9 +279,7 @@ static bool rest_block(HTTPRequest* req,
 
     case RF_JSON: {
         UniValue objBlock = blockToJSON(block, pblockindex, showTxDetails);
-        string strJSON = objBlock.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        WriteJSONReply(req, objBlock);
         return true;
     }
 
@@ -336,10 +365,7 @@ static bool rest_mempool_contents(HTTPRequest* req, const std::string& strURIPar
     switch (rf) {
     case RF_JSON: {
         UniValue mempoolObject = mempoolToJSON(true);
-
-        string strJSON = mempoolObject.write() + "\n";
-        req->WriteHeader("Content-Type", "application/json");
-        req->WriteReply(HTTP_OK, strJSON);
+        WriteJSONReply(req, mempoolObject);
         return true;
     }
     default: {
@@ -362,8 +388,21 @@ static bool rest_tx(HTTPRequest* req, const std::string& strURIPart)
     if (!ParseHashStr(hashStr, hash))
         return RESTERR(req, HTTP_BAD_REQUEST, "Invalid hash: " + hashStr);
 
-    CTransaction tx;
+    // Confirmed transactions are sent straight from the block file when it is mapped
+    CBlockFileSpan span;
     uint256 hashBlock = uint256();
+    if ((rf == RF_BINARY || rf == RF_HEX) && !mempool.exists(hash) && GetRawTransactionFromDisk(hash, span, hashBlock)) {
+        if (rf == RF_BINARY) {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, span.begin(), span.size(), span.GetPin());
+        } else {
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, HexStr(span.begin(), span.end()) + "\n");
+        }
+        return true;
+    }
+
+    CTransaction tx;
     if (!GetTransaction(hash, tx, Params().GetConsensus(), hashBlock, true))
         return RESTERR(req, HTTP_NOT_FOUND, hashStr + " not found");
 
@@ -599,24 +638,294 @@ static bool rest_getutxos(HTTPRequest* req, const std::string& strURIPart)
     return true; // continue to process further HTTP reqs on this cxn
 }
 
+/**
+ * Reply of an address query in the requested format. Replies without a record
+ * count are unbounded and streamed while the records are produced; paged
+ * replies are sent at the end, together with their cursor.
+ */
+class AddressReplyWriter
+{
+private:
+    HTTPRequest* req;
+    RetFormat rf;
+    //! Name of the record array in paged JSON replies
+    std::string strField;
+    CDataStream ssRecords;
+    UniValue records;
+    boost::scoped_ptr<HTTPReplyStream> pstream;
+    boost::scoped_ptr<CJSONStreamWriter> pwriter;
+
+public:
+    AddressReplyWriter(HTTPRequest* reqIn, RetFormat rfIn, const std::string& strFieldIn, bool fPaged) :
+        req(reqIn), rf(rfIn), strField(strFieldIn), ssRecords(SER_NETWORK, PROTOCOL_VERSION), records(UniValue::VARR)
+    {
+        if (fPaged)
+            return;
+        req->WriteHeader("Content-Type", rf == RF_JSON ? "application/json" : rf == RF_HEX ? "text/plain" : "application/octet-stream");
+        pstream.reset(new HTTPReplyStream(req, HTTP_OK));
+        if (rf == RF_JSON) {
+            pwriter.reset(new CJSONStreamWriter(boost::bind(&HTTPReplyStream::Write, pstream.get(), _1)));
+            pwriter->BeginArray();
+        }
+    }
+
+    /** Add a record in binary form. Returns false if the client went away. */
+    bool Add(const CDataStream& ssRecord)
+    {
+        if (!pstream) {
+            ssRecords.write(&ssRecord[0], ssRecord.size());
+            return true;
+        }
+        if (rf == RF_HEX)
+            return pstream->Write(HexStr(ssRecord.begin(), ssRecord.end()));
+        return pstream->Write(ssRecord.str());
+    }
+
+    /** Add a record in JSON form. Returns false if the client went away. */
+    bool Add(const UniValue& record)
+    {
+        if (!pwriter) {
+            records.push_back(record);
+            return true;
+        }
+        pwriter->Value(record);
+        return pwriter->Good();
+    }
+
+    bool Finish(const std::string& strCursor)
+    {
+        if (pstream) {
+            if (pwriter) {
+                pwriter->EndArray();
+                pwriter->Raw("\n");
+            } else if (rf == RF_HEX) {
+                pstream->Write("\n");
+            }
+            pstream->End();
+            return true;
+        }
+
+        // Lets clients page through large histories without parsing the body
+        if (!strCursor.empty())
+            req->WriteHeader("X-Address-Cursor", strCursor);
+
+        switch (rf) {
+        case RF_BINARY: {
+            req->WriteHeader("Content-Type", "application/octet-stream");
+            req->WriteReply(HTTP_OK, ssRecords.str());
+            return true;
+        }
+
+        case RF_HEX: {
+            string strHex = HexStr(ssRecords.begin(), ssRecords.end()) + "\n";
+            req->WriteHeader("Content-Type", "text/plain");
+            req->WriteReply(HTTP_OK, strHex);
+            return true;
+        }
+
+        default: {
+            UniValue paged(UniValue::VOBJ);
+            paged.push_back(Pair(strField, records));
+            if (!strCursor.empty())
+                paged.push_back(Pair("cursor", strCursor));
+            string strJSON = paged.write() + "\n";
+            req->WriteHeader("Content-Type", "application/json");
+            req->WriteReply(HTTP_OK, strJSON);
+            return true;
+        }
+        }
+    }
+
+    bool Error(enum HTTPStatusCode status, const std::string& message)
+    {
+        if (!pstream)
+            return RESTERR(req, status, message);
+        // The status was sent already, the client sees a truncated reply
+        LogPrintf("%s: %s\n", __func__, message);
+        pstream->End();
+        return false;
+    }
+};
+
+/**
+ * Address index queries: /rest/address/<address>/<txids|deltas|utxos>[/<count>[/<cursor>]].<ext>
+ *
+ * The binary format is the concatenation of fixed records:
+ *  - txids: txid (32 bytes) and block height (int32)
+ *  - deltas: the address index key as in the RPC cursors (66 bytes) and the amount (int64)
+ *  - utxos: the serialized address unspent index key and value
+ * With a count, at most that many records are returned; if more are available, the
+ * X-Address-Cursor reply header (and the "cursor" field of JSON replies) holds the
+ * cursor to pass to get the next page. Utxos are limited to the lowest heights.
+ * Without a count, all records are returned in a streamed (chunked) reply.
+ */
+static bool rest_address(HTTPRequest* req,
+                         const std::string& strURIPart)
+{
+    if (!CheckWarmup(req))
+        return false;
+    std::string param;
+    const RetFormat rf = ParseDataFormat(param, strURIPart);
+    vector<string> path;
+    boost::split(path, param, boost::is_any_of("/"));
+
+    if (path.size() < 2 || path.size() > 4)
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid URI format. Use /rest/address/<address>/<txids|deltas|utxos>[/<count>[/<cursor>]].<ext>");
+
+    if (rf == RF_UNDEF)
+        return RESTERR(req, HTTP_NOT_FOUND, "output format not found (available: " + AvailableDataFormatsString() + ")");
+
+    CBitcoinAddress address(path[0]);
+    uint160 hashBytes;
+    int type = 0;
+    if (!address.IsValid() || !address.GetIndexKey(hashBytes, type))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid address: " + path[0]);
+
+    const std::string& strQuery = path[1];
+    if (strQuery != "txids" && strQuery != "deltas" && strQuery != "utxos")
+        return RESTERR(req, HTTP_BAD_REQUEST, "Unknown address query: " + strQuery);
+
+    int32_t nCount = 0;
+    if (path.size() > 2 && (!ParseInt32(path[2], &nCount) || nCount <= 0))
+        return RESTERR(req, HTTP_BAD_REQUEST, "Invalid count: " + path[2]);
+
+    bool fHaveCursor = false;
+    CAddressIndexKey cursor;
+    if (path.size() > 3) {
+        if (strQuery == "utxos" || !IsHex(path[3]))
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[3]);
+        std::vector<unsigned char> data(ParseHex(path[3]));
+        CDataStream ssCursor(data, SER_DISK, CLIENT_VERSION);
+        try {
+            ssCursor >> cursor;
+        } catch (const std::exception&) {
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[3]);
+        }
+        if (!ssCursor.empty() || cursor.hashBytes != hashBytes || (int)cursor.type != type)
+            return RESTERR(req, HTTP_BAD_REQUEST, "Invalid cursor: " + path[3]);
+        fHaveCursor = true;
+    }
+
+    CDataStream ssRecord(SER_NETWORK, PROTOCOL_VERSION);
+
+    if (strQuery == "utxos") {
+        CAddressUnspentFilter filter;
+        filter.nLimit = nCount;
+        std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
+        if (!GetAddressUnspent(hashBytes, type, unspentOutputs, filter))
+            return RESTERR(req, HTTP_NOT_FOUND, "No information available for address");
+
+        // Utxos are returned as a plain array, also with a count
+        AddressReplyWriter writer(req, rf, strQuery, false);
+        for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it = unspentOutputs.begin(); it != unspentOutputs.end(); it++) {
+            bool fGood;
+            if (rf == RF_JSON) {
+                UniValue output(UniValue::VOBJ);
+                output.push_back(Pair("address", path[0]));
+                output.push_back(Pair("txid", it->first.txhash.GetHex()));
+                output.push_back(Pair("outputIndex", (int)it->first.index));
+                output.push_back(Pair("script", HexStr(it->second.script.begin(), it->second.script.end())));
+                output.push_back(Pair("satoshis", it->second.satoshis));
+                output.push_back(Pair("height", it->second.blockHeight));
+                fGood = writer.Add(output);
+            } else {
+                ssRecord.clear();
+                ssRecord << it->first << it->second;
+                fGood = writer.Add(ssRecord);
+            }
+            if (!fGood)
+                break;
+        }
+        return writer.Finish("");
+    }
+
+    std::vector<std::pair<uint160, int> > addresses(1, std::make_pair(hashBytes, type));
+    boost::scoped_ptr<CAddressIndexMergeCursor> pcursor(GetAddressIndexMergeCursor(addresses, 0, 0, fHaveCursor ? &cursor : NULL));
+    if (!pcursor)
+        return RESTERR(req, HTTP_NOT_FOUND, "No information available for address");
+
+    const bool fTxids = strQuery == "txids";
+    AddressReplyWriter writer(req, rf, strQuery, nCount > 0);
+    int count = 0;
+    bool fMore = false;
+    bool fHaveLast = false;
+    CAddressIndexKey lastKey;
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        const CAddressIndexKey &key = pcursor->GetKey();
+        // Rows of one transaction are adjacent, so txids are deduplicated against the previous row only
+        bool fNewRecord = !fTxids || !fHaveLast || key.txhash != lastKey.txhash || key.blockHeight != lastKey.blockHeight;
+        if (fNewRecord) {
+            if (nCount > 0 && count == nCount) {
+                fMore = true;
+                break;
+            }
+            bool fGood;
+            if (fTxids) {
+                if (rf == RF_JSON) {
+                    fGood = writer.Add(UniValue(key.txhash.GetHex()));
+                } else {
+                    ssRecord.clear();
+                    ssRecord << key.txhash << (int32_t)key.blockHeight;
+                    fGood = writer.Add(ssRecord);
+                }
+            } else {
+                CAmount nValue;
+                if (!pcursor->GetValue(nValue))
+                    return writer.Error(HTTP_INTERNAL_SERVER_ERROR, "Unable to read address index");
+                if (rf == RF_JSON) {
+                    UniValue delta(UniValue::VOBJ);
+                    delta.push_back(Pair("satoshis", nValue));
+                    delta.push_back(Pair("txid", key.txhash.GetHex()));
+                    delta.push_back(Pair("index", (int)key.index));
+                    delta.push_back(Pair("blockindex", (int)key.txindex));
+                    delta.push_back(Pair("height", key.blockHeight));
+                    delta.push_back(Pair("address", path[0]));
+                    fGood = writer.Add(delta);
+                } else {
+                    ssRecord.clear();
+                    ssRecord << key << nValue;
+                    fGood = writer.Add(ssRecord);
+                }
+            }
+            if (!fGood)
+                break;
+            count++;
+        }
+        lastKey = key;
+        fHaveLast = true;
+    }
+
+    std::string strCursor;
+    if (fMore) {
+        CDataStream ssCursor(SER_DISK, CLIENT_VERSION);
+        ssCursor << lastKey;
+        strCursor = HexStr(ssCursor.begin(), ssCursor.end());
+    }
+
+    return writer.Finish(strCursor);
+}
+
 static const struct {
     const char* prefix;
     bool (*handler)(HTTPRequest* req, const std::string& strReq);
+    HTTPPriority priority;
 } uri_prefixes[] = {
-      {"/rest/tx/", rest_tx},
-      {"/rest/block/notxdetails/", rest_block_notxdetails},
-      {"/rest/block/", rest_block_extended},
-      {"/rest/chaininfo", rest_chaininfo},
-      {"/rest/mempool/info", rest_mempool_info},
-      {"/rest/mempool/contents", rest_mempool_contents},
-      {"/rest/headers/", rest_headers},
-      {"/rest/getutxos", rest_getutxos},
+      {"/rest/tx/", rest_tx, HTTP_PRIORITY_NORMAL},
+      {"/rest/block/notxdetails/", rest_block_notxdetails, HTTP_PRIORITY_NORMAL},
+      {"/rest/block/", rest_block_extended, HTTP_PRIORITY_NORMAL},
+      {"/rest/chaininfo", rest_chaininfo, HTTP_PRIORITY_HIGH},
+      {"/rest/mempool/info", rest_mempool_info, HTTP_PRIORITY_HIGH},
+      {"/rest/mempool/contents", rest_mempool_contents, HTTP_PRIORITY_LOW},
+      {"/rest/headers/", rest_headers, HTTP_PRIORITY_NORMAL},
+      {"/rest/getutxos", rest_getutxos, HTTP_PRIORITY_NORMAL},
+      {"/rest/address/", rest_address, HTTP_PRIORITY_LOW},
 };
 
 bool StartREST()
 {
     for (unsigned int i = 0; i < ARRAYLEN(uri_prefixes); i++)
-        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler);
+        RegisterHTTPHandler(uri_prefixes[i].prefix, false, uri_prefixes[i].handler, uri_prefixes[i].priority);
     return true;
 }
 
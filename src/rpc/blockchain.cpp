@@ -3,8 +3,10 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "amount.h"
 #include "base58.h"
+#include "blockfilemap.h"
 #include "chain.h"
 #include "chainparams.h"
 #include "checkpoints.h"
@@ -21,6 +23,7 @@
 #include "streams.h"
 #include "sync.h"
 #include "txmempool.h"
+#include "undo.h"
 #include "util.h"
 #include "utilstrencodings.h"
 #include "hash.h"
@@ -33,6 +36,9 @@
 
 using namespace std;
 
+//! Maximum number of blocks returned by one getblockdeltas call
+static const int MAX_BLOCKDELTAS_RANGE = 100;
+
 extern void TxToJSON(const CTransaction& tx, const uint256 hashBlock, UniValue& entry);
 void ScriptPubKeyToJSON(const CScript& scriptPubKey, UniValue& out, bool fIncludeHex);
 
@@ -95,17 +101,43 @@ UniValue blockheaderToJSON(const CBlockIndex* blockindex)
     return result;
 }
 
-UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
+/** Read a block and its undo data, which holds the outputs spent by the inputs of the block */
+static void ReadBlockDeltaData(const CBlockIndex* blockindex, CBlock& block, CBlockUndo& blockundo)
+{
+    CDiskBlockPos pos, undoPos;
+    {
+        LOCK(cs_main);
+        if (fHavePruned && !(blockindex->nStatus & BLOCK_HAVE_DATA) && blockindex->nTx > 0)
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+        if (blockindex->pprev && !(blockindex->nStatus & BLOCK_HAVE_UNDO))
+            throw JSONRPCError(RPC_INTERNAL_ERROR, "Undo data not available");
+        pos = blockindex->GetBlockPos();
+        undoPos = blockindex->GetUndoPos();
+    }
+
+    if (!ReadBlockFromDisk(block, pos, Params().GetConsensus()) || block.GetHash() != blockindex->GetBlockHash())
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+
+    // The genesis block has no undo data, as its outputs are not spendable
+    blockundo.vtxundo.clear();
+    if (blockindex->pprev && !UndoReadFromDisk(blockundo, undoPos, blockindex->pprev->GetBlockHash()))
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read undo data from disk");
+
+    bool fMatch = blockundo.vtxundo.size() + 1 == block.vtx.size() || (!blockindex->pprev && blockundo.vtxundo.empty());
+    for (unsigned int i = 1; fMatch && i < block.vtx.size(); i++)
+        fMatch = blockundo.vtxundo[i - 1].vprevout.size() == block.vtx[i].vin.size();
+    if (!fMatch)
+        throw JSONRPCError(RPC_INTERNAL_ERROR, "Undo data does not match block");
+}
+
+UniValue blockToDeltasJSON(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* blockindex)
 {
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("hash", block.GetHash().GetHex()));
     int confirmations = -1;
     // Only report confirmations if the block is on the main chain
-    if (chainActive.Contains(blockindex)) {
+    if (chainActive.Contains(blockindex))
         confirmations = chainActive.Height() - blockindex->nHeight + 1;
-    } else {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block is an orphan");
-    }
     result.push_back(Pair("confirmations", confirmations));
     result.push_back(Pair("size", (int)::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION)));
     result.push_back(Pair("height", blockindex->nHeight));
@@ -128,30 +160,26 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
 
             for (size_t j = 0; j < tx.vin.size(); j++) {
                 const CTxIn input = tx.vin[j];
+                const CTxOut &prevout = blockundo.vtxundo[i - 1].vprevout[j].txout;
 
                 UniValue delta(UniValue::VOBJ);
 
-                CSpentIndexValue spentInfo;
-                CSpentIndexKey spentKey(input.prevout.hash, input.prevout.n);
-
-                if (GetSpentIndex(spentKey, spentInfo)) {
-                    if (spentInfo.addressType == 1) {
-                        delta.push_back(Pair("address", CBitcoinAddress(CKeyID(spentInfo.addressHash)).ToString()));
-                    } else if (spentInfo.addressType == 2)  {
-                        delta.push_back(Pair("address", CBitcoinAddress(CScriptID(spentInfo.addressHash)).ToString()));
-                    } else {
-                        continue;
-                    }
-                    delta.push_back(Pair("satoshis", -1 * spentInfo.satoshis));
-                    delta.push_back(Pair("index", (int)j));
-                    delta.push_back(Pair("prevtxid", input.prevout.hash.GetHex()));
-                    delta.push_back(Pair("prevout", (int)input.prevout.n));
-
-                    inputs.push_back(delta);
+                uint160 hashBytes;
+                int type;
+                if (!GetScriptAddressIndexKey(prevout.scriptPubKey, hashBytes, type))
+                    continue;
+
+                if (type == 1) {
+                    delta.push_back(Pair("address", CBitcoinAddress(CKeyID(hashBytes)).ToString()));
                 } else {
-                    throw JSONRPCError(RPC_INTERNAL_ERROR, "Spent information not available");
+                    delta.push_back(Pair("address", CBitcoinAddress(CScriptID(hashBytes)).ToString()));
                 }
+                delta.push_back(Pair("satoshis", -1 * prevout.nValue));
+                delta.push_back(Pair("index", (int)j));
+                delta.push_back(Pair("prevtxid", input.prevout.hash.GetHex()));
+                delta.push_back(Pair("prevout", (int)input.prevout.n));
 
+                inputs.push_back(delta);
             }
         }
 
@@ -201,6 +229,47 @@ UniValue blockToDeltasJSON(const CBlock& block, const CBlockIndex* blockindex)
     return result;
 }
 
+/**
+ * Serialize the address deltas of a block: the block hash, previous block hash,
+ * height and time, then for each transaction its txid, its input deltas (index,
+ * address type and hash, satoshis spent as a negative amount, previous txid and
+ * output) and its output deltas (index, address type and hash, satoshis).
+ */
+static void BlockToDeltasBinary(const CBlock& block, const CBlockUndo& blockundo, const CBlockIndex* blockindex, CDataStream& ss)
+{
+    ss << block.GetHash() << block.hashPrevBlock << (int32_t)blockindex->nHeight << block.nTime;
+    WriteCompactSize(ss, block.vtx.size());
+
+    uint160 hashBytes;
+    int type;
+    for (unsigned int i = 0; i < block.vtx.size(); i++) {
+        const CTransaction &tx = block.vtx[i];
+        ss << tx.GetHash();
+
+        const std::vector<CTxInUndo> noUndo;
+        const std::vector<CTxInUndo> &vprevout = tx.IsCoinBase() ? noUndo : blockundo.vtxundo[i - 1].vprevout;
+        unsigned int nInputs = 0;
+        for (unsigned int j = 0; j < vprevout.size(); j++)
+            nInputs += GetScriptAddressIndexKey(vprevout[j].txout.scriptPubKey, hashBytes, type);
+        WriteCompactSize(ss, nInputs);
+        for (unsigned int j = 0; j < vprevout.size(); j++) {
+            const CTxOut &prevout = vprevout[j].txout;
+            if (GetScriptAddressIndexKey(prevout.scriptPubKey, hashBytes, type))
+                ss << (uint32_t)j << (uint8_t)type << hashBytes << -prevout.nValue << tx.vin[j].prevout.hash << tx.vin[j].prevout.n;
+        }
+
+        unsigned int nOutputs = 0;
+        for (unsigned int k = 0; k < tx.vout.size(); k++)
+            nOutputs += GetScriptAddressIndexKey(tx.vout[k].scriptPubKey, hashBytes, type);
+        WriteCompactSize(ss, nOutputs);
+        for (unsigned int k = 0; k < tx.vout.size(); k++) {
+            const CTxOut &out = tx.vout[k];
+            if (GetScriptAddressIndexKey(out.scriptPubKey, hashBytes, type))
+                ss << (uint32_t)k << (uint8_t)type << hashBytes << out.nValue;
+        }
+    }
+}
+
 UniValue blockToJSON(const CBlock& block, const CBlockIndex* blockindex, bool txDetails = false)
 {
     UniValue result(UniValue::VOBJ);
@@ -570,27 +639,171 @@ UniValue getmempoolentry(const UniValue& params, bool fHelp)
     return info;
 }
 
+static bool ParseBlockDeltasFormat(const UniValue& params, unsigned int nParam)
+{
+    if (params.size() <= nParam)
+        return false;
+    std::string strFormat = params[nParam].get_str();
+    if (strFormat == "hex")
+        return true;
+    if (strFormat != "json")
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid format, expected json or hex");
+    return false;
+}
+
+/** Build the deltas of blocks, reading their block and undo data without holding cs_main */
+static UniValue BlockDeltasToUniValue(const std::vector<const CBlockIndex*>& vBlockIndexes, bool fHex, bool fArray)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    UniValue blocks(UniValue::VARR);
+    for (unsigned int i = 0; i < vBlockIndexes.size(); i++) {
+        CBlock block;
+        CBlockUndo blockundo;
+        ReadBlockDeltaData(vBlockIndexes[i], block, blockundo);
+        if (fHex) {
+            BlockToDeltasBinary(block, blockundo, vBlockIndexes[i], ss);
+        } else {
+            LOCK(cs_main);
+            blocks.push_back(blockToDeltasJSON(block, blockundo, vBlockIndexes[i]));
+        }
+    }
+
+    if (fHex)
+        return HexStr(ss.begin(), ss.end());
+    return fArray ? blocks : blocks[0];
+}
+
 UniValue getblockdeltas(const UniValue& params, bool fHelp)
 {
-    if (fHelp || params.size() != 1)
-        throw runtime_error("");
+    if (fHelp || params.size() < 1 || params.size() > 2)
+        throw runtime_error(
+            "getblockdeltas \"hash\" ( \"format\" )\n"
+            "\nReturns the address deltas of the transactions of a block. The addresses and amounts spent by\n"
+            "inputs are read from the undo data of the block, so a block that is not on the main chain can\n"
+            "only be returned if it was connected once.\n"
+            "\nArguments:\n"
+            "1. \"hash\"          (string, required) The block hash\n"
+            "2. \"format\"        (string, optional, default=json) json, or hex for the binary format below\n"
+            "\nResult (for json):\n"
+            "{\n"
+            "  \"hash\": \"hash\",            (string) The block hash\n"
+            "  \"confirmations\": n,        (numeric) The number of confirmations, or -1 if the block is not on the main chain\n"
+            "  \"size\": n,                 (numeric) The block size\n"
+            "  \"height\": n,               (numeric) The block height\n"
+            "  \"version\": n,              (numeric) The block version\n"
+            "  \"merkleroot\": \"xxxx\",      (string) The merkle root\n"
+            "  \"deltas\": [\n"
+            "    {\n"
+            "      \"txid\": \"hash\",        (string) The transaction id\n"
+            "      \"index\": n,            (numeric) The position of the transaction in the block\n"
+            "      \"inputs\": [\n"
+            "        {\n"
+            "          \"address\": \"addr\", (string) The address spent from\n"
+            "          \"satoshis\": n,     (numeric) The amount spent, as a negative number\n"
+            "          \"index\": n,        (numeric) The input index\n"
+            "          \"prevtxid\": \"hash\",(string) The transaction id of the spent output\n"
+            "          \"prevout\": n       (numeric) The index of the spent output\n"
+            "        }\n"
+            "        ,...\n"
+            "      ],\n"
+            "      \"outputs\": [\n"
+            "        {\n"
+            "          \"address\": \"addr\", (string) The address paid to\n"
+            "          \"satoshis\": n,     (numeric) The amount paid\n"
+            "          \"index\": n         (numeric) The output index\n"
+            "        }\n"
+            "        ,...\n"
+            "      ]\n"
+            "    }\n"
+            "    ,...\n"
+            "  ],\n"
+            "  \"time\": n,                 (numeric) The block time\n"
+            "  \"mediantime\": n,           (numeric) The median block time\n"
+            "  \"nonce\": n,                (numeric) The nonce\n"
+            "  \"bits\": \"xxxx\",            (string) The bits\n"
+            "  \"difficulty\": x.xxx,       (numeric) The difficulty\n"
+            "  \"chainwork\": \"xxxx\",       (string) The expected number of hashes to produce the chain up to this block\n"
+            "  \"previousblockhash\": \"hash\", (string) The hash of the previous block\n"
+            "  \"nextblockhash\": \"hash\"    (string) The hash of the next block\n"
+            "}\n"
+            "\nResult (for hex):\n"
+            "\"hex\"                       (string) The serialized deltas of each block, concatenated. A block is\n"
+            "                             the block hash and previous block hash (32 bytes each), height and time\n"
+            "                             (4 bytes each) and the number of transactions (compact size). Each\n"
+            "                             transaction is its txid (32 bytes), the number of input deltas (compact\n"
+            "                             size), the input deltas, the number of output deltas and the output\n"
+            "                             deltas. An input delta is the input index (4 bytes), address type (1 byte,\n"
+            "                             1 for p2pkh and 2 for p2sh), address hash (20 bytes), satoshis (8 bytes,\n"
+            "                             negative), previous txid (32 bytes) and output (4 bytes). An output delta\n"
+            "                             is the output index, address type, address hash and satoshis. Integers\n"
+            "                             are little endian and hashes are in serialization order.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockdeltas", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\"")
+            + HelpExampleRpc("getblockdeltas", "\"00000000c937983704a73af28acdec37b049d214adbda81d7e2a3dd146f6ed09\", \"hex\"")
+        );
 
-    std::string strHash = params[0].get_str();
-    uint256 hash(uint256S(strHash));
+    bool fHex = ParseBlockDeltasFormat(params, 1);
 
-    if (mapBlockIndex.count(hash) == 0)
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+    std::vector<const CBlockIndex*> vBlockIndexes;
+    {
+        LOCK(cs_main);
+        std::string strHash = params[0].get_str();
+        uint256 hash(uint256S(strHash));
 
-    CBlock block;
-    CBlockIndex* pblockindex = mapBlockIndex[hash];
+        BlockMap::iterator it = mapBlockIndex.find(hash);
+        if (it == mapBlockIndex.end())
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Block not found");
+        vBlockIndexes.push_back(it->second);
+    }
 
-    if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
+    return BlockDeltasToUniValue(vBlockIndexes, fHex, false);
+}
 
-    if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
-        throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
+UniValue getblockdeltasrange(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() < 2 || params.size() > 3)
+        throw runtime_error(
+            "getblockdeltasrange start end ( \"format\" )\n"
+            "\nReturns the address deltas of the transactions of a range of blocks of the main chain, like\n"
+            "getblockdeltas. At most " + strprintf("%d", MAX_BLOCKDELTAS_RANGE) + " blocks are returned per call.\n"
+            "\nArguments:\n"
+            "1. start           (numeric, required) The height of the first block\n"
+            "2. end             (numeric, required) The height of the last block\n"
+            "3. \"format\"        (string, optional, default=json) json, or hex for the binary format below\n"
+            "\nResult (for json):\n"
+            "[ {...}, ... ]     (json array) The blocks, as returned by getblockdeltas\n"
+            "\nResult (for hex):\n"
+            "\"hex\"                       (string) The serialized deltas of each block, concatenated. A block is\n"
+            "                             the block hash and previous block hash (32 bytes each), height and time\n"
+            "                             (4 bytes each) and the number of transactions (compact size). Each\n"
+            "                             transaction is its txid (32 bytes), the number of input deltas (compact\n"
+            "                             size), the input deltas, the number of output deltas and the output\n"
+            "                             deltas. An input delta is the input index (4 bytes), address type (1 byte,\n"
+            "                             1 for p2pkh and 2 for p2sh), address hash (20 bytes), satoshis (8 bytes,\n"
+            "                             negative), previous txid (32 bytes) and output (4 bytes). An output delta\n"
+            "                             is the output index, address type, address hash and satoshis. Integers\n"
+            "                             are little endian and hashes are in serialization order.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getblockdeltasrange", "1000 1099 \"hex\"")
+            + HelpExampleRpc("getblockdeltasrange", "1000, 1099, \"hex\"")
+        );
+
+    int nStart = params[0].get_int();
+    int nEnd = params[1].get_int();
+    bool fHex = ParseBlockDeltasFormat(params, 2);
+
+    std::vector<const CBlockIndex*> vBlockIndexes;
+    {
+        LOCK(cs_main);
+        if (nStart < 0 || nEnd < nStart || nEnd > chainActive.Height())
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Block height out of range");
+        if (nEnd - nStart >= MAX_BLOCKDELTAS_RANGE)
+            throw JSONRPCError(RPC_INVALID_PARAMETER, strprintf("Range is larger than %d blocks", MAX_BLOCKDELTAS_RANGE));
+        for (int nHeight = nStart; nHeight <= nEnd; nHeight++)
+            vBlockIndexes.push_back(chainActive[nHeight]);
+    }
 
-    return blockToDeltasJSON(block, pblockindex);
+    return BlockDeltasToUniValue(vBlockIndexes, fHex, true);
 }
 
 UniValue getblockhashes(const UniValue& params, bool fHelp)
@@ -809,6 +1022,14 @@ UniValue getblock(const UniValue& params, bool fHelp)
     if (fHavePruned && !(pblockindex->nStatus & BLOCK_HAVE_DATA) && pblockindex->nTx > 0)
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Block not available (pruned data)");
 
+    if (!fVerbose)
+    {
+        // Encode straight from the block file when it is mapped
+        CBlockFileSpan span;
+        if (ReadRawBlockFromDisk(span, pblockindex))
+            return HexStr(span.begin(), span.end());
+    }
+
     if(!ReadBlockFromDisk(block, pblockindex, Params().GetConsensus()))
         throw JSONRPCError(RPC_INTERNAL_ERROR, "Can't read block from disk");
 
@@ -1392,30 +1613,31 @@ UniValue reconsiderblock(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true  },
-    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true  },
-    { "blockchain",         "getblockcount",          &getblockcount,          true  },
-    { "blockchain",         "getblock",               &getblock,               true  },
-    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false },
-    { "blockchain",         "getblockhashes",         &getblockhashes,         true  },
-    { "blockchain",         "getblockhash",           &getblockhash,           true  },
-    { "blockchain",         "getblockheader",         &getblockheader,         true  },
-    { "blockchain",         "getchaintips",           &getchaintips,           true  },
-    { "blockchain",         "getdifficulty",          &getdifficulty,          true  },
-    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true  },
-    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true  },
-    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true  },
-    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true  },
-    { "blockchain",         "getrawmempool",          &getrawmempool,          true  },
-    { "blockchain",         "gettxout",               &gettxout,               true  },
-    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true  },
-    { "blockchain",         "verifychain",            &verifychain,            true  },
+{ //  category              name                      actor (function)         okSafeMode  threadSafe
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
+    { "blockchain",         "getblockchaininfo",      &getblockchaininfo,      true,  true  },
+    { "blockchain",         "getbestblockhash",       &getbestblockhash,       true,  true  },
+    { "blockchain",         "getblockcount",          &getblockcount,          true,  true  },
+    { "blockchain",         "getblock",               &getblock,               true,  true  },
+    { "blockchain",         "getblockdeltas",         &getblockdeltas,         false, true  },
+    { "blockchain",         "getblockdeltasrange",    &getblockdeltasrange,    false, true  },
+    { "blockchain",         "getblockhashes",         &getblockhashes,         true,  true  },
+    { "blockchain",         "getblockhash",           &getblockhash,           true,  true  },
+    { "blockchain",         "getblockheader",         &getblockheader,         true,  true  },
+    { "blockchain",         "getchaintips",           &getchaintips,           true,  true  },
+    { "blockchain",         "getdifficulty",          &getdifficulty,          true,  true  },
+    { "blockchain",         "getmempoolancestors",    &getmempoolancestors,    true,  true  },
+    { "blockchain",         "getmempooldescendants",  &getmempooldescendants,  true,  true  },
+    { "blockchain",         "getmempoolentry",        &getmempoolentry,        true,  true  },
+    { "blockchain",         "getmempoolinfo",         &getmempoolinfo,         true,  true  },
+    { "blockchain",         "getrawmempool",          &getrawmempool,          true,  true  },
+    { "blockchain",         "gettxout",               &gettxout,               true,  true  },
+    { "blockchain",         "gettxoutsetinfo",        &gettxoutsetinfo,        true,  false },
+    { "blockchain",         "verifychain",            &verifychain,            true,  false },
 
     /* Not shown in help */
-    { "hidden",             "invalidateblock",        &invalidateblock,        true  },
-    { "hidden",             "reconsiderblock",        &reconsiderblock,        true  },
+    { "hidden",             "invalidateblock",        &invalidateblock,        true,  false },
+    { "hidden",             "reconsiderblock",        &reconsiderblock,        true,  false },
 };
 
 void RegisterBlockchainRPCCommands(CRPCTable &tableRPC)
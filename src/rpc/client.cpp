@@ -107,9 +107,12 @@ static const CRPCConvertParam vRPCConvertParams[] =
     { "getblockhashes", 0 },
     { "getblockhashes", 1 },
     { "getblockhashes", 2 },
+    { "getblockdeltasrange", 0 },
+    { "getblockdeltasrange", 1 },
     { "getspentinfo", 0},
     { "getaddresstxids", 0},
     { "getaddressbalance", 0},
+    { "getaddresssummary", 0},
     { "getaddressdeltas", 0},
     { "getaddressutxos", 0},
     { "getaddressmempool", 0},
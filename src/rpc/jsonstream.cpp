@@ -0,0 +1,99 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+
+#include <assert.h>
+
+#include <univalue.h>
+
+CJSONStreamWriter::CJSONStreamWriter(const WriteFunc& writeIn) : write(writeIn), fAfterKey(false), fGood(true)
+{
+}
+
+void CJSONStreamWriter::Emit(const std::string& str)
+{
+    if (fGood)
+        fGood = write(str);
+}
+
+void CJSONStreamWriter::NextElement()
+{
+    if (fAfterKey) {
+        fAfterKey = false;
+        return;
+    }
+    if (!vEmpty.empty()) {
+        if (!vEmpty.back())
+            Emit(",");
+        vEmpty.back() = false;
+    }
+}
+
+void CJSONStreamWriter::BeginArray()
+{
+    NextElement();
+    Emit("[");
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndArray()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Emit("]");
+}
+
+void CJSONStreamWriter::BeginObject()
+{
+    NextElement();
+    Emit("{");
+    vEmpty.push_back(true);
+}
+
+void CJSONStreamWriter::EndObject()
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    vEmpty.pop_back();
+    Emit("}");
+}
+
+void CJSONStreamWriter::Key(const std::string& key)
+{
+    assert(!vEmpty.empty() && !fAfterKey);
+    NextElement();
+    Emit(UniValue(key).write() + ":");
+    fAfterKey = true;
+}
+
+void CJSONStreamWriter::Value(const UniValue& value)
+{
+    switch (value.getType()) {
+    case UniValue::VARR:
+        BeginArray();
+        for (unsigned int i = 0; i < value.size() && fGood; i++)
+            Value(value[i]);
+        EndArray();
+        break;
+    case UniValue::VOBJ: {
+        BeginObject();
+        // Only the keys are copied, the values are visited in place
+        const std::vector<std::string> keys = value.getKeys();
+        for (unsigned int i = 0; i < keys.size() && fGood; i++) {
+            Key(keys[i]);
+            Value(value[i]);
+        }
+        EndObject();
+        break;
+    }
+    default:
+        NextElement();
+        Emit(value.write());
+    }
+}
+
+void CJSONStreamWriter::Raw(const std::string& str)
+{
+    Emit(str);
+}
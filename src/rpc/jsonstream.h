@@ -0,0 +1,56 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_RPC_JSONSTREAM_H
+#define BITCOIN_RPC_JSONSTREAM_H
+
+#include <string>
+#include <vector>
+
+#include <boost/function.hpp>
+
+class UniValue;
+
+/**
+ * Writes a JSON document piece by piece, producing the same text as
+ * UniValue::write() would for the complete document. Containers are opened
+ * and closed explicitly, so a producer only has to hold one element in memory
+ * at a time; values are written out element by element as well.
+ */
+class CJSONStreamWriter
+{
+public:
+    /** Receives the output. Returns false to stop writing, e.g. when the client went away. */
+    typedef boost::function<bool (const std::string&)> WriteFunc;
+
+    CJSONStreamWriter(const WriteFunc& write);
+
+    void BeginArray();
+    void EndArray();
+    void BeginObject();
+    void EndObject();
+    /** Write the key of the next object member */
+    void Key(const std::string& key);
+    void Value(const UniValue& value);
+
+    /** Write text as is, e.g. a trailing newline after the document */
+    void Raw(const std::string& str);
+
+    /** False once the output refused data; producing more output is then pointless */
+    bool Good() const { return fGood; }
+
+private:
+    WriteFunc write;
+    //! For each open container, whether nothing was written to it yet
+    std::vector<bool> vEmpty;
+    //! A key was written and its value is next
+    bool fAfterKey;
+    bool fGood;
+
+    void Emit(const std::string& str);
+    /** Write the separator before the next element */
+    void NextElement();
+};
+
+#endif // BITCOIN_RPC_JSONSTREAM_H
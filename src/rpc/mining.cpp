@@ -901,21 +901,21 @@ UniValue estimatesmartpriority(const UniValue& params, bool fHelp)
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true  },
-    { "mining",             "getmininginfo",          &getmininginfo,          true  },
-    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true  },
-    { "mining",             "getblocktemplate",       &getblocktemplate,       true  },
-    { "mining",             "submitblock",            &submitblock,            true  },
-
-    { "generating",         "generate",               &generate,               true  },
-    { "generating",         "generatetoaddress",      &generatetoaddress,      true  },
-
-    { "util",               "estimatefee",            &estimatefee,            true  },
-    { "util",               "estimatepriority",       &estimatepriority,       true  },
-    { "util",               "estimatesmartfee",       &estimatesmartfee,       true  },
-    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true  },
+{ //  category              name                      actor (function)         okSafeMode  threadSafe
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
+    { "mining",             "getnetworkhashps",       &getnetworkhashps,       true,  true  },
+    { "mining",             "getmininginfo",          &getmininginfo,          true,  true  },
+    { "mining",             "prioritisetransaction",  &prioritisetransaction,  true,  false },
+    { "mining",             "getblocktemplate",       &getblocktemplate,       true,  false },
+    { "mining",             "submitblock",            &submitblock,            true,  false },
+
+    { "generating",         "generate",               &generate,               true,  false },
+    { "generating",         "generatetoaddress",      &generatetoaddress,      true,  false },
+
+    { "util",               "estimatefee",            &estimatefee,            true,  true  },
+    { "util",               "estimatepriority",       &estimatepriority,       true,  true  },
+    { "util",               "estimatesmartfee",       &estimatesmartfee,       true,  true  },
+    { "util",               "estimatesmartpriority",  &estimatesmartpriority,  true,  true  },
 };
 
 void RegisterMiningRPCCommands(CRPCTable &tableRPC)
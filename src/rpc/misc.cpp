@@ -5,12 +5,14 @@
 
 #include "base58.h"
 #include "clientversion.h"
+#include "httpserver.h"
 #include "init.h"
 #include "main.h"
 #include "net.h"
 #include "netbase.h"
 #include "rpc/server.h"
 #include "timedata.h"
+#include "txdb.h"
 #include "txmempool.h"
 #include "util.h"
 #include "utilstrencodings.h"
@@ -533,14 +535,77 @@ bool getAddressesFromParams(const UniValue& params, std::vector<std::pair<uint16
     return true;
 }
 
-bool heightSort(std::pair<CAddressUnspentKey, CAddressUnspentValue> a,
-                std::pair<CAddressUnspentKey, CAddressUnspentValue> b) {
-    return a.second.blockHeight < b.second.blockHeight;
+bool getPaginationFromParams(const UniValue& params, int &limit, bool &hasCursor, CAddressIndexKey &cursor)
+{
+    limit = 0;
+    hasCursor = false;
+
+    if (!params[0].isObject())
+        return false;
+
+    UniValue limitValue = find_value(params[0].get_obj(), "limit");
+    if (!limitValue.isNull()) {
+        limit = limitValue.get_int();
+        if (limit <= 0) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+        }
+    }
+
+    UniValue cursorValue = find_value(params[0].get_obj(), "cursor");
+    if (!cursorValue.isNull()) {
+        std::string strCursor = cursorValue.get_str();
+        if (!IsHex(strCursor)) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        std::vector<unsigned char> data(ParseHex(strCursor));
+        CDataStream ssCursor(data, SER_DISK, CLIENT_VERSION);
+        try {
+            ssCursor >> cursor;
+        } catch (const std::exception&) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        if (!ssCursor.empty()) {
+            throw JSONRPCError(RPC_INVALID_PARAMETER, "Invalid cursor");
+        }
+        hasCursor = true;
+    }
+
+    return limit > 0 || hasCursor;
 }
 
-bool timestampSort(std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> a,
-                   std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> b) {
-    return a.second.time < b.second.time;
+std::string getCursorFromAddressIndexKey(const CAddressIndexKey &key)
+{
+    CDataStream ssCursor(SER_DISK, CLIENT_VERSION);
+    ssCursor << key;
+    return HexStr(ssCursor.begin(), ssCursor.end());
+}
+
+bool getChainInfoFromParams(const UniValue& params)
+{
+    if (!params[0].isObject())
+        return false;
+
+    UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
+    return chainInfo.isBool() && chainInfo.get_bool();
+}
+
+/**
+ * Pin the address index for a query that reads it several times. pindexTip is
+ * set to the tip the snapshot reflects, which is what the query should report.
+ */
+CDBSnapshot *getAddressIndexSnapshot(const CBlockIndex *&pindexTip)
+{
+    CDBSnapshot *psnapshot = GetAddressIndexSnapshot(pindexTip);
+    if (!psnapshot) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
+    return psnapshot;
+}
+
+void addChainTipToResult(UniValue& result, const CBlockIndex *pindexTip)
+{
+    result.push_back(Pair("hash", pindexTip->GetBlockHash().GetHex()));
+    result.push_back(Pair("height", pindexTip->nHeight));
 }
 
 UniValue getaddressmempool(const UniValue& params, bool fHelp)
@@ -586,8 +651,6 @@ UniValue getaddressmempool(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
-    std::sort(indexes.begin(), indexes.end(), timestampSort);
-
     UniValue result(UniValue::VARR);
 
     for (std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> >::iterator it = indexes.begin();
@@ -627,9 +690,14 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
             "    ],\n"
-            "  \"chainInfo\"  (boolean) Include chain info with results\n"
+            "  \"chainInfo\"  (boolean) Include the hash and height of the chain tip the results reflect\n"
+            "  \"start\"  (number, optional) Only include outputs created at or above this block height\n"
+            "  \"end\"  (number, optional) Only include outputs created at or below this block height\n"
+            "  \"minconf\"  (number, optional) Only include outputs with at least this many confirmations\n"
+            "  \"minSatoshis\"  (number, optional) Only include outputs of at least this many satoshis\n"
+            "  \"limit\"  (number, optional) Return at most this many outputs, those of the lowest heights\n"
             "}\n"
-            "\nResult\n"
+            "\nResult (ordered by block height)\n"
             "[\n"
             "  {\n"
             "    \"address\"  (string) The address base58check encoded\n"
@@ -645,13 +713,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
             + HelpExampleRpc("getaddressutxos", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
             );
 
-    bool includeChainInfo = false;
-    if (params[0].isObject()) {
-        UniValue chainInfo = find_value(params[0].get_obj(), "chainInfo");
-        if (chainInfo.isBool()) {
-            includeChainInfo = chainInfo.get_bool();
-        }
-    }
+    bool includeChainInfo = getChainInfoFromParams(params);
 
     std::vector<std::pair<uint160, int> > addresses;
 
@@ -659,15 +721,58 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
+    // Read all addresses as of one tip, also the one confirmations are counted from
+    const CBlockIndex *pindexTip = NULL;
+    boost::scoped_ptr<CDBSnapshot> psnapshot(getAddressIndexSnapshot(pindexTip));
+
+    CAddressUnspentFilter filter;
+    if (params[0].isObject()) {
+        UniValue startValue = find_value(params[0].get_obj(), "start");
+        if (!startValue.isNull())
+            filter.minHeight = startValue.get_int();
+
+        UniValue endValue = find_value(params[0].get_obj(), "end");
+        if (!endValue.isNull())
+            filter.maxHeight = endValue.get_int();
+
+        UniValue minconfValue = find_value(params[0].get_obj(), "minconf");
+        if (!minconfValue.isNull()) {
+            int nMinConf = minconfValue.get_int();
+            if (nMinConf < 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Minconf is expected to be non-negative");
+            }
+            if (nMinConf > 0) {
+                filter.maxHeight = std::min(filter.maxHeight, pindexTip->nHeight - nMinConf + 1);
+            }
+        }
+
+        UniValue minSatoshisValue = find_value(params[0].get_obj(), "minSatoshis");
+        if (!minSatoshisValue.isNull())
+            filter.minSatoshis = minSatoshisValue.get_int64();
+
+        UniValue limitValue = find_value(params[0].get_obj(), "limit");
+        if (!limitValue.isNull()) {
+            int limit = limitValue.get_int();
+            if (limit <= 0) {
+                throw JSONRPCError(RPC_INVALID_PARAMETER, "Limit is expected to be greater than zero");
+            }
+            filter.nLimit = limit;
+        }
+    }
+
     std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspentOutputs;
 
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs)) {
+        if (!GetAddressUnspent((*it).first, (*it).second, unspentOutputs, filter, psnapshot.get())) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
     }
 
-    std::sort(unspentOutputs.begin(), unspentOutputs.end(), heightSort);
+    std::sort(unspentOutputs.begin(), unspentOutputs.end(), CAddressUnspentHeightCompare());
+
+    // Each address contributed up to the limit, keep the lowest heights overall
+    if (filter.nLimit > 0 && unspentOutputs.size() > filter.nLimit)
+        unspentOutputs.resize(filter.nLimit);
 
     UniValue utxos(UniValue::VARR);
 
@@ -690,10 +795,7 @@ UniValue getaddressutxos(const UniValue& params, bool fHelp)
     if (includeChainInfo) {
         UniValue result(UniValue::VOBJ);
         result.push_back(Pair("utxos", utxos));
-
-        LOCK(cs_main);
-        result.push_back(Pair("hash", chainActive.Tip()->GetBlockHash().GetHex()));
-        result.push_back(Pair("height", (int)chainActive.Height()));
+        addChainTipToResult(result, pindexTip);
         return result;
     } else {
         return utxos;
@@ -715,9 +817,11 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
-            "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified\n"
+            "  \"chainInfo\" (boolean) Include chain info in results, only applies if start and end specified or paginating\n"
+            "  \"limit\" (number, optional) Return at most this many deltas\n"
+            "  \"cursor\" (string, optional) Resume after the cursor returned by a previous call\n"
             "}\n"
-            "\nResult:\n"
+            "\nResult (ordered by block height and position in block):\n"
             "[\n"
             "  {\n"
             "    \"satoshis\"  (number) The difference of satoshis\n"
@@ -727,6 +831,10 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
             "    \"address\"  (string) The base58check encoded address\n"
             "  }\n"
             "]\n"
+            "\nIf limit or cursor is given, or chainInfo is requested, the result is an object with the\n"
+            "array above as \"deltas\" and, if more deltas remain, a \"cursor\" (string) for the next call.\n"
+            "Chain info adds the \"hash\" and \"height\" of the chain tip the deltas reflect and, with\n"
+            "start and end, the \"start\" and \"end\" blocks as objects with \"hash\" and \"height\".\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressdeltas", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddressdeltas", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -762,49 +870,77 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    int limit = 0;
+    bool hasCursor = false;
+    CAddressIndexKey cursor;
+    bool fPaginate = getPaginationFromParams(params, limit, hasCursor, cursor);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    if (hasCursor && std::find(addresses.begin(), addresses.end(), std::make_pair(cursor.hashBytes, (int)cursor.type)) == addresses.end()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not match any of the addresses");
+    }
+
+    const CBlockIndex *pindexTip = NULL;
+    boost::scoped_ptr<CDBSnapshot> psnapshot(getAddressIndexSnapshot(pindexTip));
+
+    const bool fRangeInfo = includeChainInfo && start > 0 && end > 0;
+    if (fRangeInfo && (start > pindexTip->nHeight || end > pindexTip->nHeight)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
+    }
+
+    boost::scoped_ptr<CAddressIndexMergeCursor> pcursor(GetAddressIndexMergeCursor(addresses, start, end, hasCursor ? &cursor : NULL, psnapshot.get()));
+    if (!pcursor) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
     }
 
     UniValue deltas(UniValue::VARR);
+    int count = 0;
+    bool fMore = false;
+    CAddressIndexKey lastKey;
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        if (limit > 0 && count == limit) {
+            fMore = true;
+            break;
+        }
+
+        const CAddressIndexKey &key = pcursor->GetKey();
+        CAmount satoshis;
+        if (!pcursor->GetValue(satoshis)) {
+            throw JSONRPCError(RPC_DATABASE_ERROR, "Unable to read address index");
+        }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
         std::string address;
-        if (!getAddressFromIndex(it->first.type, it->first.hashBytes, address)) {
+        if (!getAddressFromIndex(key.type, key.hashBytes, address)) {
             throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
         }
 
         UniValue delta(UniValue::VOBJ);
-        delta.push_back(Pair("satoshis", it->second));
-        delta.push_back(Pair("txid", it->first.txhash.GetHex()));
-        delta.push_back(Pair("index", (int)it->first.index));
-        delta.push_back(Pair("blockindex", (int)it->first.txindex));
-        delta.push_back(Pair("height", it->first.blockHeight));
+        delta.push_back(Pair("satoshis", satoshis));
+        delta.push_back(Pair("txid", key.txhash.GetHex()));
+        delta.push_back(Pair("index", (int)key.index));
+        delta.push_back(Pair("blockindex", (int)key.txindex));
+        delta.push_back(Pair("height", key.blockHeight));
         delta.push_back(Pair("address", address));
         deltas.push_back(delta);
-    }
 
-    UniValue result(UniValue::VOBJ);
+        lastKey = key;
+        count++;
+    }
 
-    if (includeChainInfo && start > 0 && end > 0) {
-        LOCK(cs_main);
+    if (!fPaginate && !fRangeInfo) {
+        return deltas;
+    }
 
-        if (start > chainActive.Height() || end > chainActive.Height()) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Start or end is outside chain range");
-        }
+    UniValue result(UniValue::VOBJ);
+    result.push_back(Pair("deltas", deltas));
+    if (fMore) {
+        result.push_back(Pair("cursor", getCursorFromAddressIndexKey(lastKey)));
+    }
 
-        CBlockIndex* startIndex = chainActive[start];
-        CBlockIndex* endIndex = chainActive[end];
+    if (fRangeInfo) {
+        // Blocks of the chain the snapshot reflects, even if the tip has moved since
+        const CBlockIndex* startIndex = pindexTip->GetAncestor(start);
+        const CBlockIndex* endIndex = pindexTip->GetAncestor(end);
 
         UniValue startInfo(UniValue::VOBJ);
         UniValue endInfo(UniValue::VOBJ);
@@ -815,14 +951,15 @@ UniValue getaddressdeltas(const UniValue& params, bool fHelp)
         endInfo.push_back(Pair("hash", endIndex->GetBlockHash().GetHex()));
         endInfo.push_back(Pair("height", end));
 
-        result.push_back(Pair("deltas", deltas));
         result.push_back(Pair("start", startInfo));
         result.push_back(Pair("end", endInfo));
+    }
 
-        return result;
-    } else {
-        return deltas;
+    if (includeChainInfo) {
+        addChainTipToResult(result, pindexTip);
     }
+
+    return result;
 }
 
 UniValue getaddressbalance(const UniValue& params, bool fHelp)
@@ -837,12 +974,15 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
             "    [\n"
             "      \"address\"  (string) The base58check encoded address\n"
             "      ,...\n"
-            "    ]\n"
+            "    ],\n"
+            "  \"chainInfo\"  (boolean, optional) Include the hash and height of the chain tip the balance reflects\n"
             "}\n"
             "\nResult:\n"
             "{\n"
             "  \"balance\"  (string) The current balance in satoshis\n"
             "  \"received\"  (string) The total number of satoshis received (including change)\n"
+            "  \"hash\"  (string, chainInfo only) The hash of the chain tip\n"
+            "  \"height\"  (number, chainInfo only) The height of the chain tip\n"
             "}\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddressbalance", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
@@ -855,32 +995,108 @@ UniValue getaddressbalance(const UniValue& params, bool fHelp)
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
-
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-        }
-    }
+    const CBlockIndex *pindexTip = NULL;
+    boost::scoped_ptr<CDBSnapshot> psnapshot(getAddressIndexSnapshot(pindexTip));
 
     CAmount balance = 0;
     CAmount received = 0;
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        if (it->second > 0) {
-            received += it->second;
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressSummaryValue summary;
+        if (!GetAddressSummary((*it).first, (*it).second, summary, psnapshot.get())) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
         }
-        balance += it->second;
+        balance += summary.balance;
+        received += summary.received;
     }
 
     UniValue result(UniValue::VOBJ);
     result.push_back(Pair("balance", balance));
     result.push_back(Pair("received", received));
+    if (getChainInfoFromParams(params)) {
+        addChainTipToResult(result, pindexTip);
+    }
 
     return result;
 
 }
 
+UniValue getaddresssummary(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 1)
+        throw runtime_error(
+            "getaddresssummary\n"
+            "\nReturns the balance, received amount, transaction count and first and last active\n"
+            "block heights for each address (requires addressindex to be enabled).\n"
+            "\nArguments:\n"
+            "{\n"
+            "  \"addresses\"\n"
+            "    [\n"
+            "      \"address\"  (string) The base58check encoded address\n"
+            "      ,...\n"
+            "    ],\n"
+            "  \"chainInfo\"  (boolean, optional) Include the hash and height of the chain tip the summaries reflect\n"
+            "}\n"
+            "\nResult:\n"
+            "[\n"
+            "  {\n"
+            "    \"address\"  (string) The base58check encoded address\n"
+            "    \"balance\"  (number) The current balance in satoshis\n"
+            "    \"received\"  (number) The total number of satoshis received (including change)\n"
+            "    \"txcount\"  (number) The number of transactions involving the address\n"
+            "    \"firstheight\"  (number) The height of the first block with activity (0 if none)\n"
+            "    \"lastheight\"  (number) The height of the last block with activity (0 if none)\n"
+            "  }\n"
+            "]\n"
+            "\nWith chainInfo, the result is an object with the array above as \"summaries\" and the\n"
+            "\"hash\" and \"height\" of the chain tip.\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getaddresssummary", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
+            + HelpExampleRpc("getaddresssummary", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
+        );
+
+    std::vector<std::pair<uint160, int> > addresses;
+
+    if (!getAddressesFromParams(params, addresses)) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid address");
+    }
+
+    const CBlockIndex *pindexTip = NULL;
+    boost::scoped_ptr<CDBSnapshot> psnapshot(getAddressIndexSnapshot(pindexTip));
+
+    UniValue result(UniValue::VARR);
+
+    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
+        CAddressSummaryValue summary;
+        if (!GetAddressSummary((*it).first, (*it).second, summary, psnapshot.get())) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+        }
+
+        std::string address;
+        if (!getAddressFromIndex((*it).second, (*it).first, address)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unknown address type");
+        }
+
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("address", address));
+        entry.push_back(Pair("balance", summary.balance));
+        entry.push_back(Pair("received", summary.received));
+        entry.push_back(Pair("txcount", summary.txCount));
+        entry.push_back(Pair("firstheight", summary.firstHeight));
+        entry.push_back(Pair("lastheight", summary.lastHeight));
+        result.push_back(entry);
+    }
+
+    if (getChainInfoFromParams(params)) {
+        UniValue info(UniValue::VOBJ);
+        info.push_back(Pair("summaries", result));
+        addChainTipToResult(info, pindexTip);
+        return info;
+    }
+
+    return result;
+}
+
 UniValue getaddresstxids(const UniValue& params, bool fHelp)
 {
     if (fHelp || params.size() != 1)
@@ -896,12 +1112,18 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
             "    ]\n"
             "  \"start\" (number) The start block height\n"
             "  \"end\" (number) The end block height\n"
+            "  \"limit\" (number, optional) Return at most this many txids\n"
+            "  \"cursor\" (string, optional) Resume after the cursor returned by a previous call\n"
+            "  \"chainInfo\" (boolean, optional) Include the hash and height of the chain tip the txids reflect\n"
             "}\n"
-            "\nResult:\n"
+            "\nResult (ordered by block height and position in block):\n"
             "[\n"
             "  \"transactionid\"  (string) The transaction id\n"
             "  ,...\n"
             "]\n"
+            "\nIf limit or cursor is given, or chainInfo is requested, the result is an object with the\n"
+            "array above as \"txids\" and, if more txids remain, a \"cursor\" (string) for the next call.\n"
+            "Chain info adds the \"hash\" and \"height\" of the chain tip.\n"
             "\nExamples:\n"
             + HelpExampleCli("getaddresstxids", "'{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}'")
             + HelpExampleRpc("getaddresstxids", "{\"addresses\": [\"12c6DSiU4Rq3P4ZxziKxzrL5LmMBrzjrJX\"]}")
@@ -924,50 +1146,95 @@ UniValue getaddresstxids(const UniValue& params, bool fHelp)
         }
     }
 
-    std::vector<std::pair<CAddressIndexKey, CAmount> > addressIndex;
+    int limit = 0;
+    bool hasCursor = false;
+    CAddressIndexKey cursor;
+    bool fPaginate = getPaginationFromParams(params, limit, hasCursor, cursor);
 
-    for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        if (start > 0 && end > 0) {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex, start, end)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        } else {
-            if (!GetAddressIndex((*it).first, (*it).second, addressIndex)) {
-                throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
-            }
-        }
+    if (hasCursor && std::find(addresses.begin(), addresses.end(), std::make_pair(cursor.hashBytes, (int)cursor.type)) == addresses.end()) {
+        throw JSONRPCError(RPC_INVALID_PARAMETER, "Cursor does not match any of the addresses");
     }
 
-    std::set<std::pair<int, std::string> > txids;
-    UniValue result(UniValue::VARR);
+    bool includeChainInfo = getChainInfoFromParams(params);
+
+    const CBlockIndex *pindexTip = NULL;
+    boost::scoped_ptr<CDBSnapshot> psnapshot(getAddressIndexSnapshot(pindexTip));
+
+    boost::scoped_ptr<CAddressIndexMergeCursor> pcursor(GetAddressIndexMergeCursor(addresses, start, end, hasCursor ? &cursor : NULL, psnapshot.get()));
+    if (!pcursor) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "No information available for address");
+    }
 
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=addressIndex.begin(); it!=addressIndex.end(); it++) {
-        int height = it->first.blockHeight;
-        std::string txid = it->first.txhash.GetHex();
+    UniValue result(UniValue::VARR);
 
-        if (addresses.size() > 1) {
-            txids.insert(std::make_pair(height, txid));
-        } else {
-            if (txids.insert(std::make_pair(height, txid)).second) {
-                result.push_back(txid);
+    // All rows of a transaction are adjacent in the merged index, also across
+    // addresses, so duplicates can be dropped without remembering every txid seen.
+    int count = 0;
+    bool fMore = false;
+    bool fHaveLast = false;
+    CAddressIndexKey lastKey;
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        const CAddressIndexKey &key = pcursor->GetKey();
+        if (!fHaveLast || key.txhash != lastKey.txhash || key.blockHeight != lastKey.blockHeight) {
+            if (limit > 0 && count == limit) {
+                fMore = true;
+                break;
             }
+            result.push_back(key.txhash.GetHex());
+            count++;
         }
+        lastKey = key;
+        fHaveLast = true;
     }
 
-    if (addresses.size() > 1) {
-        for (std::set<std::pair<int, std::string> >::const_iterator it=txids.begin(); it!=txids.end(); it++) {
-            result.push_back(it->second);
+    if (fPaginate || includeChainInfo) {
+        UniValue paged(UniValue::VOBJ);
+        paged.push_back(Pair("txids", result));
+        if (fMore) {
+            paged.push_back(Pair("cursor", getCursorFromAddressIndexKey(lastKey)));
+        }
+        if (includeChainInfo) {
+            addChainTipToResult(paged, pindexTip);
         }
+        return paged;
     }
 
     return result;
 
 }
 
+static CSpentIndexKey getSpentIndexKeyFromParam(const UniValue& param)
+{
+    if (!param.isObject())
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+
+    UniValue txidValue = find_value(param.get_obj(), "txid");
+    UniValue indexValue = find_value(param.get_obj(), "index");
+
+    if (!txidValue.isStr() || !indexValue.isNum()) {
+        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
+    }
+
+    uint256 txid = ParseHashV(txidValue, "txid");
+    int outputIndex = indexValue.get_int();
+
+    return CSpentIndexKey(txid, outputIndex);
+}
+
+static UniValue getSpentInfoObject(const CSpentIndexValue& value)
+{
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("txid", value.txid.GetHex()));
+    obj.push_back(Pair("index", (int)value.inputIndex));
+    obj.push_back(Pair("height", value.blockHeight));
+    return obj;
+}
+
 UniValue getspentinfo(const UniValue& params, bool fHelp)
 {
 
-    if (fHelp || params.size() != 1 || !params[0].isObject())
+    if (fHelp || params.size() != 1 || !(params[0].isObject() || params[0].isArray()))
         throw runtime_error(
             "getspentinfo\n"
             "\nReturns the txid and index where an output is spent.\n"
@@ -976,64 +1243,161 @@ UniValue getspentinfo(const UniValue& params, bool fHelp)
             "  \"txid\" (string) The hex string of the txid\n"
             "  \"index\" (number) The start block height\n"
             "}\n"
+            "or an array of such objects to look up many outputs at once\n"
             "\nResult:\n"
             "{\n"
             "  \"txid\"  (string) The transaction id\n"
             "  \"index\"  (number) The spending input index\n"
             "  ,...\n"
             "}\n"
+            "or, for an array argument, an array of such objects in the same order, with null for outputs that are not spent\n"
             "\nExamples:\n"
             + HelpExampleCli("getspentinfo", "'{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}'")
+            + HelpExampleCli("getspentinfo", "'[{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}, {\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 1}]'")
             + HelpExampleRpc("getspentinfo", "{\"txid\": \"0437cd7f8525ceed2324359c2d0ba26006d92d856a9c20fa0241106ee5a597c9\", \"index\": 0}")
         );
 
-    UniValue txidValue = find_value(params[0].get_obj(), "txid");
-    UniValue indexValue = find_value(params[0].get_obj(), "index");
+    if (params[0].isArray()) {
+        const UniValue& outpoints = params[0].get_array();
+        std::vector<CSpentIndexKey> keys;
+        keys.reserve(outpoints.size());
+        for (unsigned int i = 0; i < outpoints.size(); i++)
+            keys.push_back(getSpentIndexKeyFromParam(outpoints[i]));
 
-    if (!txidValue.isStr() || !indexValue.isNum()) {
-        throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Invalid txid or index");
-    }
+        std::vector<CSpentIndexValue> values;
+        if (!GetSpentIndexes(keys, values)) {
+            throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
+        }
 
-    uint256 txid = ParseHashV(txidValue, "txid");
-    int outputIndex = indexValue.get_int();
+        UniValue result(UniValue::VARR);
+        for (unsigned int i = 0; i < values.size(); i++) {
+            if (values[i].IsNull()) {
+                result.push_back(NullUniValue);
+            } else {
+                result.push_back(getSpentInfoObject(values[i]));
+            }
+        }
+        return result;
+    }
 
-    CSpentIndexKey key(txid, outputIndex);
+    CSpentIndexKey key = getSpentIndexKeyFromParam(params[0]);
     CSpentIndexValue value;
 
     if (!GetSpentIndex(key, value)) {
         throw JSONRPCError(RPC_INVALID_ADDRESS_OR_KEY, "Unable to get spent info");
     }
 
+    return getSpentInfoObject(value);
+}
+
+UniValue getspentindexcacheinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getspentindexcacheinfo\n"
+            "\nReturns the state of the in-memory cache of spent index lookups.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"entries\": xxxxx,     (numeric) Outpoints currently cached, spent or not\n"
+            "  \"maxentries\": xxxxx,  (numeric) Maximum number of cached outpoints (-spentindexcache)\n"
+            "  \"hits\": xxxxx,        (numeric) Lookups answered from the cache\n"
+            "  \"misses\": xxxxx       (numeric) Lookups that read the index database\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getspentindexcacheinfo", "")
+            + HelpExampleRpc("getspentindexcacheinfo", "")
+        );
+
+    if (!fSpentIndex)
+        throw JSONRPCError(RPC_MISC_ERROR, "Spent index not enabled");
+
+    CSpentIndexCache::Stats stats = pindexdb->GetSpentIndexCacheStats();
+
     UniValue obj(UniValue::VOBJ);
-    obj.push_back(Pair("txid", value.txid.GetHex()));
-    obj.push_back(Pair("index", (int)value.inputIndex));
-    obj.push_back(Pair("height", value.blockHeight));
+    obj.push_back(Pair("entries", (uint64_t)stats.nEntries));
+    obj.push_back(Pair("maxentries", (uint64_t)stats.nMaxEntries));
+    obj.push_back(Pair("hits", stats.nHits));
+    obj.push_back(Pair("misses", stats.nMisses));
+
+    return obj;
+}
+
+UniValue gethttpqueueinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "gethttpqueueinfo\n"
+            "\nReturns the state of the lanes of the HTTP work queue that serves RPC and REST requests.\n"
+            "Requests are assigned a lane by priority (see -rpcpriority); workers serve higher\n"
+            "priority lanes first.\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"high\": {               (json object) The lane of high priority requests\n"
+            "    \"queued\": xxxxx,       (numeric) Requests waiting for a worker\n"
+            "    \"maxqueued\": xxxxx,    (numeric) Requests are rejected when this many are waiting (-rpcworkqueue)\n"
+            "    \"running\": xxxxx,      (numeric) Requests being handled by workers\n"
+            "    \"maxrunning\": xxxxx,   (numeric) Workers that requests of this and lower priorities may occupy\n"
+            "    \"processed\": xxxxx,    (numeric) Requests handled since startup\n"
+            "    \"rejected\": xxxxx,     (numeric) Requests rejected since startup because the lane was full\n"
+            "    \"avgwait\": xxxxx,      (numeric) Average time requests waited for a worker, in microseconds\n"
+            "    \"maxwait\": xxxxx,      (numeric) Longest time a request waited for a worker, in microseconds\n"
+            "    \"lastwait\": xxxxx      (numeric) Time the last started request waited for a worker, in microseconds\n"
+            "  },\n"
+            "  \"normal\": {...},        (json object) The lane of normal priority requests\n"
+            "  \"low\": {...}            (json object) The lane of low priority requests\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("gethttpqueueinfo", "")
+            + HelpExampleRpc("gethttpqueueinfo", "")
+        );
+
+    std::vector<HTTPWorkQueueLaneStats> vStats = GetHTTPWorkQueueStats();
+
+    UniValue obj(UniValue::VOBJ);
+    for (unsigned int i = 0; i < vStats.size(); i++) {
+        const HTTPWorkQueueLaneStats& stats = vStats[i];
+        uint64_t nStarted = stats.nProcessed + stats.nRunning;
+        UniValue lane(UniValue::VOBJ);
+        lane.push_back(Pair("queued", (uint64_t)stats.nQueued));
+        lane.push_back(Pair("maxqueued", (uint64_t)stats.nMaxQueued));
+        lane.push_back(Pair("running", stats.nRunning));
+        lane.push_back(Pair("maxrunning", stats.nMaxRunning));
+        lane.push_back(Pair("processed", stats.nProcessed));
+        lane.push_back(Pair("rejected", stats.nRejected));
+        lane.push_back(Pair("avgwait", nStarted ? stats.nWaitTotal / (int64_t)nStarted : 0));
+        lane.push_back(Pair("maxwait", stats.nWaitMax));
+        lane.push_back(Pair("lastwait", stats.nWaitLast));
+        obj.push_back(Pair(HTTPPriorityName((HTTPPriority)i), lane));
+    }
 
     return obj;
 }
 
 static const CRPCCommand commands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
-    { "control",            "getinfo",                &getinfo,                true  }, /* uses wallet if enabled */
-    { "util",               "validateaddress",        &validateaddress,        true  }, /* uses wallet if enabled */
-    { "util",               "createmultisig",         &createmultisig,         true  },
-    { "util",               "createwitnessaddress",   &createwitnessaddress,   true  },
-    { "util",               "verifymessage",          &verifymessage,          true  },
-    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true  },
+{ //  category              name                      actor (function)         okSafeMode  threadSafe
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
+    { "control",            "getinfo",                &getinfo,                true,  false }, /* uses wallet if enabled */
+    { "control",            "gethttpqueueinfo",       &gethttpqueueinfo,       true,  true  },
+    { "util",               "validateaddress",        &validateaddress,        true,  true  }, /* uses wallet if enabled */
+    { "util",               "createmultisig",         &createmultisig,         true,  true  },
+    { "util",               "createwitnessaddress",   &createwitnessaddress,   true,  true  },
+    { "util",               "verifymessage",          &verifymessage,          true,  true  },
+    { "util",               "signmessagewithprivkey", &signmessagewithprivkey, true,  true  },
 
     /* Address index */
-    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true  },
-    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false },
-    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false },
-    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false },
-    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false },
+    { "addressindex",       "getaddressmempool",      &getaddressmempool,      true,  true  },
+    { "addressindex",       "getaddressutxos",        &getaddressutxos,        false, true  },
+    { "addressindex",       "getaddressdeltas",       &getaddressdeltas,       false, true  },
+    { "addressindex",       "getaddresstxids",        &getaddresstxids,        false, true  },
+    { "addressindex",       "getaddressbalance",      &getaddressbalance,      false, true  },
+    { "addressindex",       "getaddresssummary",      &getaddresssummary,      false, true  },
 
     /* Blockchain */
-    { "blockchain",         "getspentinfo",           &getspentinfo,           false },
+    { "blockchain",         "getspentinfo",           &getspentinfo,           false, true  },
+    { "blockchain",         "getspentindexcacheinfo", &getspentindexcacheinfo, true,  true  },
 
     /* Not shown in help */
-    { "hidden",             "setmocktime",            &setmocktime,            true  },
+    { "hidden",             "setmocktime",            &setmocktime,            true,  false },
 };
 
 void RegisterMiscRPCCommands(CRPCTable &tableRPC)
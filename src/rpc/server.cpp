@@ -8,6 +8,7 @@
 #include "base58.h"
 #include "init.h"
 #include "random.h"
+#include "rpc/jsonstream.h"
 #include "sync.h"
 #include "ui_interface.h"
 #include "util.h"
@@ -37,6 +38,8 @@ static RPCTimerInterface* timerInterface = NULL;
 /* Map of name to timer.
  * @note Can be changed to std::unique_ptr when C++11 */
 static std::map<std::string, boost::shared_ptr<RPCTimerBase> > deadlineTimers;
+/* Maximum number of elements of one batch executed at the same time */
+static int nRPCBatchConcurrency = DEFAULT_RPC_BATCH_CONCURRENCY;
 
 static struct CRPCSignals
 {
@@ -264,11 +267,11 @@ UniValue stop(const UniValue& params, bool fHelp)
  * Call Table
  */
 static const CRPCCommand vRPCCommands[] =
-{ //  category              name                      actor (function)         okSafeMode
-  //  --------------------- ------------------------  -----------------------  ----------
+{ //  category              name                      actor (function)         okSafeMode  threadSafe
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
     /* Overall control/query calls */
-    { "control",            "help",                   &help,                   true  },
-    { "control",            "stop",                   &stop,                   true  },
+    { "control",            "help",                   &help,                   true,  false },
+    { "control",            "stop",                   &stop,                   true,  false },
 };
 
 CRPCTable::CRPCTable()
@@ -305,10 +308,80 @@ bool CRPCTable::appendCommand(const std::string& name, const CRPCCommand* pcmd)
     return true;
 }
 
+/** Threads executing the elements of JSON-RPC batches */
+class RPCBatchQueue
+{
+private:
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::deque<boost::function<void ()> > queue;
+    boost::thread_group threads;
+    bool running;
+
+    void Run()
+    {
+        RenameThread("bitcoin-rpcbatch");
+        while (true) {
+            boost::function<void ()> f;
+            {
+                boost::unique_lock<boost::mutex> lock(cs);
+                while (running && queue.empty())
+                    cond.wait(lock);
+                // Drain the queue when stopping, batches wait for every element they posted
+                if (queue.empty())
+                    return;
+                f = queue.front();
+                queue.pop_front();
+            }
+            f();
+        }
+    }
+
+public:
+    RPCBatchQueue() : running(false) {}
+
+    void Start(int nThreads)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        running = true;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&RPCBatchQueue::Run, this));
+    }
+
+    void Stop()
+    {
+        {
+            boost::unique_lock<boost::mutex> lock(cs);
+            running = false;
+            cond.notify_all();
+        }
+        threads.join_all();
+    }
+
+    /** Queue f for execution, returns false if the queue is not running */
+    bool Post(const boost::function<void ()>& f)
+    {
+        boost::unique_lock<boost::mutex> lock(cs);
+        if (!running)
+            return false;
+        queue.push_back(f);
+        cond.notify_one();
+        return true;
+    }
+};
+
+static RPCBatchQueue rpcBatchQueue;
+
 bool StartRPC()
 {
     LogPrint("rpc", "Starting RPC\n");
     fRPCRunning = true;
+    nRPCBatchConcurrency = GetArg("-rpcbatchconcurrency", DEFAULT_RPC_BATCH_CONCURRENCY);
+    int nBatchThreads = GetArg("-rpcbatchthreads", DEFAULT_RPC_BATCH_THREADS);
+    if (nBatchThreads > 0 && nRPCBatchConcurrency > 1) {
+        LogPrint("rpc", "Starting %d RPC batch threads\n", nBatchThreads);
+        rpcBatchQueue.Start(nBatchThreads);
+    }
     g_rpcSignals.Started();
     return true;
 }
@@ -323,6 +396,7 @@ void InterruptRPC()
 void StopRPC()
 {
     LogPrint("rpc", "Stopping RPC\n");
+    rpcBatchQueue.Stop();
     deadlineTimers.clear();
     g_rpcSignals.Stopped();
 }
@@ -407,13 +481,99 @@ static UniValue JSONRPCExecOne(const UniValue& req)
     return rpc_result;
 }
 
-std::string JSONRPCExecBatch(const UniValue& vReq)
+/** Whether a batch element calls a command that may run concurrently with the rest of the batch */
+static bool JSONRPCIsThreadSafe(const UniValue& req)
+{
+    if (!req.isObject())
+        return false;
+    const UniValue& valMethod = find_value(req.get_obj(), "method");
+    if (!valMethod.isStr())
+        return false;
+    const CRPCCommand *pcmd = tableRPC[valMethod.get_str()];
+    return pcmd && pcmd->threadSafe;
+}
+
+/** Replies of the batch elements executed on the batch threads that were not written out yet */
+struct RPCBatchState
+{
+    CWaitableCriticalSection cs;
+    CConditionVariable cond;
+    std::map<size_t, UniValue> results;
+};
+
+static void JSONRPCExecBatchElement(boost::shared_ptr<RPCBatchState> state, const UniValue req, size_t nIndex)
+{
+    UniValue result;
+    try {
+        result = JSONRPCExecOne(req);
+    } catch (...) {
+        // The batch waits for this element, it must always get a reply
+        result = JSONRPCReplyObj(NullUniValue, JSONRPCError(RPC_INTERNAL_ERROR, "Internal error"), NullUniValue);
+    }
+
+    boost::unique_lock<boost::mutex> lock(state->cs);
+    std::swap(state->results[nIndex], result);
+    state->cond.notify_all();
+}
+
+void JSONRPCExecBatch(const UniValue& vReq, CJSONStreamWriter& writer)
+{
+    // Replies are written out in request order as soon as they are available, so
+    // at most nRPCBatchConcurrency replies are held in memory.
+    boost::shared_ptr<RPCBatchState> state(new RPCBatchState());
+    size_t nNext = 0;
+    size_t nWritten = 0;
+
+    writer.BeginArray();
+    while (nWritten < vReq.size()) {
+        // The client is gone: don't run the rest of the batch for nobody.
+        // Elements already posted finish on their own, the state is shared.
+        if (!writer.Good())
+            return;
+        UniValue result;
+        {
+            boost::unique_lock<boost::mutex> lock(state->cs);
+            while (nNext < vReq.size() && nNext - nWritten < (size_t)nRPCBatchConcurrency && JSONRPCIsThreadSafe(vReq[nNext])) {
+                if (!rpcBatchQueue.Post(boost::bind(&JSONRPCExecBatchElement, state, vReq[nNext], nNext)))
+                    break;
+                nNext++;
+            }
+
+            std::map<size_t, UniValue>::iterator it = state->results.find(nWritten);
+            if (it != state->results.end()) {
+                std::swap(result, it->second);
+                state->results.erase(it);
+            } else if (nNext > nWritten) {
+                state->cond.wait(lock);
+                continue;
+            }
+        }
+
+        if (nNext == nWritten) {
+            // Not thread-safe (or no batch threads): everything before it is done, run it here
+            result = JSONRPCExecOne(vReq[nNext]);
+            nNext++;
+        }
+
+        writer.Value(result);
+        nWritten++;
+    }
+    writer.EndArray();
+    writer.Raw("\n");
+}
+
+static bool AppendToString(std::string* pstr, const std::string& str)
 {
-    UniValue ret(UniValue::VARR);
-    for (unsigned int reqIdx = 0; reqIdx < vReq.size(); reqIdx++)
-        ret.push_back(JSONRPCExecOne(vReq[reqIdx]));
+    pstr->append(str);
+    return true;
+}
 
-    return ret.write() + "\n";
+std::string JSONRPCExecBatch(const UniValue& vReq)
+{
+    std::string strReply;
+    CJSONStreamWriter writer(boost::bind(AppendToString, &strReply, _1));
+    JSONRPCExecBatch(vReq, writer);
+    return strReply;
 }
 
 UniValue CRPCTable::execute(const std::string &strMethod, const UniValue &params) const
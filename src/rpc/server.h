@@ -19,6 +19,7 @@
 
 #include <univalue.h>
 
+class CJSONStreamWriter;
 class CRPCCommand;
 
 namespace RPCServer
@@ -124,6 +125,11 @@ void RPCRunLater(const std::string& name, boost::function<void(void)> func, int6
 
 typedef UniValue(*rpcfn_type)(const UniValue& params, bool fHelp);
 
+//! -rpcbatchthreads default
+static const int DEFAULT_RPC_BATCH_THREADS = 8;
+//! -rpcbatchconcurrency default
+static const int DEFAULT_RPC_BATCH_CONCURRENCY = 4;
+
 class CRPCCommand
 {
 public:
@@ -131,6 +137,8 @@ public:
     std::string name;
     rpcfn_type actor;
     bool okSafeMode;
+    //! Has no side effects, so may run concurrently with the other elements of a JSON-RPC batch
+    bool threadSafe;
 };
 
 /**
@@ -193,6 +201,14 @@ extern void EnsureWalletIsUnlocked();
 bool StartRPC();
 void InterruptRPC();
 void StopRPC();
+/**
+ * Execute a JSON-RPC batch and write the reply array to writer as the replies
+ * become available. Runs of elements that call thread-safe commands are
+ * executed in parallel on the batch threads, any other element waits for the
+ * elements before it and runs alone.
+ */
+void JSONRPCExecBatch(const UniValue& vReq, CJSONStreamWriter& writer);
+/** Execute a JSON-RPC batch and return the reply array */
 std::string JSONRPCExecBatch(const UniValue& vReq);
 
 #endif // BITCOIN_RPCSERVER_H
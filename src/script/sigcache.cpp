@@ -5,26 +5,87 @@
 
 #include "sigcache.h"
 
-#include "memusage.h"
+#include "cuckoocache.h"
 #include "pubkey.h"
 #include "random.h"
 #include "uint256.h"
 #include "util.h"
 
+#include <boost/functional/hash.hpp>
 #include <boost/thread.hpp>
-#include <boost/unordered_set.hpp>
 
 namespace {
 
 /**
- * We're hashing a nonce into the entries themselves, so we don't need extra
- * blinding in the set hash computation.
+ * A reader-writer lock for the signature cache. Readers only increment the
+ * counter of their own shard, picked by thread, so that the script
+ * verification threads looking up signatures in parallel neither wait for
+ * each other nor write to a shared cache line. A writer, which is rare,
+ * announces itself and waits until all shards are empty; readers arriving in
+ * the meantime step back until it is done.
  */
-class CSignatureCacheHasher
+class CSignatureCacheLock
 {
+private:
+    static const unsigned int SHARDS = 32;
+
+    //! Readers in one shard, padded to a cache line of its own
+    struct Shard {
+        std::atomic<uint32_t> nReaders;
+        char padding[64 - sizeof(std::atomic<uint32_t>)];
+    };
+
+    Shard shards[SHARDS];
+    std::atomic<bool> fWriting;
+    //! Serializes writers
+    boost::mutex csWrite;
+
+    static unsigned int GetShard()
+    {
+        uint64_t nThread = boost::hash<boost::thread::id>()(boost::this_thread::get_id());
+        return (nThread * 0x9e3779b97f4a7c15ULL) >> 59;
+    }
+
 public:
-    size_t operator()(const uint256& key) const {
-        return key.GetCheapHash();
+    CSignatureCacheLock() : fWriting(false)
+    {
+        for (unsigned int i = 0; i < SHARDS; i++)
+            shards[i].nReaders = 0;
+    }
+
+    /** Enter as a reader; returns the shard to pass to unlock_shared */
+    unsigned int lock_shared()
+    {
+        unsigned int nShard = GetShard();
+        while (true) {
+            shards[nShard].nReaders.fetch_add(1);
+            if (!fWriting.load())
+                return nShard;
+            shards[nShard].nReaders.fetch_sub(1);
+            while (fWriting.load())
+                boost::this_thread::yield();
+        }
+    }
+
+    void unlock_shared(unsigned int nShard)
+    {
+        shards[nShard].nReaders.fetch_sub(1, std::memory_order_release);
+    }
+
+    void lock()
+    {
+        csWrite.lock();
+        fWriting.store(true);
+        for (unsigned int i = 0; i < SHARDS; i++) {
+            while (shards[i].nReaders.load() != 0)
+                boost::this_thread::yield();
+        }
+    }
+
+    void unlock()
+    {
+        fWriting.store(false, std::memory_order_release);
+        csWrite.unlock();
     }
 };
 
@@ -38,15 +99,16 @@ class CSignatureCache
 private:
      //! Entries are SHA256(nonce || signature hash || public key || signature):
     uint256 nonce;
-    typedef boost::unordered_set<uint256, CSignatureCacheHasher> map_type;
+    typedef CuckooCache::cache<uint256, SignatureCacheHasher> map_type;
     map_type setValid;
-    boost::shared_mutex cs_sigcache;
-
+    CSignatureCacheLock cs_sigcache;
 
 public:
     CSignatureCache()
     {
         GetRandBytes(nonce.begin(), 32);
+        // Usable before InitSignatureCache sizes it
+        setValid.setup(0);
     }
 
     void
@@ -55,53 +117,61 @@ public:
         CSHA256().Write(nonce.begin(), 32).Write(hash.begin(), 32).Write(&pubkey[0], pubkey.size()).Write(&vchSig[0], vchSig.size()).Finalize(entry.begin());
     }
 
+    /** Look up an entry; if erase is set, a hit marks it as the first to be overwritten */
     bool
-    Get(const uint256& entry)
+    Get(const uint256& entry, const bool erase)
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
-        return setValid.count(entry);
+        unsigned int nShard = cs_sigcache.lock_shared();
+        bool fFound = setValid.contains(entry, erase);
+        cs_sigcache.unlock_shared(nShard);
+        return fFound;
     }
 
-    void Erase(const uint256& entry)
+    void Set(const uint256& entry)
     {
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        setValid.erase(entry);
+        cs_sigcache.lock();
+        setValid.insert(entry);
+        cs_sigcache.unlock();
     }
 
-    void Set(const uint256& entry)
+    uint32_t setup_bytes(size_t n)
     {
-        size_t nMaxCacheSize = GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
-        if (nMaxCacheSize <= 0) return;
-
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
-        while (memusage::DynamicUsage(setValid) > nMaxCacheSize)
-        {
-            map_type::size_type s = GetRand(setValid.bucket_count());
-            map_type::local_iterator it = setValid.begin(s);
-            if (it != setValid.end(s)) {
-                setValid.erase(*it);
-            }
-        }
-
-        setValid.insert(entry);
+        cs_sigcache.lock();
+        uint32_t nElems = setValid.setup_bytes(n);
+        cs_sigcache.unlock();
+        return nElems;
     }
 };
 
+/* In previous versions of this code, signatureCache was a local static variable
+ * in CachingTransactionSignatureChecker::VerifySignature. We initialize
+ * signatureCache outside of VerifySignature to avoid the atomic operation per
+ * call overhead associated with local static variables even though
+ * signatureCache could be made local to VerifySignature.
+*/
+static CSignatureCache signatureCache;
+
 }
 
-bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+void InitSignatureCache()
 {
-    static CSignatureCache signatureCache;
+    // nMaxCacheSize is unsigned. If -maxsigcachesize is set to zero,
+    // setup_bytes creates the minimum possible cache (2 elements).
+    // The script execution cache takes the other half of -maxsigcachesize.
+    size_t nMaxCacheSize = std::min(std::max((int64_t)0, GetArg("-maxsigcachesize", DEFAULT_MAX_SIG_CACHE_SIZE) / 2), MAX_MAX_SIG_CACHE_SIZE) * ((size_t) 1 << 20);
+    size_t nElems = signatureCache.setup_bytes(nMaxCacheSize);
+    LogPrintf("Using %zu MiB out of %zu requested for signature cache, able to store %zu elements\n",
+            (nElems*sizeof(uint256)) >>20, nMaxCacheSize>>20, nElems);
+}
 
+bool CachingTransactionSignatureChecker::VerifySignature(const std::vector<unsigned char>& vchSig, const CPubKey& pubkey, const uint256& sighash) const
+{
     uint256 entry;
     signatureCache.ComputeEntry(entry, sighash, vchSig, pubkey);
 
-    if (signatureCache.Get(entry)) {
-        if (!store) {
-            signatureCache.Erase(entry);
-        }
+    // Entries looked up without storing (when connecting a block) won't be needed again
+    if (signatureCache.Get(entry, !store))
         return true;
-    }
 
     if (!TransactionSignatureChecker::VerifySignature(vchSig, pubkey, sighash))
         return false;
@@ -0,0 +1,94 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "spentindexcache.h"
+
+#include "hash.h"
+#include "random.h"
+
+#include <limits>
+
+CSpentIndexKeyHasher::CSpentIndexKeyHasher() : k0(GetRand(std::numeric_limits<uint64_t>::max())), k1(GetRand(std::numeric_limits<uint64_t>::max())) {}
+
+size_t CSpentIndexKeyHasher::operator()(const CSpentIndexKey& key) const
+{
+    return SipHashUint256(k0, k1 ^ key.outputIndex, key.txid);
+}
+
+CSpentIndexCache::CSpentIndexCache(size_t nMaxEntries)
+{
+    nMaxShardEntries = (nMaxEntries + NUM_SHARDS - 1) / NUM_SHARDS;
+}
+
+CSpentIndexCache::Shard &CSpentIndexCache::GetShard(const CSpentIndexKey &key)
+{
+    // Pick the shard from the high bits of the salted hash
+    return shards[(hasher(key) >> 28) % NUM_SHARDS];
+}
+
+bool CSpentIndexCache::Lookup(const CSpentIndexKey &key, CSpentIndexValue &value, uint64_t &nGeneration)
+{
+    Shard &shard = GetShard(key);
+    LOCK(shard.cs);
+    map_type::iterator it = shard.map.find(key);
+    if (it == shard.map.end()) {
+        shard.nMisses++;
+        nGeneration = shard.nGeneration;
+        return false;
+    }
+    shard.nHits++;
+    shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+    value = it->second->second;
+    return true;
+}
+
+void CSpentIndexCache::Insert(const CSpentIndexKey &key, const CSpentIndexValue &value, uint64_t nGeneration)
+{
+    if (nMaxShardEntries == 0)
+        return;
+    Shard &shard = GetShard(key);
+    LOCK(shard.cs);
+    if (shard.nGeneration != nGeneration)
+        return;
+    map_type::iterator it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        it->second->second = value;
+        shard.entries.splice(shard.entries.begin(), shard.entries, it->second);
+        return;
+    }
+    shard.entries.push_front(std::make_pair(key, value));
+    shard.map.insert(std::make_pair(key, shard.entries.begin()));
+    if (shard.map.size() > nMaxShardEntries) {
+        shard.map.erase(shard.entries.back().first);
+        shard.entries.pop_back();
+    }
+}
+
+void CSpentIndexCache::Invalidate(const CSpentIndexKey &key)
+{
+    Shard &shard = GetShard(key);
+    LOCK(shard.cs);
+    shard.nGeneration++;
+    map_type::iterator it = shard.map.find(key);
+    if (it != shard.map.end()) {
+        shard.entries.erase(it->second);
+        shard.map.erase(it);
+    }
+}
+
+CSpentIndexCache::Stats CSpentIndexCache::GetStats() const
+{
+    Stats stats;
+    stats.nEntries = 0;
+    stats.nMaxEntries = nMaxShardEntries * NUM_SHARDS;
+    stats.nHits = 0;
+    stats.nMisses = 0;
+    for (unsigned int i = 0; i < NUM_SHARDS; i++) {
+        LOCK(shards[i].cs);
+        stats.nEntries += shards[i].map.size();
+        stats.nHits += shards[i].nHits;
+        stats.nMisses += shards[i].nMisses;
+    }
+    return stats;
+}
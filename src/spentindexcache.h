@@ -0,0 +1,96 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_SPENTINDEXCACHE_H
+#define BITCOIN_SPENTINDEXCACHE_H
+
+#include "spentindex.h"
+#include "sync.h"
+
+#include <list>
+
+#include <boost/unordered_map.hpp>
+
+//! -spentindexcache default (number of outpoints)
+static const unsigned int DEFAULT_SPENTINDEX_CACHE_SIZE = 100000;
+
+/** Salted hasher for spent index keys, so peers cannot aim outpoints at one shard or bucket */
+class CSpentIndexKeyHasher
+{
+private:
+    uint64_t k0, k1;
+
+public:
+    CSpentIndexKeyHasher();
+
+    size_t operator()(const CSpentIndexKey& key) const;
+};
+
+struct CSpentIndexKeyEqual
+{
+    bool operator()(const CSpentIndexKey& a, const CSpentIndexKey& b) const {
+        return a.outputIndex == b.outputIndex && a.txid == b.txid;
+    }
+};
+
+/**
+ * Bounded LRU cache of spent index lookups, including outputs that are not
+ * spent (cached as a null value). Entries are spread over independently
+ * locked shards so concurrent RPC threads rarely contend.
+ *
+ * Writers must call Invalidate() for every key they change, after the change
+ * is committed to the database. A lookup that missed only inserts its result
+ * if no invalidation hit the shard meanwhile, so a value read before a
+ * concurrent block connect can never be cached after it.
+ */
+class CSpentIndexCache
+{
+public:
+    struct Stats {
+        size_t nEntries;
+        size_t nMaxEntries;
+        uint64_t nHits;
+        uint64_t nMisses;
+    };
+
+    CSpentIndexCache(size_t nMaxEntries);
+
+    /**
+     * Look up a key.
+     * @param[out] value        The cached value (null if the output is known to be unspent)
+     * @param[out] nGeneration  On a miss, the token to pass to Insert() with the value read from disk
+     * @return true on a cache hit
+     */
+    bool Lookup(const CSpentIndexKey &key, CSpentIndexValue &value, uint64_t &nGeneration);
+    void Insert(const CSpentIndexKey &key, const CSpentIndexValue &value, uint64_t nGeneration);
+    void Invalidate(const CSpentIndexKey &key);
+    Stats GetStats() const;
+
+private:
+    static const unsigned int NUM_SHARDS = 16;
+
+    typedef std::list<std::pair<CSpentIndexKey, CSpentIndexValue> > list_type;
+    typedef boost::unordered_map<CSpentIndexKey, list_type::iterator, CSpentIndexKeyHasher, CSpentIndexKeyEqual> map_type;
+
+    struct Shard {
+        mutable CCriticalSection cs;
+        //! Most recently used entries first
+        list_type entries;
+        map_type map;
+        //! Bumped on every invalidation
+        uint64_t nGeneration;
+        uint64_t nHits;
+        uint64_t nMisses;
+
+        Shard() : nGeneration(0), nHits(0), nMisses(0) {}
+    };
+
+    CSpentIndexKeyHasher hasher;
+    size_t nMaxShardEntries;
+    Shard shards[NUM_SHARDS];
+
+    Shard &GetShard(const CSpentIndexKey &key);
+};
+
+#endif // BITCOIN_SPENTINDEXCACHE_H
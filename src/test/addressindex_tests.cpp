@@ -0,0 +1,195 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "addressindex.h"
+#include "coins.h"
+#include "random.h"
+#include "script/standard.h"
+#include "streams.h"
+#include "txdb.h"
+#include "txmempool.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(addressindex_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(compact_key_serialization)
+{
+    uint160 hash;
+    hash.SetHex("0102030405060708090a0b0c0d0e0f1011121314");
+    CAddressIndexKey key(1, hash, 400000, 1234, GetRandHash(), 300, true);
+
+    CCompactAddressIndexKey compact(key);
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << compact;
+    BOOST_CHECK_EQUAL(ss.size(), 32U);
+    BOOST_CHECK_EQUAL(ss.size(), compact.GetSerializeSize(SER_DISK, CLIENT_VERSION));
+
+    CCompactAddressIndexKey compact2;
+    ss >> compact2;
+    CAddressIndexKey key2 = compact2.ToKey(key.txhash);
+    BOOST_CHECK(key2.type == key.type);
+    BOOST_CHECK(key2.hashBytes == key.hashBytes);
+    BOOST_CHECK_EQUAL(key2.blockHeight, key.blockHeight);
+    BOOST_CHECK_EQUAL(key2.txindex, key.txindex);
+    BOOST_CHECK(key2.txhash == key.txhash);
+    BOOST_CHECK_EQUAL(key2.index, key.index);
+    BOOST_CHECK_EQUAL(key2.spending, key.spending);
+
+    // Keys of one address sort by height first
+    CDataStream ssLow(SER_DISK, CLIENT_VERSION), ssHigh(SER_DISK, CLIENT_VERSION);
+    ssLow << CCompactAddressIndexKey(CAddressIndexKey(1, hash, 255, 7, uint256(), 200, false));
+    ssHigh << CCompactAddressIndexKey(CAddressIndexKey(1, hash, 256, 0, uint256(), 0, false));
+    BOOST_CHECK(ssLow.str() < ssHigh.str());
+}
+
+BOOST_AUTO_TEST_CASE(compact_key_upgrade)
+{
+    CIndexDB db(1 << 20, true);
+    uint160 hash = uint160(std::vector<unsigned char>(20, 0xab));
+
+    // Rows in the format written by older versions
+    std::vector<std::pair<CAddressIndexKey, CAmount> > rows;
+    uint256 txid1 = GetRandHash(), txid2 = GetRandHash();
+    rows.push_back(std::make_pair(CAddressIndexKey(1, hash, 10, 1, txid1, 0, false), 5000));
+    rows.push_back(std::make_pair(CAddressIndexKey(1, hash, 10, 1, txid1, 2, false), 700));
+    rows.push_back(std::make_pair(CAddressIndexKey(1, hash, 12, 3, txid2, 0, true), -5000));
+    CDBBatch batch(db);
+    for (unsigned int i = 0; i < rows.size(); i++)
+        batch.Write(std::make_pair('a', rows[i].first), rows[i].second);
+    BOOST_CHECK(db.WriteBatch(batch));
+
+    BOOST_CHECK(db.UpgradeAddressIndex());
+    // Nothing is left to convert
+    BOOST_CHECK(db.UpgradeAddressIndex());
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > result;
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, result));
+    BOOST_CHECK_EQUAL(result.size(), rows.size());
+    for (unsigned int i = 0; i < result.size() && i < rows.size(); i++) {
+        BOOST_CHECK_EQUAL(result[i].first.blockHeight, rows[i].first.blockHeight);
+        BOOST_CHECK_EQUAL(result[i].first.txindex, rows[i].first.txindex);
+        BOOST_CHECK(result[i].first.txhash == rows[i].first.txhash);
+        BOOST_CHECK_EQUAL(result[i].first.index, rows[i].first.index);
+        BOOST_CHECK_EQUAL(result[i].first.spending, rows[i].first.spending);
+        BOOST_CHECK_EQUAL(result[i].second, rows[i].second);
+    }
+
+    // Rows in a height range
+    result.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hash, 1, result, 11, 12));
+    BOOST_CHECK_EQUAL(result.size(), 1U);
+    BOOST_CHECK(result.size() == 1 && result[0].first.txhash == txid2);
+}
+
+BOOST_AUTO_TEST_CASE(compact_key_connect_disconnect)
+{
+    CIndexDB db(1 << 20, true);
+    uint160 hash = uint160(std::vector<unsigned char>(20, 0xcd));
+    std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > unspent;
+    std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > spent;
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > block1, block2;
+    uint256 txid1 = GetRandHash(), txid2 = GetRandHash();
+    block1.push_back(std::make_pair(CAddressIndexKey(2, hash, 1, 0, txid1, 0, false), 1000));
+    block2.push_back(std::make_pair(CAddressIndexKey(2, hash, 2, 1, txid2, 0, true), -1000));
+    block2.push_back(std::make_pair(CAddressIndexKey(2, hash, 2, 1, txid2, 1, false), 400));
+    BOOST_CHECK(db.WriteBlockIndexes(block1, unspent, spent, NULL));
+    BOOST_CHECK(db.WriteBlockIndexes(block2, unspent, spent, NULL));
+
+    std::vector<std::pair<CAddressIndexKey, CAmount> > result;
+    BOOST_CHECK(db.ReadAddressIndex(hash, 2, result));
+    BOOST_CHECK_EQUAL(result.size(), 3U);
+
+    BOOST_CHECK(db.EraseBlockIndexes(block2, unspent, spent));
+    result.clear();
+    BOOST_CHECK(db.ReadAddressIndex(hash, 2, result));
+    BOOST_CHECK_EQUAL(result.size(), 1U);
+    BOOST_CHECK(result.size() == 1 && result[0].first.txhash == txid1);
+
+    CAddressSummaryValue summary;
+    BOOST_CHECK(db.ReadAddressSummaryIndex(hash, 2, summary));
+    BOOST_CHECK_EQUAL(summary.balance, 1000);
+    BOOST_CHECK_EQUAL(summary.txCount, 1);
+    BOOST_CHECK_EQUAL(summary.lastHeight, 1);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_address_index)
+{
+    CTxMemPool pool(CFeeRate(0));
+    TestMemPoolEntryHelper entry;
+    CCoinsView dummy;
+    CCoinsViewCache view(&dummy);
+
+    CKeyID keyA(uint160(std::vector<unsigned char>(20, 0xaa)));
+    CKeyID keyB(uint160(std::vector<unsigned char>(20, 0xbb)));
+    std::vector<std::pair<uint160, int> > addresses;
+    addresses.push_back(std::make_pair(uint160(keyA), 1));
+    addresses.push_back(std::make_pair(uint160(keyB), 1));
+
+    // The funding transaction is confirmed, the spends of its outputs are in the mempool
+    CMutableTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vout.resize(2);
+    txFund.vout[0].nValue = 5000;
+    txFund.vout[0].scriptPubKey = GetScriptForDestination(keyA);
+    txFund.vout[1].nValue = 3000;
+    txFund.vout[1].scriptPubKey = GetScriptForDestination(keyB);
+    view.ModifyCoins(txFund.GetHash())->FromTx(txFund, 1);
+
+    // Added out of time order: tx1 (B to A) at time 300, tx2 (A to B) at time 100
+    CMutableTransaction tx1;
+    tx1.vin.resize(1);
+    tx1.vin[0].prevout = COutPoint(txFund.GetHash(), 1);
+    tx1.vout.resize(1);
+    tx1.vout[0].nValue = 2900;
+    tx1.vout[0].scriptPubKey = GetScriptForDestination(keyA);
+    CMutableTransaction tx2;
+    tx2.vin.resize(1);
+    tx2.vin[0].prevout = COutPoint(txFund.GetHash(), 0);
+    tx2.vout.resize(1);
+    tx2.vout[0].nValue = 4900;
+    tx2.vout[0].scriptPubKey = GetScriptForDestination(keyB);
+    pool.addAddressIndex(entry.Time(300).FromTx(tx1), view);
+    pool.addAddressIndex(entry.Time(100).FromTx(tx2), view);
+
+    // Deltas of both addresses, merged in time order
+    std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > results;
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_CHECK_EQUAL(results.size(), 4U);
+    for (unsigned int i = 1; i < results.size(); i++)
+        BOOST_CHECK(results[i - 1].second.time <= results[i].second.time);
+    BOOST_CHECK(results[0].first.txhash == tx2.GetHash());
+    BOOST_CHECK(results[3].first.txhash == tx1.GetHash());
+
+    // Spending deltas refer to the spent output
+    for (unsigned int i = 0; i < results.size(); i++) {
+        if (results[i].first.spending) {
+            BOOST_CHECK(results[i].second.amount < 0);
+            BOOST_CHECK(results[i].second.prevhash == txFund.GetHash());
+        }
+    }
+
+    // Removing a transaction drops all of its deltas and only those
+    BOOST_CHECK(pool.removeAddressIndex(tx2.GetHash()));
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_CHECK_EQUAL(results.size(), 2U);
+    for (unsigned int i = 0; i < results.size(); i++)
+        BOOST_CHECK(results[i].first.txhash == tx1.GetHash());
+
+    std::vector<std::pair<uint160, int> > addressA(1, addresses[0]);
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(addressA, results));
+    BOOST_CHECK_EQUAL(results.size(), 1U);
+    BOOST_CHECK(results.size() == 1 && results[0].second.amount == 2900);
+
+    BOOST_CHECK(pool.removeAddressIndex(tx1.GetHash()));
+    results.clear();
+    BOOST_CHECK(pool.getAddressIndex(addresses, results));
+    BOOST_CHECK(results.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
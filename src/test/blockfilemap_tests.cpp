@@ -0,0 +1,133 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockfilemap.h"
+#include "chain.h"
+#include "chainparams.h"
+#include "crypto/common.h"
+#include "main.h"
+#include "streams.h"
+#include "txdb.h"
+#include "utilstrencodings.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockfilemap_tests, TestingSetup)
+
+BOOST_AUTO_TEST_CASE(blockfilemap_read)
+{
+#ifndef WIN32
+    CBlockFileMap map(1);
+    // The genesis block is written to the first block file on startup
+    const CBlockIndex* pindex = chainActive.Genesis();
+    CBlock block;
+    BOOST_CHECK(ReadBlockFromDisk(block, pindex, Params().GetConsensus()));
+    CDataStream ssBlock(SER_DISK, CLIENT_VERSION);
+    ssBlock << block;
+
+    CBlockFileSpan span;
+    BOOST_CHECK(map.GetBlock(pindex->GetBlockPos(), span));
+    BOOST_CHECK_EQUAL(HexStr(span.begin(), span.end()), HexStr(ssBlock.begin(), ssBlock.end()));
+
+    // The coinbase directly follows the header and the transaction count
+    CDiskTxPos postx(pindex->GetBlockPos(), GetSizeOfCompactSize(block.vtx.size()));
+    CBlockFileSpan txspan, header;
+    BOOST_CHECK(map.GetTransaction(postx, txspan, &header));
+    CDataStream ssTx(SER_DISK, CLIENT_VERSION);
+    ssTx << block.vtx[0];
+    BOOST_CHECK_EQUAL(HexStr(txspan.begin(), txspan.end()), HexStr(ssTx.begin(), ssTx.end()));
+    BOOST_CHECK(Hash(header.begin(), header.end()) == pindex->GetBlockHash());
+
+    CTransaction tx;
+    CSpanReader(SER_DISK, CLIENT_VERSION, txspan.begin(), txspan.end()) >> tx;
+    BOOST_CHECK(tx.GetHash() == block.vtx[0].GetHash());
+
+    CBlockFileMap::Stats stats = map.GetStats();
+    BOOST_CHECK_EQUAL(stats.nMapped, 1U);
+    BOOST_CHECK_EQUAL(stats.nMaps, 1U);
+    BOOST_CHECK_EQUAL(stats.nHits, 1U);
+
+    // A forgotten file is mapped again on the next read
+    map.Forget(0);
+    BOOST_CHECK_EQUAL(map.GetStats().nMapped, 0U);
+    BOOST_CHECK(map.GetBlock(pindex->GetBlockPos(), span));
+    BOOST_CHECK_EQUAL(map.GetStats().nMaps, 2U);
+
+    // The span keeps the mapping alive after it is dropped from the map
+    map.Forget(0);
+    CBlockHeader blockheader;
+    CSpanReader(SER_DISK, CLIENT_VERSION, span.begin(), span.end()) >> blockheader;
+    BOOST_CHECK(blockheader.GetHash() == pindex->GetBlockHash());
+
+    // Missing files and bad positions are not found
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(99999, 8), span));
+    BOOST_CHECK(!map.GetBlock(CDiskBlockPos(0, 0), span));
+#endif
+
+    CBlockFileMap disabled(0);
+    CBlockFileSpan disabledspan;
+    BOOST_CHECK(!disabled.GetBlock(chainActive.Tip()->GetBlockPos(), disabledspan));
+    BOOST_CHECK(disabledspan.empty());
+}
+
+BOOST_AUTO_TEST_CASE(serialized_transaction_size)
+{
+    CMutableTransaction mtx;
+    mtx.vin.resize(2);
+    mtx.vin[0].scriptSig = CScript() << OP_1 << std::vector<unsigned char>(300, 0x42);
+    mtx.vin[1].prevout.n = 7;
+    mtx.vout.resize(3);
+    mtx.vout[1].scriptPubKey = CScript() << OP_RETURN << std::vector<unsigned char>(40, 0x17);
+    mtx.nLockTime = 1234;
+
+    for (int fWitness = 0; fWitness <= 1; fWitness++) {
+        if (fWitness) {
+            mtx.wit.vtxinwit.resize(2);
+            mtx.wit.vtxinwit[1].scriptWitness.stack.push_back(std::vector<unsigned char>(72, 0x01));
+            mtx.wit.vtxinwit[1].scriptWitness.stack.push_back(std::vector<unsigned char>(33, 0x02));
+        }
+        CTransaction tx(mtx);
+        CDataStream ss(SER_DISK, CLIENT_VERSION);
+        ss << tx;
+        BOOST_CHECK_EQUAL(ss[4] == 0, fWitness == 1);
+        // Trailing data is not part of the transaction
+        size_t nSize = ss.size();
+        ss << 0xdeadbeef;
+        BOOST_CHECK_EQUAL(GetSerializedTransactionSize(&ss[0], &ss[0] + ss.size()), nSize);
+        // Truncated data is not a transaction
+        BOOST_CHECK_EQUAL(GetSerializedTransactionSize(&ss[0], &ss[0] + nSize - 1), 0U);
+        BOOST_CHECK_EQUAL(GetSerializedTransactionSize(&ss[0], &ss[0] + 4), 0U);
+    }
+
+    // A compact size beyond the end of the data
+    std::vector<char> vch(4, 0);
+    vch.push_back((char)0xfd);
+    BOOST_CHECK_EQUAL(GetSerializedTransactionSize(&vch[0], &vch[0] + vch.size()), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(spanreader)
+{
+    std::vector<char> vch(6);
+    WriteLE32((unsigned char*)&vch[0], 0x12345678);
+    vch[4] = 1;
+    vch[5] = 2;
+
+    CSpanReader reader(SER_DISK, CLIENT_VERSION, &vch[0], &vch[0] + vch.size());
+    uint32_t n;
+    reader >> n;
+    BOOST_CHECK_EQUAL(n, 0x12345678U);
+    BOOST_CHECK_EQUAL(reader.size(), 2U);
+    reader.ignore(1);
+    BOOST_CHECK_EQUAL(*reader.data(), 2);
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    BOOST_CHECK_THROW(reader.ignore(2), std::ios_base::failure);
+    unsigned char ch;
+    reader >> ch;
+    BOOST_CHECK_EQUAL(ch, 2);
+    BOOST_CHECK(reader.empty());
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,82 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "blockimport.h"
+#include "chainparams.h"
+#include "streams.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(blockimport_tests, TestingSetup)
+
+/** Write blocks to a new file the way WriteBlockToDisk does, with some garbage in between */
+static FILE* WriteBlocks(const boost::filesystem::path& path, const std::vector<CBlock>& blocks)
+{
+    CAutoFile file(fopen(path.string().c_str(), "wb+"), SER_DISK, CLIENT_VERSION);
+    BOOST_REQUIRE(!file.IsNull());
+    for (unsigned int i = 0; i < blocks.size(); i++) {
+        file << std::string("garbage");
+        file << FLATDATA(Params().MessageStart()) << (unsigned int)::GetSerializeSize(blocks[i], SER_DISK, CLIENT_VERSION) << blocks[i];
+    }
+    // A block cut short is skipped
+    file << FLATDATA(Params().MessageStart()) << (unsigned int)1000 << blocks[0].GetBlockHeader();
+    rewind(file.Get());
+    return file.release();
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_order)
+{
+    // Distinct blocks; only the genesis block passes CheckBlock
+    std::vector<CBlock> blocks;
+    for (unsigned int i = 0; i < 12; i++) {
+        blocks.push_back(Params().GenesisBlock());
+        blocks.back().nNonce += i;
+    }
+
+    for (int nThreads = 1; nThreads <= 3; nThreads++) {
+        // A tiny limit makes the workers wait for every block to be taken
+        for (int fTiny = 0; fTiny <= 1; fTiny++) {
+            CBlockImportPipeline pipeline(Params(), nThreads, fTiny ? 1 : DEFAULT_IMPORT_QUEUE_MAXMEM);
+            for (unsigned int nFile = 0; nFile < 4; nFile++) {
+                std::vector<CBlock> fileblocks(blocks.begin() + nFile * 3, blocks.begin() + nFile * 3 + 3);
+                pipeline.AddFile(WriteBlocks(pathTemp / strprintf("import%d_%d_%u.dat", nThreads, fTiny, nFile), fileblocks));
+            }
+            pipeline.Start();
+
+            CImportedBlock imported;
+            for (unsigned int i = 0; i < blocks.size(); i++) {
+                BOOST_REQUIRE(pipeline.Next(imported));
+                BOOST_CHECK(imported.hash == blocks[i].GetHash());
+                BOOST_CHECK(imported.block.GetHash() == blocks[i].GetHash());
+                BOOST_CHECK_EQUAL(imported.nSource, i / 3);
+                BOOST_CHECK_EQUAL(imported.nSize, ::GetSerializeSize(blocks[i], SER_DISK, CLIENT_VERSION));
+                BOOST_CHECK(imported.pos.IsNull());
+                BOOST_CHECK_EQUAL(imported.block.fChecked, i == 0);
+            }
+            BOOST_CHECK(!pipeline.Next(imported));
+            BOOST_CHECK(!pipeline.Next(imported));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(blockimport_stop)
+{
+    std::vector<CBlock> blocks(20, Params().GenesisBlock());
+    CBlockImportPipeline pipeline(Params(), 2, 1);
+    for (unsigned int nFile = 0; nFile < 5; nFile++)
+        pipeline.AddFile(WriteBlocks(pathTemp / strprintf("stop%u.dat", nFile), blocks));
+    // Also files no worker got to are closed
+    pipeline.AddFile(WriteBlocks(pathTemp / "unread.dat", blocks));
+    pipeline.Start();
+
+    CImportedBlock imported;
+    BOOST_CHECK(pipeline.Next(imported));
+    BOOST_CHECK(imported.hash == Params().GenesisBlock().GetHash());
+    // Workers waiting for room are woken up
+    pipeline.Stop();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
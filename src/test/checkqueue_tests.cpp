@@ -0,0 +1,125 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "checkqueue.h"
+#include "random.h"
+
+#include "test/test_bitcoin.h"
+
+#include <atomic>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+#include <boost/thread/thread.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(checkqueue_tests, BasicTestingSetup)
+
+/** Counts how often it was run; fails if fOk is unset */
+struct FakeCheck
+{
+    std::atomic<unsigned int>* pnRuns;
+    unsigned int nCost;
+    bool fOk;
+
+    FakeCheck() : pnRuns(NULL), nCost(0), fOk(true) {}
+    FakeCheck(std::atomic<unsigned int>* pnRunsIn, unsigned int nCostIn, bool fOkIn) : pnRuns(pnRunsIn), nCost(nCostIn), fOk(fOkIn) {}
+
+    bool operator()()
+    {
+        ++*pnRuns;
+        return fOk;
+    }
+
+    unsigned int GetCost() const { return nCost; }
+
+    void swap(FakeCheck& check)
+    {
+        std::swap(pnRuns, check.pnRuns);
+        std::swap(nCost, check.nCost);
+        std::swap(fOk, check.fOk);
+    }
+};
+
+BOOST_AUTO_TEST_CASE(checkqueue_all_run)
+{
+    for (int nThreads = 0; nThreads <= 3; nThreads++) {
+        CCheckQueue<FakeCheck> queue(16, 3);
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CCheckQueue<FakeCheck>::Thread, &queue));
+
+        // The queue is reused for several blocks
+        for (int nBlock = 0; nBlock < 10; nBlock++) {
+            std::atomic<unsigned int> nRuns(0);
+            unsigned int nTotal = 0;
+            {
+                CCheckQueueControl<FakeCheck> control(&queue);
+                for (int nTx = 0; nTx < 50; nTx++) {
+                    std::vector<FakeCheck> vChecks;
+                    for (unsigned int i = insecure_rand() % 20; i > 0; i--)
+                        vChecks.push_back(FakeCheck(&nRuns, insecure_rand() % 5, true));
+                    nTotal += vChecks.size();
+                    control.Add(vChecks);
+                    BOOST_CHECK(vChecks.empty());
+                }
+                BOOST_CHECK(control.Wait());
+            }
+            BOOST_CHECK_EQUAL(nRuns, nTotal);
+            BOOST_CHECK(queue.IsIdle());
+        }
+
+        threads.interrupt_all();
+        threads.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_failure)
+{
+    for (int nThreads = 0; nThreads <= 3; nThreads++) {
+        CCheckQueue<FakeCheck> queue(16, 3);
+        boost::thread_group threads;
+        for (int i = 0; i < nThreads; i++)
+            threads.create_thread(boost::bind(&CCheckQueue<FakeCheck>::Thread, &queue));
+
+        for (unsigned int nFail = 0; nFail < 200; nFail += 37) {
+            std::atomic<unsigned int> nRuns(0);
+            CCheckQueueControl<FakeCheck> control(&queue);
+            for (unsigned int i = 0; i < 200; i += 10) {
+                std::vector<FakeCheck> vChecks;
+                for (unsigned int j = i; j < i + 10; j++)
+                    vChecks.push_back(FakeCheck(&nRuns, 1, j != nFail));
+                control.Add(vChecks);
+            }
+            BOOST_CHECK(!control.Wait());
+            BOOST_CHECK(nRuns <= 200U);
+        }
+        // A failure doesn't stick
+        std::atomic<unsigned int> nRuns(0);
+        std::vector<FakeCheck> vChecks(1, FakeCheck(&nRuns, 1, true));
+        CCheckQueueControl<FakeCheck> control(&queue);
+        control.Add(vChecks);
+        BOOST_CHECK(control.Wait());
+        BOOST_CHECK_EQUAL(nRuns, 1U);
+
+        threads.interrupt_all();
+        threads.join_all();
+    }
+}
+
+BOOST_AUTO_TEST_CASE(checkqueue_cost_order)
+{
+    // Without workers the master runs the most expensive check first, and
+    // drops the others once it failed
+    CCheckQueue<FakeCheck> queue(16, 0);
+    std::atomic<unsigned int> nRuns(0);
+    std::vector<FakeCheck> vChecks;
+    for (unsigned int i = 0; i < 100; i++)
+        vChecks.push_back(FakeCheck(&nRuns, i == 42 ? 1000 : i % 10, i != 42));
+    CCheckQueueControl<FakeCheck> control(&queue);
+    control.Add(vChecks);
+    BOOST_CHECK(!control.Wait());
+    BOOST_CHECK_EQUAL(nRuns, 1U);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
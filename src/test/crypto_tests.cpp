@@ -9,6 +9,7 @@
 #include "crypto/sha512.h"
 #include "crypto/hmac_sha256.h"
 #include "crypto/hmac_sha512.h"
+#include "hash.h"
 #include "random.h"
 #include "utilstrencodings.h"
 #include "test/test_bitcoin.h"
@@ -255,6 +256,51 @@ BOOST_AUTO_TEST_CASE(sha256_testvectors) {
     TestSHA256(test1, "a316d55510b49662420f49d145d42fb83f31ef8dc016aa4e32df049991a91e26");
 }
 
+BOOST_AUTO_TEST_CASE(sha256d64)
+{
+    // Exercises every batch size the multi-buffer implementations are used for
+    for (int i = 0; i <= 32; ++i) {
+        unsigned char in[64 * 32];
+        unsigned char out1[32 * 32], out2[32 * 32];
+        for (int j = 0; j < 64 * i; ++j) {
+            in[j] = insecure_rand();
+        }
+        for (int j = 0; j < i; ++j) {
+            CHash256().Write(in + 64 * j, 64).Finalize(out1 + 32 * j);
+        }
+        SHA256D64(out2, in, i);
+        BOOST_CHECK(memcmp(out1, out2, 32 * i) == 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(sha256d64_kernels)
+{
+    // Every kernel this CPU can run, not just the ones SHA256AutoDetect picked
+    std::vector<SHA256D64Kernel> kernels = SHA256D64Kernels();
+    BOOST_CHECK_EQUAL(kernels[0].name, "standard");
+    unsigned char in[64 * 8];
+    unsigned char out1[32 * 8], out2[32 * 8];
+    for (int i = 0; i < 100; ++i) {
+        for (unsigned int j = 0; j < sizeof(in); ++j) {
+            in[j] = insecure_rand();
+        }
+        for (int j = 0; j < 8; ++j) {
+            kernels[0].transform(out1 + 32 * j, in + 64 * j);
+        }
+        if (i == 0) {
+            unsigned char hash[32];
+            CHash256().Write(in, 64).Finalize(hash);
+            BOOST_CHECK(memcmp(out1, hash, 32) == 0);
+        }
+        for (size_t k = 0; k < kernels.size(); ++k) {
+            const SHA256D64Kernel& kernel = kernels[k];
+            memset(out2, 0, sizeof(out2));
+            kernel.transform(out2, in);
+            BOOST_CHECK_MESSAGE(memcmp(out1, out2, 32 * kernel.ways) == 0, kernel.name);
+        }
+    }
+}
+
 BOOST_AUTO_TEST_CASE(sha512_testvectors) {
     TestSHA512("",
                "cf83e1357eefb8bdf1542850d66d8007d620e4050b5715dc83f4a921d36ce9ce"
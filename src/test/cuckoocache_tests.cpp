@@ -0,0 +1,110 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "cuckoocache.h"
+#include "random.h"
+#include "uint256.h"
+
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+/** The signature cache hasher: entries are random, so their words are the hashes */
+class RandomHasher
+{
+public:
+    template <uint8_t hash_select>
+    uint32_t operator()(const uint256& key) const
+    {
+        uint32_t u;
+        std::memcpy(&u, key.begin() + 4 * hash_select, 4);
+        return u;
+    }
+};
+
+typedef CuckooCache::cache<uint256, RandomHasher> test_cache;
+
+static void insecure_GetRandHash(uint256& t)
+{
+    uint32_t* ptr = (uint32_t*)t.begin();
+    for (uint8_t j = 0; j < 8; ++j)
+        *(ptr++) = insecure_rand();
+}
+
+/** Share of hashes[nBegin, nEnd) that are still in the cache */
+static double HitRate(const test_cache& cache, const std::vector<uint256>& hashes, size_t nBegin, size_t nEnd)
+{
+    size_t nHits = 0;
+    for (size_t i = nBegin; i < nEnd; i++)
+        nHits += cache.contains(hashes[i], false);
+    return nHits / (double)(nEnd - nBegin);
+}
+
+BOOST_FIXTURE_TEST_SUITE(cuckoocache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(cuckoocache_soundness)
+{
+    seed_insecure_rand(true);
+    test_cache cache;
+    uint32_t nSize = cache.setup_bytes(1 << 20);
+    BOOST_CHECK_EQUAL(nSize, (1U << 20) / 32);
+
+    std::vector<uint256> hashes(nSize / 2);
+    for (unsigned int i = 0; i < hashes.size(); i++) {
+        insecure_GetRandHash(hashes[i]);
+        cache.insert(hashes[i]);
+    }
+    // Entries that were never inserted are never found
+    for (unsigned int i = 0; i < 1000; i++) {
+        uint256 h;
+        insecure_GetRandHash(h);
+        BOOST_CHECK(!cache.contains(h, false));
+    }
+    // At half load, every entry fits
+    BOOST_CHECK_EQUAL(HitRate(cache, hashes, 0, hashes.size()), 1.0);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_hit_rate)
+{
+    seed_insecure_rand(true);
+    test_cache cache;
+    uint32_t nSize = cache.setup_bytes(1 << 20);
+
+    // Insert twice as many entries as fit: the most recent ones survive
+    std::vector<uint256> hashes(nSize * 2);
+    for (unsigned int i = 0; i < hashes.size(); i++) {
+        insecure_GetRandHash(hashes[i]);
+        cache.insert(hashes[i]);
+    }
+    BOOST_CHECK_GT(HitRate(cache, hashes, hashes.size() - nSize / 4, hashes.size()), 0.95);
+    BOOST_CHECK_LT(HitRate(cache, hashes, 0, nSize / 4), 0.05);
+}
+
+BOOST_AUTO_TEST_CASE(cuckoocache_erase)
+{
+    seed_insecure_rand(true);
+    test_cache cache;
+    uint32_t nSize = cache.setup_bytes(1 << 20);
+
+    // Few enough entries in total that no kept entry ages out
+    std::vector<uint256> hashes(nSize * 9 / 10);
+    for (unsigned int i = 0; i < hashes.size(); i++)
+        insecure_GetRandHash(hashes[i]);
+    // Fill 40% of the cache, and erase the first half of that on hit
+    size_t nFirst = nSize * 4 / 10;
+    for (unsigned int i = 0; i < nFirst; i++)
+        cache.insert(hashes[i]);
+    for (unsigned int i = 0; i < nFirst / 2; i++)
+        BOOST_CHECK(cache.contains(hashes[i], true));
+    // Erased entries are still found until their slot is needed
+    BOOST_CHECK_EQUAL(HitRate(cache, hashes, 0, nFirst / 2), 1.0);
+
+    // The new entries take the place of the erased ones, not of the kept ones
+    for (unsigned int i = nFirst; i < hashes.size(); i++)
+        cache.insert(hashes[i]);
+    BOOST_CHECK_GT(HitRate(cache, hashes, nFirst / 2, nFirst), 0.99);
+    BOOST_CHECK_LT(HitRate(cache, hashes, 0, nFirst / 2), HitRate(cache, hashes, nFirst / 2, nFirst));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -169,6 +169,50 @@ BOOST_AUTO_TEST_CASE(dbwrapper_iterator)
     }
 }
 
+BOOST_AUTO_TEST_CASE(dbwrapper_snapshot)
+{
+    path ph = temp_directory_path() / unique_path();
+    CDBWrapper dbw(ph, (1 << 20), true, false, true);
+
+    char key = 'j';
+    uint256 in = GetRandHash();
+    BOOST_CHECK(dbw.Write(key, in));
+
+    CDBSnapshot snapshot(dbw);
+
+    // Changes after the snapshot are only visible to reads without it
+    uint256 in2 = GetRandHash();
+    BOOST_CHECK(dbw.Write(key, in2));
+    char key2 = 'k';
+    BOOST_CHECK(dbw.Write(key2, in2));
+
+    uint256 res;
+    BOOST_CHECK(dbw.Read(key, res, &snapshot));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+    BOOST_CHECK(!dbw.Read(key2, res, &snapshot));
+    BOOST_CHECK(dbw.Read(key, res));
+    BOOST_CHECK_EQUAL(res.ToString(), in2.ToString());
+
+    boost::scoped_ptr<CDBIterator> it(dbw.NewIterator(&snapshot));
+    it->Seek(key);
+
+    char key_res;
+    BOOST_CHECK(it->Valid());
+    BOOST_CHECK(it->GetKey(key_res));
+    BOOST_CHECK(it->GetValue(res));
+    BOOST_CHECK_EQUAL(key_res, key);
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+
+    it->Next();
+    BOOST_CHECK_EQUAL(it->Valid(), false);
+
+    // Erasing the key does not affect the snapshot either
+    BOOST_CHECK(dbw.Erase(key));
+    BOOST_CHECK(dbw.Read(key, res, &snapshot));
+    BOOST_CHECK_EQUAL(res.ToString(), in.ToString());
+    BOOST_CHECK(!dbw.Read(key, res));
+}
+
 // Test that we do not obfuscation if there is existing data.
 BOOST_AUTO_TEST_CASE(existing_data_no_obfuscate)
 {
@@ -0,0 +1,123 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "rpc/jsonstream.h"
+#include "test/test_bitcoin.h"
+
+#include <string>
+
+#include <boost/bind.hpp>
+#include <boost/test/unit_test.hpp>
+
+#include <univalue.h>
+
+BOOST_FIXTURE_TEST_SUITE(jsonstream_tests, BasicTestingSetup)
+
+/** Output that refuses data beyond a size limit and counts how often it was called */
+struct TestOutput
+{
+    std::string str;
+    size_t nLimit;
+    int nCalls;
+
+    TestOutput(size_t nLimitIn = (size_t)-1) : nLimit(nLimitIn), nCalls(0) {}
+
+    bool Write(const std::string& data)
+    {
+        nCalls++;
+        if (str.size() + data.size() > nLimit)
+            return false;
+        str.append(data);
+        return true;
+    }
+};
+
+static std::string StreamValue(const UniValue& value)
+{
+    TestOutput output;
+    CJSONStreamWriter writer(boost::bind(&TestOutput::Write, &output, _1));
+    writer.Value(value);
+    BOOST_CHECK(writer.Good());
+    return output.str;
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_matches_write)
+{
+    UniValue values(UniValue::VARR);
+    values.push_back(UniValue(UniValue::VARR));
+    values.push_back(UniValue(UniValue::VOBJ));
+    values.push_back(NullUniValue);
+    values.push_back(true);
+    values.push_back(-42);
+    values.push_back(1.5);
+    values.push_back("quote \" and\nnewline");
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("empty", UniValue(UniValue::VARR)));
+    obj.push_back(Pair("values", values));
+    obj.push_back(Pair("key \"escaped\"", "value"));
+    UniValue nested(UniValue::VOBJ);
+    nested.push_back(Pair("inner", obj));
+    nested.push_back(Pair("n", 1));
+    obj.push_back(Pair("nested", nested));
+
+    UniValue doc(UniValue::VARR);
+    doc.push_back(obj);
+    doc.push_back(values);
+    doc.push_back(obj);
+
+    BOOST_CHECK_EQUAL(StreamValue(doc), doc.write());
+    BOOST_CHECK_EQUAL(StreamValue(obj), obj.write());
+    BOOST_CHECK_EQUAL(StreamValue(UniValue("scalar")), UniValue("scalar").write());
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_containers)
+{
+    // Explicitly opened containers, as producers that hold one element at a time write them
+    UniValue expected(UniValue::VOBJ);
+    UniValue items(UniValue::VARR);
+    for (int i = 0; i < 3; i++) {
+        UniValue item(UniValue::VOBJ);
+        item.push_back(Pair("i", i));
+        items.push_back(item);
+    }
+    expected.push_back(Pair("items", items));
+    expected.push_back(Pair("count", 3));
+
+    TestOutput output;
+    CJSONStreamWriter writer(boost::bind(&TestOutput::Write, &output, _1));
+    writer.BeginObject();
+    writer.Key("items");
+    writer.BeginArray();
+    for (unsigned int i = 0; i < items.size(); i++)
+        writer.Value(items[i]);
+    writer.EndArray();
+    writer.Key("count");
+    writer.Value(3);
+    writer.EndObject();
+    writer.Raw("\n");
+    BOOST_CHECK(writer.Good());
+    BOOST_CHECK_EQUAL(output.str, expected.write() + "\n");
+}
+
+BOOST_AUTO_TEST_CASE(jsonstream_output_refused)
+{
+    UniValue doc(UniValue::VARR);
+    for (int i = 0; i < 1000; i++)
+        doc.push_back(i);
+
+    // Once the output refuses data, nothing more is written to it
+    TestOutput output(100);
+    CJSONStreamWriter writer(boost::bind(&TestOutput::Write, &output, _1));
+    writer.Value(doc);
+    BOOST_CHECK(!writer.Good());
+    BOOST_CHECK(output.str.size() <= 100);
+    BOOST_CHECK_EQUAL(doc.write().compare(0, output.str.size(), output.str), 0);
+    int nCalls = output.nCalls;
+    BOOST_CHECK(nCalls < 1000);
+    writer.Raw("\n");
+    BOOST_CHECK_EQUAL(output.nCalls, nCalls);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -133,4 +133,28 @@ BOOST_AUTO_TEST_CASE(merkle_test)
     }
 }
 
+BOOST_AUTO_TEST_CASE(merkle_tree_levels)
+{
+    BOOST_CHECK(ComputeMerkleTree(std::vector<uint256>()).size() == 1);
+    for (unsigned int nLeaves = 1; nLeaves <= 40; nLeaves++) {
+        std::vector<uint256> leaves(nLeaves);
+        for (unsigned int i = 0; i < nLeaves; i++)
+            leaves[i] = GetRandHash();
+        std::vector<std::vector<uint256> > levels = ComputeMerkleTree(leaves);
+        BOOST_CHECK(levels[0] == leaves);
+        for (unsigned int height = 1; height < levels.size(); height++) {
+            // Each node hashes its two children, or its only child twice
+            const std::vector<uint256>& below = levels[height - 1];
+            BOOST_REQUIRE_EQUAL(levels[height].size(), (below.size() + 1) / 2);
+            for (unsigned int pos = 0; pos < levels[height].size(); pos++) {
+                const uint256& left = below[pos * 2];
+                const uint256& right = below[std::min<size_t>(pos * 2 + 1, below.size() - 1)];
+                BOOST_CHECK(levels[height][pos] == Hash(left.begin(), left.end(), right.begin(), right.end()));
+            }
+        }
+        BOOST_CHECK_EQUAL(levels.back().size(), 1U);
+        BOOST_CHECK(levels.back()[0] == ComputeMerkleRoot(leaves));
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -332,4 +332,57 @@ BOOST_AUTO_TEST_CASE(rpc_convert_values_generatetoaddress)
     BOOST_CHECK_EQUAL(result[2].get_int(), 9);
 }
 
+BOOST_AUTO_TEST_CASE(rpc_batch)
+{
+    SetRPCWarmupFinished();
+    mapArgs["-rpcbatchthreads"] = "4";
+    mapArgs["-rpcbatchconcurrency"] = "3";
+    StartRPC();
+
+    // Thread-safe calls, interrupted by calls that must run alone and an invalid request
+    UniValue batch(UniValue::VARR);
+    for (int i = 0; i < 40; i++) {
+        if (i == 7) {
+            batch.push_back("invalid");
+            continue;
+        }
+        UniValue req(UniValue::VOBJ);
+        UniValue params(UniValue::VARR);
+        if (i % 10 == 5) {
+            req.push_back(Pair("method", "help"));
+            params.push_back("getblockcount");
+        } else {
+            req.push_back(Pair("method", "decodescript"));
+            params.push_back(strprintf("%02x", 0x51 + i % 16));
+        }
+        req.push_back(Pair("params", params));
+        req.push_back(Pair("id", i));
+        batch.push_back(req);
+    }
+
+    UniValue reply;
+    BOOST_CHECK(reply.read(JSONRPCExecBatch(batch)));
+    BOOST_CHECK_EQUAL(reply.size(), 40);
+    for (int i = 0; i < 40; i++) {
+        const UniValue& result = find_value(reply[i], "result");
+        if (i == 7) {
+            BOOST_CHECK(result.isNull());
+            BOOST_CHECK_EQUAL(find_value(find_value(reply[i], "error"), "code").get_int(), RPC_INVALID_REQUEST);
+            continue;
+        }
+        BOOST_CHECK_EQUAL(find_value(reply[i], "id").get_int(), i);
+        BOOST_CHECK(find_value(reply[i], "error").isNull());
+        if (i % 10 == 5) {
+            BOOST_CHECK(result.get_str().find("getblockcount") == 0);
+        } else {
+            BOOST_CHECK_EQUAL(find_value(result, "asm").get_str(), strprintf("%d", 1 + i % 16));
+        }
+    }
+
+    InterruptRPC();
+    StopRPC();
+    mapArgs.erase("-rpcbatchthreads");
+    mapArgs.erase("-rpcbatchconcurrency");
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,86 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "spentindexcache.h"
+#include "random.h"
+#include "test/test_bitcoin.h"
+
+#include <boost/test/unit_test.hpp>
+
+BOOST_FIXTURE_TEST_SUITE(spentindexcache_tests, BasicTestingSetup)
+
+BOOST_AUTO_TEST_CASE(spentindexcache_lookup)
+{
+    CSpentIndexCache cache(1000);
+    CSpentIndexKey key(GetRandHash(), 1);
+    CSpentIndexValue value(GetRandHash(), 0, 100, 5000, 1, uint160());
+    CSpentIndexValue result;
+    uint64_t nGeneration;
+
+    BOOST_CHECK(!cache.Lookup(key, result, nGeneration));
+    cache.Insert(key, value, nGeneration);
+    BOOST_CHECK(cache.Lookup(key, result, nGeneration));
+    BOOST_CHECK(result.txid == value.txid);
+    BOOST_CHECK_EQUAL(result.blockHeight, 100);
+
+    // Unspent outputs are cached as null values
+    CSpentIndexKey key2(key.txid, 2);
+    BOOST_CHECK(!cache.Lookup(key2, result, nGeneration));
+    cache.Insert(key2, CSpentIndexValue(), nGeneration);
+    BOOST_CHECK(cache.Lookup(key2, result, nGeneration));
+    BOOST_CHECK(result.IsNull());
+
+    CSpentIndexCache::Stats stats = cache.GetStats();
+    BOOST_CHECK_EQUAL(stats.nEntries, 2U);
+    BOOST_CHECK_EQUAL(stats.nHits, 2U);
+    BOOST_CHECK_EQUAL(stats.nMisses, 2U);
+
+    cache.Invalidate(key2);
+    BOOST_CHECK(!cache.Lookup(key2, result, nGeneration));
+    BOOST_CHECK(cache.Lookup(key, result, nGeneration));
+}
+
+BOOST_AUTO_TEST_CASE(spentindexcache_stale_insert)
+{
+    CSpentIndexCache cache(1000);
+    CSpentIndexKey key(GetRandHash(), 0);
+    CSpentIndexValue result;
+    uint64_t nGeneration;
+
+    // A value read before the key was written must not be cached after it
+    BOOST_CHECK(!cache.Lookup(key, result, nGeneration));
+    cache.Invalidate(key);
+    cache.Insert(key, CSpentIndexValue(), nGeneration);
+    BOOST_CHECK(!cache.Lookup(key, result, nGeneration));
+}
+
+BOOST_AUTO_TEST_CASE(spentindexcache_eviction)
+{
+    CSpentIndexCache cache(160);
+    uint256 txid = GetRandHash();
+    CSpentIndexValue result;
+    uint64_t nGeneration;
+
+    for (unsigned int i = 0; i < 1000; i++) {
+        CSpentIndexKey key(txid, i);
+        BOOST_CHECK(!cache.Lookup(key, result, nGeneration));
+        cache.Insert(key, CSpentIndexValue(GetRandHash(), i, 1, 1, 1, uint160()), nGeneration);
+        // Keep the first key hot
+        BOOST_CHECK(cache.Lookup(CSpentIndexKey(txid, 0), result, nGeneration));
+    }
+
+    CSpentIndexCache::Stats stats = cache.GetStats();
+    BOOST_CHECK(stats.nEntries <= stats.nMaxEntries);
+    BOOST_CHECK_EQUAL(stats.nMaxEntries, 160U);
+    BOOST_CHECK(cache.Lookup(CSpentIndexKey(txid, 0), result, nGeneration));
+    BOOST_CHECK_EQUAL(result.inputIndex, 0U);
+
+    CSpentIndexCache disabled(0);
+    CSpentIndexKey key(txid, 0);
+    BOOST_CHECK(!disabled.Lookup(key, result, nGeneration));
+    disabled.Insert(key, CSpentIndexValue(), nGeneration);
+    BOOST_CHECK(!disabled.Lookup(key, result, nGeneration));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -2,6 +2,7 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "chainparams.h"
 #include "consensus/validation.h"
 #include "key.h"
 #include "main.h"
@@ -11,6 +12,7 @@
 #include "random.h"
 #include "script/standard.h"
 #include "test/test_bitcoin.h"
+#include "timedata.h"
 #include "utiltime.h"
 
 #include <boost/test/unit_test.hpp>
@@ -83,4 +85,72 @@ BOOST_FIXTURE_TEST_CASE(tx_mempool_block_doublespend, TestChain100Setup)
     BOOST_CHECK_EQUAL(mempool.size(), 0);
 }
 
+BOOST_FIXTURE_TEST_CASE(checkinputs_scriptcache, TestChain100Setup)
+{
+    // Scripts found valid on mempool acceptance are not run again for the
+    // flags of the next block, but are for other flags.
+
+    CScript scriptPubKey = CScript() <<  ToByteVector(coinbaseKey.GetPubKey()) << OP_CHECKSIG;
+
+    CMutableTransaction spend;
+    spend.vin.resize(1);
+    spend.vin[0].prevout.hash = coinbaseTxns[0].GetHash();
+    spend.vin[0].prevout.n = 0;
+    spend.vout.resize(1);
+    spend.vout[0].nValue = 11*CENT;
+    spend.vout[0].scriptPubKey = scriptPubKey;
+
+    std::vector<unsigned char> vchSig;
+    uint256 hash = SignatureHash(scriptPubKey, spend, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    spend.vin[0].scriptSig << vchSig;
+    // The checks handed out point into the transaction
+    const CTransaction tx(spend);
+
+    LOCK(cs_main);
+    unsigned int flags = GetBlockScriptFlags(ComputeBlockVersion(chainActive.Tip(), Params().GetConsensus()), GetAdjustedTime(), chainActive.Tip(), Params().GetConsensus());
+    CCoinsViewCache coins(pcoinsTip);
+    CValidationState state;
+    std::vector<CScriptCheck> vChecks;
+
+    // Unknown transaction: the script is handed out to be checked
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, flags, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+    BOOST_CHECK(vChecks[0]());
+
+    BOOST_CHECK(ToMemPool(spend));
+
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, flags, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 0U);
+
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(tx, state, coins, true, flags | SCRIPT_VERIFY_LOW_S, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // A different witness makes it a different transaction
+    CMutableTransaction malleated(spend);
+    malleated.wit.vtxinwit.resize(1);
+    malleated.wit.vtxinwit[0].scriptWitness.stack.push_back(std::vector<unsigned char>(1, 1));
+    const CTransaction txMalleated(malleated);
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txMalleated, state, coins, true, flags, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 1U);
+
+    // Checked inline and stored
+    CMutableTransaction other(spend);
+    other.nLockTime = 1;
+    hash = SignatureHash(scriptPubKey, other, 0, SIGHASH_ALL, 0, SIGVERSION_BASE);
+    vchSig.clear();
+    BOOST_CHECK(coinbaseKey.Sign(hash, vchSig));
+    vchSig.push_back((unsigned char)SIGHASH_ALL);
+    other.vin[0].scriptSig = CScript() << vchSig;
+    const CTransaction txOther(other);
+    BOOST_CHECK(CheckInputs(txOther, state, coins, true, flags, false, true));
+    vChecks.clear();
+    BOOST_CHECK(CheckInputs(txOther, state, coins, true, flags, false, false, &vChecks));
+    BOOST_CHECK_EQUAL(vChecks.size(), 0U);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
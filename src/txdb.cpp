@@ -12,6 +12,10 @@
 
 #include <stdint.h>
 
+#include <algorithm>
+#include <limits>
+#include <set>
+
 #include <boost/thread.hpp>
 
 using namespace std;
@@ -19,8 +23,11 @@ using namespace std;
 static const char DB_COINS = 'c';
 static const char DB_BLOCK_FILES = 'f';
 static const char DB_TXINDEX = 't';
-static const char DB_ADDRESSINDEX = 'a';
+static const char DB_ADDRESSINDEX = 'A';
+static const char DB_ADDRESSINDEXTX = 'h';
+static const char DB_ADDRESSINDEX_LEGACY = 'a';
 static const char DB_ADDRESSUNSPENTINDEX = 'u';
+static const char DB_ADDRESSSUMMARYINDEX = 'm';
 static const char DB_TIMESTAMPINDEX = 's';
 static const char DB_BLOCKHASHINDEX = 'z';
 static const char DB_SPENTINDEX = 'p';
@@ -157,19 +164,14 @@ bool CBlockTreeDB::ReadTxIndex(const uint256 &txid, CDiskTxPos &pos) {
     return Read(make_pair(DB_TXINDEX, txid), pos);
 }
 
-bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
-    CDBBatch batch(*this);
+namespace {
+
+void BatchWriteTxIndex(CDBBatch &batch, const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
     for (std::vector<std::pair<uint256,CDiskTxPos> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
         batch.Write(make_pair(DB_TXINDEX, it->first), it->second);
-    return WriteBatch(batch);
-}
-
-bool CBlockTreeDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
-    return Read(make_pair(DB_SPENTINDEX, key), value);
 }
 
-bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
-    CDBBatch batch(*this);
+void BatchUpdateSpentIndex(CDBBatch &batch, const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
     for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_SPENTINDEX, it->first));
@@ -177,11 +179,9 @@ bool CBlockTreeDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey,
             batch.Write(make_pair(DB_SPENTINDEX, it->first), it->second);
         }
     }
-    return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
-    CDBBatch batch(*this);
+void BatchUpdateAddressUnspentIndex(CDBBatch &batch, const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
     for (std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
         if (it->second.IsNull()) {
             batch.Erase(make_pair(DB_ADDRESSUNSPENTINDEX, it->first));
@@ -189,13 +189,177 @@ bool CBlockTreeDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddres
             batch.Write(make_pair(DB_ADDRESSUNSPENTINDEX, it->first), it->second);
         }
     }
+}
+
+void BatchWriteAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    CAddressIndexTxKey lastTx(-1, 0);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        batch.Write(make_pair(DB_ADDRESSINDEX, CCompactAddressIndexKey(it->first)), it->second);
+        // The rows of a transaction are adjacent, write its hash once
+        CAddressIndexTxKey tx(it->first.blockHeight, it->first.txindex);
+        if (tx != lastTx) {
+            batch.Write(make_pair(DB_ADDRESSINDEXTX, tx), it->first.txhash);
+            lastTx = tx;
+        }
+    }
+}
+
+void BatchEraseAddressIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+    CAddressIndexTxKey lastTx(-1, 0);
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        batch.Erase(make_pair(DB_ADDRESSINDEX, CCompactAddressIndexKey(it->first)));
+        CAddressIndexTxKey tx(it->first.blockHeight, it->first.txindex);
+        if (tx != lastTx) {
+            batch.Erase(make_pair(DB_ADDRESSINDEXTX, tx));
+            lastTx = tx;
+        }
+    }
+}
+
+void BatchWriteTimestampIndex(CDBBatch &batch, const CTimestampIndexKey &timestampIndex) {
+    batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
+    batch.Write(make_pair(DB_BLOCKHASHINDEX, CTimestampBlockIndexKey(timestampIndex.blockHash)), CTimestampBlockIndexValue(timestampIndex.timestamp));
+}
+
+}
+
+bool CBlockTreeDB::WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> >&vect) {
+    CDBBatch batch(*this);
+    BatchWriteTxIndex(batch, vect);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                           std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs) {
+bool CIndexDB::WriteBlockIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                 const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                                 const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+                                 const CTimestampIndexKey *ptimestampIndex) {
+    CDBBatch batch(*this);
+    BatchWriteAddressIndex(batch, addressIndex);
+    UpdateAddressSummaryIndex(batch, addressIndex, false);
+    BatchUpdateAddressUnspentIndex(batch, addressUnspentIndex);
+    BatchUpdateSpentIndex(batch, spentIndex);
+    if (ptimestampIndex)
+        BatchWriteTimestampIndex(batch, *ptimestampIndex);
+    if (!WriteBatch(batch))
+        return false;
+    InvalidateSpentIndexCache(spentIndex);
+    return true;
+}
+
+bool CIndexDB::EraseBlockIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                 const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                                 const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex) {
+    CDBBatch batch(*this);
+    BatchEraseAddressIndex(batch, addressIndex);
+    UpdateAddressSummaryIndex(batch, addressIndex, true);
+    BatchUpdateAddressUnspentIndex(batch, addressUnspentIndex);
+    BatchUpdateSpentIndex(batch, spentIndex);
+    if (!WriteBatch(batch))
+        return false;
+    InvalidateSpentIndexCache(spentIndex);
+    return true;
+}
+
+void CIndexDB::InvalidateSpentIndexCache(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect) {
+    for (std::vector<std::pair<CSpentIndexKey,CSpentIndexValue> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
+        spentCache.Invalidate(it->first);
+}
+
+bool CIndexDB::ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value) {
+    uint64_t nGeneration;
+    if (spentCache.Lookup(key, value, nGeneration))
+        return !value.IsNull();
+
+    // Unspent outputs are cached too, as a null value
+    if (!Read(make_pair(DB_SPENTINDEX, key), value))
+        value.SetNull();
+    spentCache.Insert(key, value, nGeneration);
+    return !value.IsNull();
+}
+
+namespace {
+
+struct SpentIndexKeyPositionCompare
+{
+    const std::vector<CSpentIndexKey> &keys;
+    SpentIndexKeyPositionCompare(const std::vector<CSpentIndexKey> &keysIn) : keys(keysIn) {}
+
+    bool operator()(size_t a, size_t b) const {
+        return CSpentIndexKeyCompare()(keys[a], keys[b]);
+    }
+};
+
+}
+
+bool CIndexDB::ReadSpentIndexes(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values) {
+    values.assign(keys.size(), CSpentIndexValue());
 
+    std::vector<size_t> vMissing;
+    std::vector<uint64_t> vGeneration(keys.size(), 0);
+    for (size_t i = 0; i < keys.size(); i++) {
+        if (!spentCache.Lookup(keys[i], values[i], vGeneration[i]))
+            vMissing.push_back(i);
+    }
+    if (vMissing.empty())
+        return true;
+
+    // Visit the keys in order on a single iterator: outputs of one transaction are
+    // adjacent on disk, so most of them are reached by stepping instead of seeking.
+    std::sort(vMissing.begin(), vMissing.end(), SpentIndexKeyPositionCompare(keys));
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    std::pair<char, CSpentIndexKey> key;
+    bool fHaveKey = false;
+    for (std::vector<size_t>::const_iterator it = vMissing.begin(); it != vMissing.end(); it++) {
+        boost::this_thread::interruption_point();
+        const CSpentIndexKey &target = keys[*it];
+        bool fMatch = fHaveKey && key.second.txid == target.txid && key.second.outputIndex == target.outputIndex;
+        if (!fMatch) {
+            pcursor->Seek(make_pair(DB_SPENTINDEX, target));
+            fHaveKey = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_SPENTINDEX;
+            fMatch = fHaveKey && key.second.txid == target.txid && key.second.outputIndex == target.outputIndex;
+        }
+        if (fMatch) {
+            if (!pcursor->GetValue(values[*it]))
+                return error("failed to get spent index value");
+            pcursor->Next();
+            fHaveKey = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_SPENTINDEX;
+        }
+        spentCache.Insert(target, values[*it], vGeneration[*it]);
+    }
+
+    return true;
+}
+
+CSpentIndexCache::Stats CIndexDB::GetSpentIndexCacheStats() const {
+    return spentCache.GetStats();
+}
+
+bool CIndexDB::UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect) {
+    CDBBatch batch(*this);
+    BatchUpdateSpentIndex(batch, vect);
+    if (!WriteBatch(batch))
+        return false;
+    InvalidateSpentIndexCache(vect);
+    return true;
+}
+
+bool CIndexDB::UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect) {
+    CDBBatch batch(*this);
+    BatchUpdateAddressUnspentIndex(batch, vect);
+    return WriteBatch(batch);
+}
+
+bool CIndexDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
+                                       std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &unspentOutputs,
+                                       const CAddressUnspentFilter &filter,
+                                       const CDBSnapshot *psnapshot) {
+
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator(psnapshot));
+
+    // With a limit, the outputs of this address are kept as a max-heap by height at the end of
+    // the vector, so only the lowest nLimit outputs are ever held in memory
+    const size_t nStart = unspentOutputs.size();
+    CAddressUnspentHeightCompare comp;
 
     pcursor->Seek(make_pair(DB_ADDRESSUNSPENTINDEX, CAddressIndexIteratorKey(type, addressHash)));
 
@@ -205,7 +369,16 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
         if (pcursor->GetKey(key) && key.first == DB_ADDRESSUNSPENTINDEX && key.second.hashBytes == addressHash) {
             CAddressUnspentValue nValue;
             if (pcursor->GetValue(nValue)) {
-                unspentOutputs.push_back(make_pair(key.second, nValue));
+                if (filter.Match(nValue)) {
+                    unspentOutputs.push_back(make_pair(key.second, nValue));
+                    if (filter.nLimit > 0) {
+                        std::push_heap(unspentOutputs.begin() + nStart, unspentOutputs.end(), comp);
+                        if (unspentOutputs.size() - nStart > filter.nLimit) {
+                            std::pop_heap(unspentOutputs.begin() + nStart, unspentOutputs.end(), comp);
+                            unspentOutputs.pop_back();
+                        }
+                    }
+                }
                 pcursor->Next();
             } else {
                 return error("failed to get address unspent value");
@@ -215,64 +388,358 @@ bool CBlockTreeDB::ReadAddressUnspentIndex(uint160 addressHash, int type,
         }
     }
 
+    if (filter.nLimit > 0)
+        std::sort_heap(unspentOutputs.begin() + nStart, unspentOutputs.end(), comp);
+
     return true;
 }
 
-bool CBlockTreeDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CIndexDB::WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Write(make_pair(DB_ADDRESSINDEX, it->first), it->second);
+    BatchWriteAddressIndex(batch, vect);
+    UpdateAddressSummaryIndex(batch, vect, false);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
+bool CIndexDB::EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount > >&vect) {
     CDBBatch batch(*this);
-    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++)
-        batch.Erase(make_pair(DB_ADDRESSINDEX, it->first));
+    BatchEraseAddressIndex(batch, vect);
+    UpdateAddressSummaryIndex(batch, vect, true);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadAddressIndex(uint160 addressHash, int type,
-                                    std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                                    int start, int end) {
+namespace {
 
-    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+/** Aggregated address index activity of one address within a single block */
+struct CAddressSummaryDelta {
+    CAmount balance;
+    CAmount received;
+    std::set<uint256> txids;
+    int height;
 
-    if (start > 0 && end > 0) {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
-    } else {
-        pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    CAddressSummaryDelta() : balance(0), received(0), height(0) {}
+};
+
+}
+
+void CIndexDB::UpdateAddressSummaryIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase) {
+    std::map<std::pair<unsigned int, uint160>, CAddressSummaryDelta> deltas;
+    for (std::vector<std::pair<CAddressIndexKey, CAmount> >::const_iterator it=vect.begin(); it!=vect.end(); it++) {
+        CAddressSummaryDelta &delta = deltas[std::make_pair(it->first.type, it->first.hashBytes)];
+        if (it->second > 0)
+            delta.received += it->second;
+        delta.balance += it->second;
+        delta.txids.insert(it->first.txhash);
+        delta.height = it->first.blockHeight;
     }
 
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        std::pair<char,CAddressIndexKey> key;
-        if (pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX && key.second.hashBytes == addressHash) {
-            if (end > 0 && key.second.blockHeight > end) {
-                break;
+    for (std::map<std::pair<unsigned int, uint160>, CAddressSummaryDelta>::const_iterator it=deltas.begin(); it!=deltas.end(); it++) {
+        const CAddressIndexIteratorKey summaryKey(it->first.first, it->first.second);
+        const CAddressSummaryDelta &delta = it->second;
+        CAddressSummaryValue summary;
+        if (!Read(make_pair(DB_ADDRESSSUMMARYINDEX, summaryKey), summary))
+            summary.SetNull();
+
+        if (!fErase) {
+            // Blocks are connected in height order, so a summary that already covers
+            // this height means the block is being replayed (e.g. after an unclean
+            // shutdown or with -reindex-chainstate) and must not be counted twice.
+            if (!summary.IsNull() && summary.lastHeight >= delta.height)
+                continue;
+            if (summary.IsNull())
+                summary.firstHeight = delta.height;
+            summary.balance += delta.balance;
+            summary.received += delta.received;
+            summary.txCount += delta.txids.size();
+            summary.lastHeight = delta.height;
+            batch.Write(make_pair(DB_ADDRESSSUMMARYINDEX, summaryKey), summary);
+        } else {
+            // Only the tip block can be disconnected; anything else was already undone.
+            if (summary.IsNull() || summary.lastHeight != delta.height)
+                continue;
+            summary.balance -= delta.balance;
+            summary.received -= delta.received;
+            summary.txCount -= delta.txids.size();
+            if (summary.txCount <= 0) {
+                batch.Erase(make_pair(DB_ADDRESSSUMMARYINDEX, summaryKey));
+                continue;
             }
-            CAmount nValue;
-            if (pcursor->GetValue(nValue)) {
-                addressIndex.push_back(make_pair(key.second, nValue));
-                pcursor->Next();
+
+            // Find the height of the last activity before the disconnected block
+            boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+            pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(summaryKey.type, summaryKey.hashBytes, delta.height)));
+            if (pcursor->Valid()) {
+                pcursor->Prev();
             } else {
-                return error("failed to get address index value");
+                pcursor->SeekToLast();
             }
-        } else {
+            std::pair<char, CCompactAddressIndexKey> key;
+            if (pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX &&
+                key.second.type == summaryKey.type && key.second.hashBytes == summaryKey.hashBytes) {
+                summary.lastHeight = key.second.blockHeight;
+            } else {
+                summary.lastHeight = summary.firstHeight;
+            }
+            batch.Write(make_pair(DB_ADDRESSSUMMARYINDEX, summaryKey), summary);
+        }
+    }
+}
+
+bool CIndexDB::ReadAddressSummaryIndex(uint160 addressHash, int type, CAddressSummaryValue &summary,
+                                       const CDBSnapshot *psnapshot) {
+    if (!Read(make_pair(DB_ADDRESSSUMMARYINDEX, CAddressIndexIteratorKey(type, addressHash)), summary, psnapshot))
+        summary.SetNull();
+    return true;
+}
+
+bool CIndexDB::BuildAddressSummaryIndex() {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+
+    pcursor->Seek(DB_ADDRESSINDEX);
+
+    CDBBatch batch(*this);
+    unsigned int nBatchAddresses = 0;
+    bool fHaveCurrent = false;
+    CAddressIndexIteratorKey current;
+    CAddressSummaryValue summary;
+    std::pair<int, unsigned int> lastTx;
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char,CCompactAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX;
+
+        if (fHaveCurrent && (!fValid || key.second.type != current.type || key.second.hashBytes != current.hashBytes)) {
+            batch.Write(make_pair(DB_ADDRESSSUMMARYINDEX, current), summary);
+            if (++nBatchAddresses >= 10000) {
+                WriteBatch(batch);
+                batch.Clear();
+                nBatchAddresses = 0;
+            }
+            fHaveCurrent = false;
+        }
+
+        if (!fValid)
             break;
+
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+
+        if (!fHaveCurrent) {
+            current = CAddressIndexIteratorKey(key.second.type, key.second.hashBytes);
+            summary = CAddressSummaryValue(0, 0, 0, key.second.blockHeight, key.second.blockHeight);
+            lastTx = std::make_pair(-1, 0);
+            fHaveCurrent = true;
         }
+
+        // Rows of one transaction are adjacent as keys are ordered by height and position in block
+        std::pair<int, unsigned int> tx(key.second.blockHeight, key.second.txindex);
+        if (tx != lastTx) {
+            summary.txCount++;
+            lastTx = tx;
+        }
+        if (nValue > 0)
+            summary.received += nValue;
+        summary.balance += nValue;
+        summary.lastHeight = key.second.blockHeight;
+
+        pcursor->Next();
+    }
+
+    return WriteBatch(batch);
+}
+
+bool CIndexDB::ReadAddressIndex(uint160 addressHash, int type,
+                                std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                                int start, int end, const CDBSnapshot *psnapshot) {
+
+    boost::scoped_ptr<CAddressIndexCursor> pcursor(AddressIndexCursor(addressHash, type, start, end, NULL, psnapshot));
+
+    for (; pcursor->Valid(); pcursor->Next()) {
+        CAmount nValue;
+        if (!pcursor->GetValue(nValue))
+            return error("failed to get address index value");
+        addressIndex.push_back(make_pair(pcursor->GetKey(), nValue));
     }
 
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
+CAddressIndexCursor *CIndexDB::AddressIndexCursor(uint160 addressHash, int type, int start, int end,
+                                                  const CAddressIndexKey *pafter, const CDBSnapshot *psnapshot) {
+    CAddressIndexCursor *i = new CAddressIndexCursor(*this, psnapshot, addressHash, type, end);
+
+    if (pafter) {
+        i->pcursor->Seek(make_pair(DB_ADDRESSINDEX, CCompactAddressIndexKey(*pafter)));
+    } else if (start > 0 && end > 0) {
+        i->pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorHeightKey(type, addressHash, start)));
+    } else {
+        i->pcursor->Seek(make_pair(DB_ADDRESSINDEX, CAddressIndexIteratorKey(type, addressHash)));
+    }
+    i->ReadKey();
+
+    // Resume strictly after the given key
+    if (pafter && i->fValid) {
+        const CCompactAddressIndexKey &key = i->keyTmp.second;
+        if (key.blockHeight == pafter->blockHeight && key.txindex == pafter->txindex &&
+            key.index == pafter->index && key.spending == pafter->spending) {
+            i->Next();
+        }
+    }
+
+    return i;
+}
+
+CAddressIndexCursor::CAddressIndexCursor(const CDBWrapper &dbIn, const CDBSnapshot *psnapshotIn, const uint160 &addressHashIn, int typeIn, int endIn) :
+    db(dbIn), pownsnapshot(psnapshotIn ? NULL : new CDBSnapshot(dbIn)), psnapshot(psnapshotIn ? psnapshotIn : pownsnapshot.get()),
+    pcursor(dbIn.NewIterator(psnapshot)), addressHash(addressHashIn), type(typeIn), end(endIn), fValid(false), txKey(-1, 0)
+{
+}
+
+void CAddressIndexCursor::ReadKey()
+{
+    fValid = pcursor->Valid() && pcursor->GetKey(keyTmp) && keyTmp.first == DB_ADDRESSINDEX &&
+        keyTmp.second.type == (unsigned int)type && keyTmp.second.hashBytes == addressHash &&
+        !(end > 0 && keyTmp.second.blockHeight > end);
+    if (!fValid)
+        return;
+
+    // Consecutive rows usually belong to the same transaction, only look up the hash when it changes
+    CAddressIndexTxKey tx(keyTmp.second.blockHeight, keyTmp.second.txindex);
+    if (tx != txKey) {
+        if (!db.Read(make_pair(DB_ADDRESSINDEXTX, tx), txhash, psnapshot)) {
+            fValid = false;
+            error("%s: missing txid of address index row at height %d position %u", __func__, tx.blockHeight, tx.txindex);
+            return;
+        }
+        txKey = tx;
+    }
+    key = keyTmp.second.ToKey(txhash);
+}
+
+const CAddressIndexKey &CAddressIndexCursor::GetKey() const
+{
+    return key;
+}
+
+bool CAddressIndexCursor::GetValue(CAmount &value) const
+{
+    return pcursor->GetValue(value);
+}
+
+bool CAddressIndexCursor::Valid() const
+{
+    return fValid;
+}
+
+void CAddressIndexCursor::Next()
+{
+    boost::this_thread::interruption_point();
+    pcursor->Next();
+    ReadKey();
+}
+
+namespace {
+
+/** Order of address index rows in a CAddressIndexMergeCursor, ignoring the fields that are ordered within a single address */
+bool AddressIndexMergeLess(const CAddressIndexKey &a, const CAddressIndexKey &b)
+{
+    if (a.blockHeight != b.blockHeight)
+        return a.blockHeight < b.blockHeight;
+    if (a.txindex != b.txindex)
+        return a.txindex < b.txindex;
+    if (a.type != b.type)
+        return a.type < b.type;
+    return a.hashBytes < b.hashBytes;
+}
+
+struct AddressIndexCursorGreater
+{
+    bool operator()(const CAddressIndexCursor *a, const CAddressIndexCursor *b) const {
+        return AddressIndexMergeLess(b->GetKey(), a->GetKey());
+    }
+};
+
+}
+
+CAddressIndexMergeCursor *CIndexDB::AddressIndexMergeCursor(const std::vector<std::pair<uint160, int> > &addresses, int start, int end,
+                                                            const CAddressIndexKey *pafter, const CDBSnapshot *psnapshot) {
+    CAddressIndexMergeCursor *i = new CAddressIndexMergeCursor();
+    if (!psnapshot) {
+        i->pownsnapshot.reset(new CDBSnapshot(*this));
+        psnapshot = i->pownsnapshot.get();
+    }
+
+    std::set<std::pair<uint160, int> > seen;
+    for (std::vector<std::pair<uint160, int> >::const_iterator it = addresses.begin(); it != addresses.end(); it++) {
+        if (!seen.insert(*it).second)
+            continue;
+
+        CAddressIndexCursor *pcursor;
+        if (!pafter) {
+            pcursor = AddressIndexCursor(it->first, it->second, start, end, NULL, psnapshot);
+        } else if (it->first == pafter->hashBytes && it->second == (int)pafter->type) {
+            pcursor = AddressIndexCursor(it->first, it->second, start, end, pafter, psnapshot);
+        } else {
+            // Rows of the other addresses resume at the height of the key, after the rows merged before it
+            pcursor = AddressIndexCursor(it->first, it->second, pafter->blockHeight, end > 0 ? end : std::numeric_limits<int>::max(), NULL, psnapshot);
+            while (pcursor->Valid() && AddressIndexMergeLess(pcursor->GetKey(), *pafter))
+                pcursor->Next();
+        }
+        i->Add(pcursor);
+    }
+
+    return i;
+}
+
+CAddressIndexMergeCursor::~CAddressIndexMergeCursor()
+{
+    for (std::vector<CAddressIndexCursor*>::iterator it = heap.begin(); it != heap.end(); it++)
+        delete *it;
+}
+
+void CAddressIndexMergeCursor::Add(CAddressIndexCursor *pcursor)
+{
+    if (!pcursor->Valid()) {
+        delete pcursor;
+        return;
+    }
+    heap.push_back(pcursor);
+    std::push_heap(heap.begin(), heap.end(), AddressIndexCursorGreater());
+}
+
+const CAddressIndexKey &CAddressIndexMergeCursor::GetKey() const
+{
+    return heap.front()->GetKey();
+}
+
+bool CAddressIndexMergeCursor::GetValue(CAmount &value) const
+{
+    return heap.front()->GetValue(value);
+}
+
+bool CAddressIndexMergeCursor::Valid() const
+{
+    return !heap.empty();
+}
+
+void CAddressIndexMergeCursor::Next()
+{
+    std::pop_heap(heap.begin(), heap.end(), AddressIndexCursorGreater());
+    CAddressIndexCursor *pcursor = heap.back();
+    heap.pop_back();
+    pcursor->Next();
+    Add(pcursor);
+}
+
+bool CIndexDB::WriteTimestampIndex(const CTimestampIndexKey &timestampIndex) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_TIMESTAMPINDEX, timestampIndex), 0);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
+bool CIndexDB::ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &hashes) {
 
     boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
 
@@ -299,13 +766,13 @@ bool CBlockTreeDB::ReadTimestampIndex(const unsigned int &high, const unsigned i
     return true;
 }
 
-bool CBlockTreeDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
+bool CIndexDB::WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts) {
     CDBBatch batch(*this);
     batch.Write(make_pair(DB_BLOCKHASHINDEX, blockhashIndex), logicalts);
     return WriteBatch(batch);
 }
 
-bool CBlockTreeDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
+bool CIndexDB::ReadTimestampBlockIndex(const uint256 &hash, unsigned int &ltimestamp) {
 
     CTimestampBlockIndexValue(lts);
     if (!Read(std::make_pair(DB_BLOCKHASHINDEX, hash), lts))
@@ -369,3 +836,135 @@ bool CBlockTreeDB::LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256
 
     return true;
 }
+
+CIndexDB::CIndexDB(size_t nCacheSize, bool fMemory, bool fWipe, int maxOpenFiles, int bloomBits, size_t nWriteBufferSize, size_t nSpentCacheEntries) :
+    CDBWrapper(GetDataDir() / "indexes", nCacheSize, fMemory, fWipe, false, true, maxOpenFiles, bloomBits, nWriteBufferSize),
+    spentCache(nSpentCacheEntries) {
+}
+
+bool CIndexDB::WriteFlag(const std::string &name, bool fValue) {
+    return Write(std::make_pair(DB_FLAG, name), fValue ? '1' : '0');
+}
+
+bool CIndexDB::ReadFlag(const std::string &name, bool &fValue) {
+    char ch;
+    if (!Read(std::make_pair(DB_FLAG, name), ch))
+        return false;
+    fValue = ch == '1';
+    return true;
+}
+
+namespace {
+
+/**
+ * Move all rows with the given key prefix from one database to another. Rows are
+ * written to the destination before they are erased from the source, so an
+ * interrupted move is simply resumed on the next start.
+ */
+template<typename K, typename V>
+bool MoveIndexRows(CDBWrapper &from, CDBWrapper &to, char prefix, uint64_t &nMoved)
+{
+    boost::scoped_ptr<CDBIterator> pcursor(from.NewIterator());
+    pcursor->Seek(prefix);
+
+    CDBBatch batchWrite(to);
+    CDBBatch batchErase(from);
+    unsigned int nBatch = 0;
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, K> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == prefix;
+        if (fValid) {
+            V value;
+            if (!pcursor->GetValue(value))
+                return error("%s: failed to read index value", __func__);
+            batchWrite.Write(key, value);
+            batchErase.Erase(key);
+            nBatch++;
+            nMoved++;
+            pcursor->Next();
+        }
+        if (nBatch >= 10000 || (!fValid && nBatch > 0)) {
+            if (!to.WriteBatch(batchWrite, true) || !from.WriteBatch(batchErase))
+                return error("%s: failed to move index rows", __func__);
+            batchWrite.Clear();
+            batchErase.Clear();
+            nBatch = 0;
+        }
+        if (!fValid)
+            break;
+    }
+
+    return true;
+}
+
+}
+
+bool CIndexDB::MigrateFromBlockTree(CBlockTreeDB &blocktree) {
+    uint64_t nMoved = 0;
+    if (!MoveIndexRows<CAddressIndexKey, CAmount>(blocktree, *this, DB_ADDRESSINDEX_LEGACY, nMoved) ||
+        !MoveIndexRows<CAddressUnspentKey, CAddressUnspentValue>(blocktree, *this, DB_ADDRESSUNSPENTINDEX, nMoved) ||
+        !MoveIndexRows<CAddressIndexIteratorKey, CAddressSummaryValue>(blocktree, *this, DB_ADDRESSSUMMARYINDEX, nMoved) ||
+        !MoveIndexRows<CSpentIndexKey, CSpentIndexValue>(blocktree, *this, DB_SPENTINDEX, nMoved) ||
+        !MoveIndexRows<CTimestampIndexKey, int>(blocktree, *this, DB_TIMESTAMPINDEX, nMoved) ||
+        !MoveIndexRows<CTimestampBlockIndexKey, CTimestampBlockIndexValue>(blocktree, *this, DB_BLOCKHASHINDEX, nMoved))
+        return false;
+
+    bool fSummary = false;
+    if (blocktree.ReadFlag("addresssummaryindex", fSummary)) {
+        if (!WriteFlag("addresssummaryindex", fSummary))
+            return false;
+        if (!blocktree.Erase(std::make_pair(DB_FLAG, std::string("addresssummaryindex"))))
+            return false;
+    }
+
+    if (nMoved > 0)
+        LogPrintf("Moved %u index entries from the block tree database to the index database\n", nMoved);
+    return true;
+}
+
+bool CIndexDB::UpgradeAddressIndex() {
+    boost::scoped_ptr<CDBIterator> pcursor(NewIterator());
+    pcursor->Seek(DB_ADDRESSINDEX_LEGACY);
+
+    CDBBatch batch(*this);
+    unsigned int nBatch = 0;
+    uint64_t nConverted = 0;
+    CAddressIndexTxKey lastTx(-1, 0);
+
+    while (true) {
+        boost::this_thread::interruption_point();
+        std::pair<char, CAddressIndexKey> key;
+        bool fValid = pcursor->Valid() && pcursor->GetKey(key) && key.first == DB_ADDRESSINDEX_LEGACY;
+        if (fValid) {
+            CAmount nValue;
+            if (!pcursor->GetValue(nValue))
+                return error("%s: failed to read address index value", __func__);
+            // Each legacy row is erased in the same batch that writes its compact form, so an
+            // interrupted upgrade is simply resumed on the next start
+            batch.Write(make_pair(DB_ADDRESSINDEX, CCompactAddressIndexKey(key.second)), nValue);
+            CAddressIndexTxKey tx(key.second.blockHeight, key.second.txindex);
+            if (tx != lastTx) {
+                batch.Write(make_pair(DB_ADDRESSINDEXTX, tx), key.second.txhash);
+                lastTx = tx;
+            }
+            batch.Erase(key);
+            nBatch++;
+            nConverted++;
+            pcursor->Next();
+        }
+        if (nBatch >= 10000 || (!fValid && nBatch > 0)) {
+            if (!WriteBatch(batch, true))
+                return error("%s: failed to write compact address index", __func__);
+            batch.Clear();
+            nBatch = 0;
+        }
+        if (!fValid)
+            break;
+    }
+
+    if (nConverted > 0)
+        LogPrintf("Converted %u address index entries to the compact key format\n", nConverted);
+    return true;
+}
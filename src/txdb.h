@@ -12,6 +12,7 @@
 #include "chain.h"
 #include "addressindex.h"
 #include "spentindex.h"
+#include "spentindexcache.h"
 #include "timestampindex.h"
 
 #include <map>
@@ -39,6 +40,8 @@ static const int64_t nMaxBlockDBCache = 2;
 static const int64_t nMaxBlockDBAndTxIndexCache = 1024;
 //! Max memory allocated to coin DB specific cache (MiB)
 static const int64_t nMaxCoinsDBCache = 8;
+//! Share of -dbcache given to the index database by default, if any of the address, spent or timestamp indexes is enabled (1/8ths)
+static const int64_t nDefaultIndexDBCacheShare = 5;
 
 struct CDiskTxPos : public CDiskBlockPos
 {
@@ -102,6 +105,69 @@ private:
     friend class CCoinsViewDB;
 };
 
+/** Lazily iterates over the address index rows of a single address, in key order */
+class CAddressIndexCursor
+{
+public:
+    ~CAddressIndexCursor() {}
+
+    const CAddressIndexKey &GetKey() const;
+    bool GetValue(CAmount &value) const;
+
+    bool Valid() const;
+    void Next();
+
+private:
+    CAddressIndexCursor(const CDBWrapper &dbIn, const CDBSnapshot *psnapshotIn, const uint160 &addressHashIn, int typeIn, int endIn);
+    void ReadKey();
+
+    const CDBWrapper &db;
+    //! Snapshot taken by the cursor itself when it was not given one
+    boost::scoped_ptr<CDBSnapshot> pownsnapshot;
+    //! Snapshot the rows and their txids are read from, so a txid always matches its row
+    const CDBSnapshot *psnapshot;
+    boost::scoped_ptr<CDBIterator> pcursor;
+    uint160 addressHash;
+    int type;
+    int end;
+    bool fValid;
+    std::pair<char, CCompactAddressIndexKey> keyTmp;
+    //! Transaction of the current row and its hash
+    CAddressIndexTxKey txKey;
+    uint256 txhash;
+    CAddressIndexKey key;
+
+    friend class CIndexDB;
+};
+
+/**
+ * Merges the address index rows of several addresses into one stream ordered by
+ * (height, position in block, address), so the rows of a transaction touching
+ * several of the addresses are adjacent.
+ */
+class CAddressIndexMergeCursor
+{
+public:
+    ~CAddressIndexMergeCursor();
+
+    const CAddressIndexKey &GetKey() const;
+    bool GetValue(CAmount &value) const;
+
+    bool Valid() const;
+    void Next();
+
+private:
+    CAddressIndexMergeCursor() {}
+    void Add(CAddressIndexCursor *pcursor);
+
+    //! Snapshot taken by the merge cursor itself when it was not given one, shared by all cursors
+    boost::scoped_ptr<CDBSnapshot> pownsnapshot;
+    //! Min-heap of the cursors that still have rows
+    std::vector<CAddressIndexCursor*> heap;
+
+    friend class CIndexDB;
+};
+
 /** Access to the block database (blocks/index/) */
 class CBlockTreeDB : public CDBWrapper
 {
@@ -118,23 +184,75 @@ public:
     bool ReadReindexing(bool &fReindex);
     bool ReadTxIndex(const uint256 &txid, CDiskTxPos &pos);
     bool WriteTxIndex(const std::vector<std::pair<uint256, CDiskTxPos> > &list);
+    bool WriteFlag(const std::string &name, bool fValue);
+    bool ReadFlag(const std::string &name, bool &fValue);
+    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+};
+
+/**
+ * Access to the address, spent and timestamp index database (indexes/). These
+ * indexes are kept apart from the block tree so that their write-heavy, range
+ * scanned workload can be tuned and compacted independently.
+ */
+class CIndexDB : public CDBWrapper
+{
+public:
+    CIndexDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false, int maxOpenFiles = DEFAULT_INDEXDB_MAX_OPEN_FILES,
+             int bloomBits = DEFAULT_INDEXDB_BLOOM_BITS, size_t nWriteBufferSize = 0,
+             size_t nSpentCacheEntries = DEFAULT_SPENTINDEX_CACHE_SIZE);
+private:
+    CIndexDB(const CIndexDB&);
+    void operator=(const CIndexDB&);
+
+    //! Cache of ReadSpentIndex results, invalidated whenever spent index rows are written
+    CSpentIndexCache spentCache;
+public:
+    //! Write all index rows of a connected block in one atomic batch
+    bool WriteBlockIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                           const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                           const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex,
+                           const CTimestampIndexKey *ptimestampIndex);
+    //! Revert all index rows of a disconnected block in one atomic batch
+    bool EraseBlockIndexes(const std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
+                           const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &addressUnspentIndex,
+                           const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &spentIndex);
     bool ReadSpentIndex(CSpentIndexKey &key, CSpentIndexValue &value);
+    //! Look up many keys at once; values of unspent outputs are left null
+    bool ReadSpentIndexes(const std::vector<CSpentIndexKey> &keys, std::vector<CSpentIndexValue> &values);
+    CSpentIndexCache::Stats GetSpentIndexCacheStats() const;
     bool UpdateSpentIndex(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> >&vect);
     bool UpdateAddressUnspentIndex(const std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue > >&vect);
     bool ReadAddressUnspentIndex(uint160 addressHash, int type,
-                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect);
+                                 std::vector<std::pair<CAddressUnspentKey, CAddressUnspentValue> > &vect,
+                                 const CAddressUnspentFilter &filter = CAddressUnspentFilter(),
+                                 const CDBSnapshot *psnapshot = NULL);
     bool WriteAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
     bool EraseAddressIndex(const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect);
+    //! The address reads below take an optional snapshot (see CDBSnapshot) to read from
+    CAddressIndexCursor *AddressIndexCursor(uint160 addressHash, int type, int start = 0, int end = 0,
+                                            const CAddressIndexKey *pafter = NULL, const CDBSnapshot *psnapshot = NULL);
+    CAddressIndexMergeCursor *AddressIndexMergeCursor(const std::vector<std::pair<uint160, int> > &addresses, int start = 0, int end = 0,
+                                                      const CAddressIndexKey *pafter = NULL, const CDBSnapshot *psnapshot = NULL);
+    bool ReadAddressSummaryIndex(uint160 addressHash, int type, CAddressSummaryValue &summary,
+                                 const CDBSnapshot *psnapshot = NULL);
+    bool BuildAddressSummaryIndex();
     bool ReadAddressIndex(uint160 addressHash, int type,
                           std::vector<std::pair<CAddressIndexKey, CAmount> > &addressIndex,
-                          int start = 0, int end = 0);
+                          int start = 0, int end = 0, const CDBSnapshot *psnapshot = NULL);
     bool WriteTimestampIndex(const CTimestampIndexKey &timestampIndex);
     bool ReadTimestampIndex(const unsigned int &high, const unsigned int &low, const bool fActiveOnly, std::vector<std::pair<uint256, unsigned int> > &vect);
     bool WriteTimestampBlockIndex(const CTimestampBlockIndexKey &blockhashIndex, const CTimestampBlockIndexValue &logicalts);
     bool ReadTimestampBlockIndex(const uint256 &hash, unsigned int &logicalTS);
     bool WriteFlag(const std::string &name, bool fValue);
     bool ReadFlag(const std::string &name, bool &fValue);
-    bool LoadBlockIndexGuts(boost::function<CBlockIndex*(const uint256&)> insertBlockIndex);
+    //! Move index rows written by older versions out of the block tree database
+    bool MigrateFromBlockTree(CBlockTreeDB &blocktree);
+    //! Convert address index rows written by older versions to the compact key format
+    bool UpgradeAddressIndex();
+private:
+    //! Apply (or with fErase, revert) one block's address index rows to the per-address summaries
+    void UpdateAddressSummaryIndex(CDBBatch &batch, const std::vector<std::pair<CAddressIndexKey, CAmount> > &vect, bool fErase);
+    void InvalidateSpentIndexCache(const std::vector<std::pair<CSpentIndexKey, CSpentIndexValue> > &vect);
 };
 
 #endif // BITCOIN_TXDB_H
@@ -450,11 +450,11 @@ bool CTxMemPool::addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry,
     return true;
 }
 
-void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view)
+void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view,
+                                 std::vector<std::pair<CAddressIndexKey, CAmount> > *pdeltas)
 {
     LOCK(cs);
     const CTransaction& tx = entry.GetTx();
-    std::vector<CMempoolAddressDeltaKey> inserted;
 
     uint256 txhash = tx.GetHash();
     for (unsigned int j = 0; j < tx.vin.size(); j++) {
@@ -464,14 +464,16 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
             vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+2, prevout.scriptPubKey.begin()+22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            mapAddress.insert(CMempoolAddressDeltaEntry(key, delta));
+            if (pdeltas)
+                pdeltas->push_back(std::make_pair(CAddressIndexKey(key.type, key.addressBytes, -1, 0, txhash, j, true), delta.amount));
         } else if (prevout.scriptPubKey.IsPayToPublicKeyHash()) {
             vector<unsigned char> hashBytes(prevout.scriptPubKey.begin()+3, prevout.scriptPubKey.begin()+23);
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, j, 1);
             CMempoolAddressDelta delta(entry.GetTime(), prevout.nValue * -1, input.prevout.hash, input.prevout.n);
-            mapAddress.insert(make_pair(key, delta));
-            inserted.push_back(key);
+            mapAddress.insert(CMempoolAddressDeltaEntry(key, delta));
+            if (pdeltas)
+                pdeltas->push_back(std::make_pair(CAddressIndexKey(key.type, key.addressBytes, -1, 0, txhash, j, true), delta.amount));
         }
     }
 
@@ -480,30 +482,41 @@ void CTxMemPool::addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewC
         if (out.scriptPubKey.IsPayToScriptHash()) {
             vector<unsigned char> hashBytes(out.scriptPubKey.begin()+2, out.scriptPubKey.begin()+22);
             CMempoolAddressDeltaKey key(2, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            mapAddress.insert(CMempoolAddressDeltaEntry(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+            if (pdeltas)
+                pdeltas->push_back(std::make_pair(CAddressIndexKey(key.type, key.addressBytes, -1, 0, txhash, k, false), out.nValue));
         } else if (out.scriptPubKey.IsPayToPublicKeyHash()) {
             vector<unsigned char> hashBytes(out.scriptPubKey.begin()+3, out.scriptPubKey.begin()+23);
-            std::pair<addressDeltaMap::iterator,bool> ret;
             CMempoolAddressDeltaKey key(1, uint160(hashBytes), txhash, k, 0);
-            mapAddress.insert(make_pair(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
-            inserted.push_back(key);
+            mapAddress.insert(CMempoolAddressDeltaEntry(key, CMempoolAddressDelta(entry.GetTime(), out.nValue)));
+            if (pdeltas)
+                pdeltas->push_back(std::make_pair(CAddressIndexKey(key.type, key.addressBytes, -1, 0, txhash, k, false), out.nValue));
         }
     }
+}
 
-    mapAddressInserted.insert(make_pair(txhash, inserted));
+static bool CompareAddressDeltaByTime(const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& a,
+                                      const std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta>& b)
+{
+    return a.second.time < b.second.time;
 }
 
 bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                                  std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results)
 {
     LOCK(cs);
+    const size_t nStart = results.size();
     for (std::vector<std::pair<uint160, int> >::iterator it = addresses.begin(); it != addresses.end(); it++) {
-        addressDeltaMap::iterator ait = mapAddress.lower_bound(CMempoolAddressDeltaKey((*it).second, (*it).first));
-        while (ait != mapAddress.end() && (*ait).first.addressBytes == (*it).first && (*ait).first.type == (*it).second) {
-            results.push_back(*ait);
+        const size_t nMerged = results.size();
+        // Sorts before all deltas of the address
+        CMempoolAddressDeltaEntry first(CMempoolAddressDeltaKey((*it).second, (*it).first), CMempoolAddressDelta(std::numeric_limits<int64_t>::min(), 0));
+        addressDeltaIndex::iterator ait = mapAddress.lower_bound(first);
+        while (ait != mapAddress.end() && ait->key.addressBytes == (*it).first && ait->key.type == (*it).second) {
+            results.push_back(std::make_pair(ait->key, ait->delta));
             ait++;
         }
+        // The deltas of each address are in time order already
+        std::inplace_merge(results.begin() + nStart, results.begin() + nMerged, results.end(), CompareAddressDeltaByTime);
     }
     return true;
 }
@@ -511,15 +524,9 @@ bool CTxMemPool::getAddressIndex(std::vector<std::pair<uint160, int> > &addresse
 bool CTxMemPool::removeAddressIndex(const uint256 txhash)
 {
     LOCK(cs);
-    addressDeltaMapInserted::iterator it = mapAddressInserted.find(txhash);
-
-    if (it != mapAddressInserted.end()) {
-        std::vector<CMempoolAddressDeltaKey> keys = (*it).second;
-        for (std::vector<CMempoolAddressDeltaKey>::iterator mit = keys.begin(); mit != keys.end(); mit++) {
-            mapAddress.erase(*mit);
-        }
-        mapAddressInserted.erase(it);
-    }
+    addressDeltaIndex::nth_index<1>::type& byTxid = mapAddress.get<1>();
+    std::pair<addressDeltaIndex::nth_index<1>::type::iterator, addressDeltaIndex::nth_index<1>::type::iterator> range = byTxid.equal_range(txhash);
+    byTxid.erase(range.first, range.second);
 
     return true;
 }
@@ -770,6 +777,9 @@ void CTxMemPool::_clear()
     mapLinks.clear();
     mapTx.clear();
     mapNextTx.clear();
+    mapAddress.clear();
+    mapSpent.clear();
+    mapSpentInserted.clear();
     totalTxSize = 0;
     cachedInnerUsage = 0;
     lastRollingFeeUpdate = GetTime();
@@ -878,7 +888,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             waitingOnDependants.push_back(&(*it));
         else {
             CValidationState state;
-            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, NULL));
+            assert(CheckInputs(tx, state, mempoolDuplicate, false, 0, false, false, NULL));
             UpdateCoins(tx, mempoolDuplicate, 1000000);
         }
     }
@@ -892,7 +902,7 @@ void CTxMemPool::check(const CCoinsViewCache *pcoins) const
             stepsSinceLastRemove++;
             assert(stepsSinceLastRemove < waitingOnDependants.size());
         } else {
-            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, NULL));
+            assert(CheckInputs(entry->GetTx(), state, mempoolDuplicate, false, 0, false, false, NULL));
             UpdateCoins(entry->GetTx(), mempoolDuplicate, 1000000);
             stepsSinceLastRemove = 0;
         }
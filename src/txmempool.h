@@ -219,6 +219,16 @@ struct mempoolentry_txid
     }
 };
 
+// extracts a CMempoolAddressDeltaEntry's transaction hash
+struct mempooladdressdelta_txid
+{
+    typedef uint256 result_type;
+    result_type operator() (const CMempoolAddressDeltaEntry &entry) const
+    {
+        return entry.key.txhash;
+    }
+};
+
 /** \class CompareTxMemPoolEntryByDescendantScore
  *
  *  Sort an entry by max(score/size of entry's tx, score/size with all descendants).
@@ -486,11 +496,19 @@ private:
     typedef std::map<txiter, TxLinks, CompareIteratorByHash> txlinksMap;
     txlinksMap mapLinks;
 
-    typedef std::map<CMempoolAddressDeltaKey, CMempoolAddressDelta, CMempoolAddressDeltaKeyCompare> addressDeltaMap;
-    addressDeltaMap mapAddress;
-
-    typedef std::map<uint256, std::vector<CMempoolAddressDeltaKey> > addressDeltaMapInserted;
-    addressDeltaMapInserted mapAddressInserted;
+    typedef boost::multi_index_container<
+        CMempoolAddressDeltaEntry,
+        boost::multi_index::indexed_by<
+            // sorted by address, then entry time
+            boost::multi_index::ordered_unique<
+                boost::multi_index::identity<CMempoolAddressDeltaEntry>,
+                CMempoolAddressDeltaEntryCompare
+            >,
+            // grouped by txid, to remove the deltas of a transaction
+            boost::multi_index::hashed_non_unique<mempooladdressdelta_txid, SaltedTxidHasher>
+        >
+    > addressDeltaIndex;
+    addressDeltaIndex mapAddress;
 
     typedef std::map<CSpentIndexKey, CSpentIndexValue, CSpentIndexKeyCompare> mapSpentIndex;
     mapSpentIndex mapSpent;
@@ -531,7 +549,10 @@ public:
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, bool fCurrentEstimate = true);
     bool addUnchecked(const uint256& hash, const CTxMemPoolEntry &entry, setEntries &setAncestors, bool fCurrentEstimate = true);
 
-    void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view);
+    /** Add the address deltas of a transaction; if pdeltas is set, also return them as address index keys with block height -1 */
+    void addAddressIndex(const CTxMemPoolEntry &entry, const CCoinsViewCache &view,
+                         std::vector<std::pair<CAddressIndexKey, CAmount> > *pdeltas = NULL);
+    /** Append the deltas of the addresses to results, ordered by the time their transaction entered the mempool */
     bool getAddressIndex(std::vector<std::pair<uint160, int> > &addresses,
                          std::vector<std::pair<CMempoolAddressDeltaKey, CMempoolAddressDelta> > &results);
     bool removeAddressIndex(const uint256 txhash);
@@ -6,6 +6,10 @@
 #ifndef BITCOIN_VALIDATIONINTERFACE_H
 #define BITCOIN_VALIDATIONINTERFACE_H
 
+#include "amount.h"
+
+#include <vector>
+
 #include <boost/signals2/signal.hpp>
 #include <boost/shared_ptr.hpp>
 
@@ -18,6 +22,15 @@ class CTransaction;
 class CValidationInterface;
 class CValidationState;
 class uint256;
+struct CAddressIndexKey;
+
+/** What caused the address index deltas that are notified */
+enum AddressDeltaEvent
+{
+    ADDRESS_DELTA_MEMPOOL = 0,      //!< A transaction was accepted to the mempool
+    ADDRESS_DELTA_CONNECTED = 1,    //!< A block was connected
+    ADDRESS_DELTA_DISCONNECTED = 2, //!< A block was disconnected
+};
 
 // These functions dispatch to one or all registered wallets
 
@@ -41,6 +54,7 @@ protected:
     virtual void BlockChecked(const CBlock&, const CValidationState&) {}
     virtual void GetScriptForMining(boost::shared_ptr<CReserveScript>&) {};
     virtual void ResetRequestCount(const uint256 &hash) {};
+    virtual void AddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &deltas, AddressDeltaEvent event) {};
     friend void ::RegisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterValidationInterface(CValidationInterface*);
     friend void ::UnregisterAllValidationInterfaces();
@@ -65,6 +79,11 @@ struct CMainSignals {
     boost::signals2::signal<void (boost::shared_ptr<CReserveScript>&)> ScriptForMining;
     /** Notifies listeners that a block has been successfully mined */
     boost::signals2::signal<void (const uint256 &)> BlockFound;
+    /**
+     * Notifies listeners of the address index deltas of a block or a mempool transaction (with -addressindex only).
+     * Mempool deltas have block height -1. The deltas of a disconnected block are those it added when connected.
+     */
+    boost::signals2::signal<void (const std::vector<std::pair<CAddressIndexKey, CAmount> > &, AddressDeltaEvent)> AddressDeltas;
 };
 
 CMainSignals& GetMainSignals();
@@ -20,3 +20,8 @@ bool CZMQAbstractNotifier::NotifyTransaction(const CTransaction &/*transaction*/
 {
     return true;
 }
+
+bool CZMQAbstractNotifier::NotifyAddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &/*deltas*/, AddressDeltaEvent /*event*/)
+{
+    return true;
+}
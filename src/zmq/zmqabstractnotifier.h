@@ -6,16 +6,21 @@
 #define BITCOIN_ZMQ_ZMQABSTRACTNOTIFIER_H
 
 #include "zmqconfig.h"
+#include "validationinterface.h"
+
+#include <vector>
 
 class CBlockIndex;
+struct CAddressIndexKey;
 class CZMQAbstractNotifier;
+class CZMQPublishQueue;
 
 typedef CZMQAbstractNotifier* (*CZMQNotifierFactory)();
 
 class CZMQAbstractNotifier
 {
 public:
-    CZMQAbstractNotifier() : psocket(0) { }
+    CZMQAbstractNotifier() : psocket(0), pqueue(0) { }
     virtual ~CZMQAbstractNotifier();
 
     template <typename T>
@@ -28,15 +33,18 @@ public:
     void SetType(const std::string &t) { type = t; }
     std::string GetAddress() const { return address; }
     void SetAddress(const std::string &a) { address = a; }
+    void SetPublishQueue(CZMQPublishQueue *q) { pqueue = q; }
 
     virtual bool Initialize(void *pcontext) = 0;
     virtual void Shutdown() = 0;
 
     virtual bool NotifyBlock(const CBlockIndex *pindex);
     virtual bool NotifyTransaction(const CTransaction &transaction);
+    virtual bool NotifyAddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &deltas, AddressDeltaEvent event);
 
 protected:
     void *psocket;
+    CZMQPublishQueue *pqueue;
     std::string type;
     std::string address;
 };
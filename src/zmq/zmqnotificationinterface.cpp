@@ -9,13 +9,18 @@
 #include "main.h"
 #include "streams.h"
 #include "util.h"
+#include "utilstrencodings.h"
+
+#include <algorithm>
+
+CZMQNotificationInterface* pzmqNotificationInterface = NULL;
 
 void zmqError(const char *str)
 {
     LogPrint("zmq", "zmq: Error: %s, errno=%s\n", str, zmq_strerror(errno));
 }
 
-CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL)
+CZMQNotificationInterface::CZMQNotificationInterface() : pcontext(NULL), pqueue(NULL)
 {
 }
 
@@ -23,10 +28,17 @@ CZMQNotificationInterface::~CZMQNotificationInterface()
 {
     Shutdown();
 
-    for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
+    for (std::vector<CZMQAbstractPublishNotifier*>::iterator i=vPublishNotifiers.begin(); i!=vPublishNotifiers.end(); ++i)
     {
         delete *i;
     }
+    delete pqueue;
+}
+
+static int64_t GetIntArgument(const std::map<std::string, std::string> &args, const std::string &strArg, int64_t nDefault)
+{
+    std::map<std::string, std::string>::const_iterator i = args.find(strArg);
+    return i != args.end() ? atoi64(i->second) : nDefault;
 }
 
 CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const std::map<std::string, std::string> &args)
@@ -34,11 +46,13 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
     CZMQNotificationInterface* notificationInterface = NULL;
     std::map<std::string, CZMQNotifierFactory> factories;
     std::list<CZMQAbstractNotifier*> notifiers;
+    std::vector<CZMQAbstractPublishNotifier*> vPublishNotifiers;
 
     factories["pubhashblock"] = CZMQAbstractNotifier::Create<CZMQPublishHashBlockNotifier>;
     factories["pubhashtx"] = CZMQAbstractNotifier::Create<CZMQPublishHashTransactionNotifier>;
     factories["pubrawblock"] = CZMQAbstractNotifier::Create<CZMQPublishRawBlockNotifier>;
     factories["pubrawtx"] = CZMQAbstractNotifier::Create<CZMQPublishRawTransactionNotifier>;
+    factories["pubaddresstx"] = CZMQAbstractNotifier::Create<CZMQPublishAddressTransactionNotifier>;
 
     for (std::map<std::string, CZMQNotifierFactory>::const_iterator i=factories.begin(); i!=factories.end(); ++i)
     {
@@ -51,13 +65,23 @@ CZMQNotificationInterface* CZMQNotificationInterface::CreateWithArguments(const
             notifier->SetType(i->first);
             notifier->SetAddress(address);
             notifiers.push_back(notifier);
+            vPublishNotifiers.push_back(static_cast<CZMQAbstractPublishNotifier*>(notifier));
         }
     }
 
     if (!notifiers.empty())
     {
+        ZMQDropPolicy policy = ZMQ_DROP_NEWEST;
+        std::map<std::string, std::string>::const_iterator j = args.find("-zmqpubdroppolicy");
+        ParseZMQDropPolicy(j != args.end() ? j->second : DEFAULT_ZMQ_DROP_POLICY, policy);
+
         notificationInterface = new CZMQNotificationInterface();
         notificationInterface->notifiers = notifiers;
+        notificationInterface->vPublishNotifiers = vPublishNotifiers;
+        notificationInterface->pqueue = new CZMQPublishQueue(
+            std::max(GetIntArgument(args, "-zmqpubqueuesize", DEFAULT_ZMQ_PUBLISH_QUEUE_SIZE), (int64_t)1),
+            std::max(GetIntArgument(args, "-zmqpubqueuemaxmem", DEFAULT_ZMQ_PUBLISH_QUEUE_MAXMEM), (int64_t)1) * 1024 * 1024,
+            policy);
 
         if (!notificationInterface->Initialize())
         {
@@ -87,6 +111,7 @@ bool CZMQNotificationInterface::Initialize()
     for (; i!=notifiers.end(); ++i)
     {
         CZMQAbstractNotifier *notifier = *i;
+        notifier->SetPublishQueue(pqueue);
         if (notifier->Initialize(pcontext))
         {
             LogPrint("zmq", "  Notifier %s ready (address = %s)\n", notifier->GetType(), notifier->GetAddress());
@@ -103,6 +128,8 @@ bool CZMQNotificationInterface::Initialize()
         return false;
     }
 
+    pqueue->Start();
+
     return true;
 }
 
@@ -112,6 +139,9 @@ void CZMQNotificationInterface::Shutdown()
     LogPrint("zmq", "zmq: Shutdown notification interface\n");
     if (pcontext)
     {
+        // Stop publishing before the sockets are closed
+        pqueue->Stop();
+
         for (std::list<CZMQAbstractNotifier*>::iterator i=notifiers.begin(); i!=notifiers.end(); ++i)
         {
             CZMQAbstractNotifier *notifier = *i;
@@ -124,6 +154,11 @@ void CZMQNotificationInterface::Shutdown()
     }
 }
 
+CZMQPublishQueue::Stats CZMQNotificationInterface::GetQueueStats() const
+{
+    return pqueue->GetStats();
+}
+
 void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
@@ -141,6 +176,23 @@ void CZMQNotificationInterface::UpdatedBlockTip(const CBlockIndex *pindex)
     }
 }
 
+void CZMQNotificationInterface::AddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &deltas, AddressDeltaEvent event)
+{
+    for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
+    {
+        CZMQAbstractNotifier *notifier = *i;
+        if (notifier->NotifyAddressDeltas(deltas, event))
+        {
+            i++;
+        }
+        else
+        {
+            notifier->Shutdown();
+            i = notifiers.erase(i);
+        }
+    }
+}
+
 void CZMQNotificationInterface::SyncTransaction(const CTransaction& tx, const CBlockIndex* pindex, const CBlock* pblock)
 {
     for (std::list<CZMQAbstractNotifier*>::iterator i = notifiers.begin(); i!=notifiers.end(); )
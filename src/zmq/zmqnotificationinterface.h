@@ -6,11 +6,13 @@
 #define BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
 
 #include "validationinterface.h"
+#include "zmqpublishqueue.h"
 #include <string>
 #include <map>
 
 class CBlockIndex;
 class CZMQAbstractNotifier;
+class CZMQAbstractPublishNotifier;
 
 class CZMQNotificationInterface : public CValidationInterface
 {
@@ -19,6 +21,10 @@ public:
 
     static CZMQNotificationInterface* CreateWithArguments(const std::map<std::string, std::string> &args);
 
+    CZMQPublishQueue::Stats GetQueueStats() const;
+    //! The notifiers; these are not removed or deleted until shutdown
+    const std::vector<CZMQAbstractPublishNotifier*>& GetPublishNotifiers() const { return vPublishNotifiers; }
+
 protected:
     bool Initialize();
     void Shutdown();
@@ -26,12 +32,17 @@ protected:
     // CValidationInterface
     void SyncTransaction(const CTransaction& tx, const CBlockIndex *pindex, const CBlock* pblock);
     void UpdatedBlockTip(const CBlockIndex *pindex);
+    void AddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &deltas, AddressDeltaEvent event);
 
 private:
     CZMQNotificationInterface();
 
     void *pcontext;
     std::list<CZMQAbstractNotifier*> notifiers;
+    std::vector<CZMQAbstractPublishNotifier*> vPublishNotifiers;
+    CZMQPublishQueue *pqueue;
 };
 
+extern CZMQNotificationInterface* pzmqNotificationInterface;
+
 #endif // BITCOIN_ZMQ_ZMQNOTIFICATIONINTERFACE_H
@@ -2,17 +2,21 @@
 // Distributed under the MIT software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
+#include "addressindex.h"
 #include "chainparams.h"
 #include "zmqpublishnotifier.h"
 #include "main.h"
 #include "util.h"
 
+#include <algorithm>
+
 static std::multimap<std::string, CZMQAbstractPublishNotifier*> mapPublishNotifiers;
 
 static const char *MSG_HASHBLOCK = "hashblock";
 static const char *MSG_HASHTX    = "hashtx";
 static const char *MSG_RAWBLOCK  = "rawblock";
 static const char *MSG_RAWTX     = "rawtx";
+static const char *MSG_ADDRESSTX = "addresstx";
 
 // Internal function to send multipart message
 static int zmq_send_multipart(void *sock, const void* data, size_t size, ...)
@@ -125,21 +129,41 @@ void CZMQAbstractPublishNotifier::Shutdown()
 
 bool CZMQAbstractPublishNotifier::SendMessage(const char *command, const void* data, size_t size)
 {
-    assert(psocket);
+    return SendMessage(command, strlen(command), data, size);
+}
 
-    /* send three parts, command & data & a LE 4byte sequence number */
-    unsigned char msgseq[sizeof(uint32_t)];
-    WriteLE32(&msgseq[0], nSequence);
-    int rc = zmq_send_multipart(psocket, command, strlen(command), data, size, msgseq, (size_t)sizeof(uint32_t), (void*)0);
-    if (rc == -1)
-        return false;
+bool CZMQAbstractPublishNotifier::SendMessage(const void *topic, size_t topicSize, const void* data, size_t size)
+{
+    assert(pqueue);
 
-    /* increment memory only sequence number after sending */
-    nSequence++;
+    std::vector<unsigned char> vTopic((const unsigned char*)topic, (const unsigned char*)topic + topicSize);
+    std::vector<unsigned char> vBody((const unsigned char*)data, (const unsigned char*)data + size);
+    pqueue->Push(this, vTopic, vBody);
 
     return true;
 }
 
+void CZMQAbstractPublishNotifier::Publish(CZMQPendingMessage &msg)
+{
+    assert(psocket);
+
+    if (msg.pindex && !PrepareMessage(msg)) {
+        nFailed++;
+        return;
+    }
+
+    /* send three parts, topic & data & a LE 4byte sequence number */
+    unsigned char msgseq[sizeof(uint32_t)];
+    WriteLE32(&msgseq[0], msg.nSequence);
+    int rc = zmq_send_multipart(psocket, msg.topic.data(), msg.topic.size(), msg.body.data(), msg.body.size(), msgseq, (size_t)sizeof(uint32_t), (void*)0);
+    if (rc == -1) {
+        nFailed++;
+        return;
+    }
+
+    nPublished++;
+}
+
 bool CZMQPublishHashBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     uint256 hash = pindex->GetBlockHash();
@@ -164,21 +188,34 @@ bool CZMQPublishRawBlockNotifier::NotifyBlock(const CBlockIndex *pindex)
 {
     LogPrint("zmq", "zmq: Publish rawblock %s\n", pindex->GetBlockHash().GetHex());
 
-    const Consensus::Params& consensusParams = Params().GetConsensus();
-    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    // The block is read from disk by the publisher thread
+    assert(pqueue);
+    std::vector<unsigned char> vTopic(MSG_RAWBLOCK, MSG_RAWBLOCK + strlen(MSG_RAWBLOCK));
+    std::vector<unsigned char> vBody;
+    pqueue->Push(this, vTopic, vBody, pindex);
+
+    return true;
+}
+
+bool CZMQPublishRawBlockNotifier::PrepareMessage(CZMQPendingMessage &msg)
+{
+    CDiskBlockPos pos;
     {
         LOCK(cs_main);
-        CBlock block;
-        if(!ReadBlockFromDisk(block, pindex, consensusParams))
-        {
-            zmqError("Can't read block from disk");
-            return false;
-        }
+        pos = msg.pindex->GetBlockPos();
+    }
 
-        ss << block;
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pos, Params().GetConsensus()) || block.GetHash() != msg.pindex->GetBlockHash())
+    {
+        zmqError("Can't read block from disk");
+        return false;
     }
 
-    return SendMessage(MSG_RAWBLOCK, &(*ss.begin()), ss.size());
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block;
+    msg.body.assign(ss.begin(), ss.end());
+    return true;
 }
 
 bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &transaction)
@@ -189,3 +226,56 @@ bool CZMQPublishRawTransactionNotifier::NotifyTransaction(const CTransaction &tr
     ss << transaction;
     return SendMessage(MSG_RAWTX, &(*ss.begin()), ss.size());
 }
+
+static bool CompareAddressDeltaByTxAndAddress(const std::pair<CAddressIndexKey, CAmount> *a, const std::pair<CAddressIndexKey, CAmount> *b)
+{
+    if (a->first.txindex != b->first.txindex)
+        return a->first.txindex < b->first.txindex;
+    if (a->first.txhash != b->first.txhash)
+        return a->first.txhash < b->first.txhash;
+    if (a->first.type != b->first.type)
+        return a->first.type < b->first.type;
+    return a->first.hashBytes < b->first.hashBytes;
+}
+
+static bool SameTxAndAddress(const CAddressIndexKey &a, const CAddressIndexKey &b)
+{
+    return a.txhash == b.txhash && a.type == b.type && a.hashBytes == b.hashBytes;
+}
+
+bool CZMQPublishAddressTransactionNotifier::NotifyAddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &deltas, AddressDeltaEvent event)
+{
+    // Group the deltas by transaction, in block order, and by address
+    std::vector<const std::pair<CAddressIndexKey, CAmount>*> vSorted;
+    vSorted.reserve(deltas.size());
+    for (unsigned int i = 0; i < deltas.size(); i++)
+        vSorted.push_back(&deltas[i]);
+    std::stable_sort(vSorted.begin(), vSorted.end(), CompareAddressDeltaByTxAndAddress);
+
+    std::vector<const std::pair<CAddressIndexKey, CAmount>*>::const_iterator it = vSorted.begin();
+    while (it != vSorted.end()) {
+        const CAddressIndexKey &key = (*it)->first;
+
+        // topic: "addresstx", address type (1 byte), address hash (20 bytes)
+        std::vector<unsigned char> topic(MSG_ADDRESSTX, MSG_ADDRESSTX + strlen(MSG_ADDRESSTX));
+        topic.push_back(key.type);
+        topic.insert(topic.end(), key.hashBytes.begin(), key.hashBytes.end());
+
+        // body: event (1 byte), txid (32 bytes), block height (LE int32, -1 in the mempool), number of
+        // records (compact size), then per record the input or output index (LE uint32), a flag that
+        // is 1 for inputs (1 byte) and the amount in satoshis (LE int64, negative for inputs)
+        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+        std::vector<const std::pair<CAddressIndexKey, CAmount>*>::const_iterator end = it;
+        while (end != vSorted.end() && SameTxAndAddress((*end)->first, key))
+            end++;
+        ss << (unsigned char)event << key.txhash << (int32_t)key.blockHeight;
+        WriteCompactSize(ss, end - it);
+        for (; it != end; it++)
+            ss << (uint32_t)(*it)->first.index << (unsigned char)(*it)->first.spending << (*it)->second;
+
+        LogPrint("zmq", "zmq: Publish addresstx %s for %s\n", key.txhash.GetHex(), key.hashBytes.GetHex());
+        if (!SendMessage(&topic[0], topic.size(), &(*ss.begin()), ss.size()))
+            return false;
+    }
+    return true;
+}
@@ -6,23 +6,44 @@
 #define BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
 
 #include "zmqabstractnotifier.h"
+#include "zmqpublishqueue.h"
+
+#include <atomic>
 
 class CBlockIndex;
 
 class CZMQAbstractPublishNotifier : public CZMQAbstractNotifier
 {
+    friend class CZMQPublishQueue;
+
 private:
-    uint32_t nSequence; //! upcounting per message sequence number
+    std::atomic<uint32_t> nSequence; //! upcounting per message sequence number, assigned when queued
+    std::atomic<uint64_t> nPublished;
+    std::atomic<uint64_t> nDropped;  //! dropped because the publish queue was full
+    std::atomic<uint64_t> nFailed;
 
 public:
+    CZMQAbstractPublishNotifier() : nSequence(0), nPublished(0), nDropped(0), nFailed(0) { }
 
-    /* send zmq multipart message
+    /* queue a zmq multipart message for the publisher thread
        parts:
           * command
           * data
           * message sequence number
     */
     bool SendMessage(const char *command, const void* data, size_t size);
+    /* same, with a binary topic */
+    bool SendMessage(const void *topic, size_t topicSize, const void* data, size_t size);
+
+    /** Send a queued message, on the publisher thread */
+    void Publish(CZMQPendingMessage &msg);
+    /** Build the body of a message queued with a block index, on the publisher thread */
+    virtual bool PrepareMessage(CZMQPendingMessage &msg) { return true; }
+
+    uint32_t GetSequence() const { return nSequence; }
+    uint64_t GetPublishedCount() const { return nPublished; }
+    uint64_t GetDroppedCount() const { return nDropped; }
+    uint64_t GetFailedCount() const { return nFailed; }
 
     bool Initialize(void *pcontext);
     void Shutdown();
@@ -44,6 +65,7 @@ class CZMQPublishRawBlockNotifier : public CZMQAbstractPublishNotifier
 {
 public:
     bool NotifyBlock(const CBlockIndex *pindex);
+    bool PrepareMessage(CZMQPendingMessage &msg);
 };
 
 class CZMQPublishRawTransactionNotifier : public CZMQAbstractPublishNotifier
@@ -52,4 +74,15 @@ public:
     bool NotifyTransaction(const CTransaction &transaction);
 };
 
+/**
+ * Publishes the address index deltas of mempool transactions and of connected
+ * and disconnected blocks, one message per transaction and address. The topic
+ * ends with the address, so subscribers can filter by address prefix.
+ */
+class CZMQPublishAddressTransactionNotifier : public CZMQAbstractPublishNotifier
+{
+public:
+    bool NotifyAddressDeltas(const std::vector<std::pair<CAddressIndexKey, CAmount> > &deltas, AddressDeltaEvent event);
+};
+
 #endif // BITCOIN_ZMQ_ZMQPUBLISHNOTIFIER_H
@@ -0,0 +1,136 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmqpublishqueue.h"
+#include "zmqpublishnotifier.h"
+
+#include "util.h"
+
+#include <boost/bind.hpp>
+
+bool ParseZMQDropPolicy(const std::string &str, ZMQDropPolicy &policy)
+{
+    if (str == "newest")
+        policy = ZMQ_DROP_NEWEST;
+    else if (str == "oldest")
+        policy = ZMQ_DROP_OLDEST;
+    else
+        return false;
+    return true;
+}
+
+std::string ZMQDropPolicyName(ZMQDropPolicy policy)
+{
+    return policy == ZMQ_DROP_OLDEST ? "oldest" : "newest";
+}
+
+static size_t PendingMessageSize(const CZMQPendingMessage &msg)
+{
+    return msg.topic.size() + msg.body.size();
+}
+
+CZMQPublishQueue::CZMQPublishQueue(size_t nMaxSizeIn, size_t nMaxBytesIn, ZMQDropPolicy policyIn) :
+    nBytes(0), nMaxSize(std::max(nMaxSizeIn, (size_t)1)), nMaxBytes(nMaxBytesIn), policy(policyIn), fRunning(false)
+{
+}
+
+CZMQPublishQueue::~CZMQPublishQueue()
+{
+    Stop();
+}
+
+void CZMQPublishQueue::Start()
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    assert(!fRunning);
+    fRunning = true;
+    thread = boost::thread(boost::bind(&CZMQPublishQueue::Thread, this));
+}
+
+void CZMQPublishQueue::Stop()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (!fRunning)
+            return;
+        fRunning = false;
+    }
+    cond.notify_all();
+    thread.join();
+
+    boost::unique_lock<boost::mutex> lock(mutex);
+    if (!queue.empty())
+        LogPrint("zmq", "zmq: Discarding %u unpublished messages\n", queue.size());
+    queue.clear();
+    nBytes = 0;
+}
+
+void CZMQPublishQueue::PopFront()
+{
+    nBytes -= PendingMessageSize(queue.front());
+    queue.pop_front();
+}
+
+void CZMQPublishQueue::Push(CZMQAbstractPublishNotifier *notifier, std::vector<unsigned char> &topic, std::vector<unsigned char> &body, const CBlockIndex *pindex)
+{
+    size_t nSize = topic.size() + body.size();
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        uint32_t nSequence = notifier->nSequence++;
+
+        bool fFull = queue.size() >= nMaxSize || nBytes + nSize > nMaxBytes;
+        if (fFull && policy == ZMQ_DROP_OLDEST) {
+            while (!queue.empty() && (queue.size() >= nMaxSize || nBytes + nSize > nMaxBytes)) {
+                queue.front().notifier->nDropped++;
+                PopFront();
+            }
+            fFull = nSize > nMaxBytes;
+        }
+        if (fFull) {
+            notifier->nDropped++;
+            return;
+        }
+
+        queue.push_back(CZMQPendingMessage());
+        CZMQPendingMessage &msg = queue.back();
+        msg.notifier = notifier;
+        msg.topic.swap(topic);
+        msg.body.swap(body);
+        msg.nSequence = nSequence;
+        msg.pindex = pindex;
+        nBytes += nSize;
+    }
+    cond.notify_one();
+}
+
+CZMQPublishQueue::Stats CZMQPublishQueue::GetStats() const
+{
+    boost::unique_lock<boost::mutex> lock(mutex);
+    Stats stats;
+    stats.nQueued = queue.size();
+    stats.nBytes = nBytes;
+    stats.nMaxSize = nMaxSize;
+    stats.nMaxBytes = nMaxBytes;
+    stats.policy = policy;
+    return stats;
+}
+
+void CZMQPublishQueue::Thread()
+{
+    RenameThread("bitcoin-zmqpub");
+    CZMQPendingMessage msg;
+    while (true) {
+        {
+            boost::unique_lock<boost::mutex> lock(mutex);
+            while (fRunning && queue.empty())
+                cond.wait(lock);
+            if (!fRunning)
+                return;
+            nBytes -= PendingMessageSize(queue.front());
+            std::swap(msg, queue.front());
+            queue.pop_front();
+        }
+        msg.notifier->Publish(msg);
+    }
+}
@@ -0,0 +1,96 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#ifndef BITCOIN_ZMQ_ZMQPUBLISHQUEUE_H
+#define BITCOIN_ZMQ_ZMQPUBLISHQUEUE_H
+
+#include <deque>
+#include <string>
+#include <vector>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+class CBlockIndex;
+class CZMQAbstractPublishNotifier;
+
+/** Which message to drop when the publish queue is full */
+enum ZMQDropPolicy
+{
+    ZMQ_DROP_NEWEST, //! drop the message being queued
+    ZMQ_DROP_OLDEST, //! drop the longest queued message to make room
+};
+
+//! -zmqpubqueuesize default (messages)
+static const unsigned int DEFAULT_ZMQ_PUBLISH_QUEUE_SIZE = 10000;
+//! -zmqpubqueuemaxmem default (MiB)
+static const unsigned int DEFAULT_ZMQ_PUBLISH_QUEUE_MAXMEM = 100;
+//! -zmqpubdroppolicy default
+static const char DEFAULT_ZMQ_DROP_POLICY[] = "newest";
+
+bool ParseZMQDropPolicy(const std::string &str, ZMQDropPolicy &policy);
+std::string ZMQDropPolicyName(ZMQDropPolicy policy);
+
+/** A message waiting to be published */
+struct CZMQPendingMessage
+{
+    CZMQAbstractPublishNotifier *notifier;
+    std::vector<unsigned char> topic;
+    std::vector<unsigned char> body;
+    uint32_t nSequence;
+    //! If set, the body is built from this block by the publisher thread
+    const CBlockIndex *pindex;
+
+    CZMQPendingMessage() : notifier(NULL), nSequence(0), pindex(NULL) {}
+};
+
+/**
+ * Bounded queue of messages, published by a dedicated thread so that a slow
+ * subscriber or a block read never holds up the validation signals.
+ *
+ * Queueing never waits for the publisher thread. When the queue holds
+ * nMaxSize messages or nMaxBytes bytes, a message is dropped according to the
+ * drop policy and counted against its notifier. Sequence numbers are assigned
+ * when a message is queued, so subscribers see dropped messages as gaps.
+ */
+class CZMQPublishQueue
+{
+public:
+    struct Stats {
+        size_t nQueued;
+        size_t nBytes;
+        size_t nMaxSize;
+        size_t nMaxBytes;
+        ZMQDropPolicy policy;
+    };
+
+    CZMQPublishQueue(size_t nMaxSizeIn, size_t nMaxBytesIn, ZMQDropPolicy policyIn);
+    ~CZMQPublishQueue();
+
+    void Start();
+    //! Stop the publisher thread, discarding the messages still queued
+    void Stop();
+
+    /** Queue a message for notifier; the topic and body are swapped out of the arguments */
+    void Push(CZMQAbstractPublishNotifier *notifier, std::vector<unsigned char> &topic, std::vector<unsigned char> &body, const CBlockIndex *pindex = NULL);
+
+    Stats GetStats() const;
+
+private:
+    mutable boost::mutex mutex;
+    boost::condition_variable cond;
+    std::deque<CZMQPendingMessage> queue;
+    size_t nBytes;
+    size_t nMaxSize;
+    size_t nMaxBytes;
+    ZMQDropPolicy policy;
+    bool fRunning;
+    boost::thread thread;
+
+    void Thread();
+    void PopFront();
+};
+
+#endif // BITCOIN_ZMQ_ZMQPUBLISHQUEUE_H
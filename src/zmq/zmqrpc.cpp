@@ -0,0 +1,88 @@
+// Copyright (c) 2016 The Bitcoin Core developers
+// Distributed under the MIT software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include "zmqrpc.h"
+
+#include "rpc/server.h"
+#include "utilstrencodings.h"
+#include "zmqnotificationinterface.h"
+#include "zmqpublishnotifier.h"
+
+#include <univalue.h>
+
+using namespace std;
+
+UniValue getzmqqueueinfo(const UniValue& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getzmqqueueinfo\n"
+            "\nReturns the state of the queue of ZMQ notifications waiting to be published, and the\n"
+            "counters of each notifier. Notifications are dropped when the queue is full (see\n"
+            "-zmqpubqueuesize, -zmqpubqueuemaxmem and -zmqpubdroppolicy).\n"
+            "\nResult:\n"
+            "{\n"
+            "  \"queued\": xxxxx,          (numeric) Notifications waiting to be published\n"
+            "  \"bytes\": xxxxx,           (numeric) Size of the notifications waiting to be published\n"
+            "  \"maxqueued\": xxxxx,       (numeric) Maximum number of notifications waiting to be published\n"
+            "  \"maxbytes\": xxxxx,        (numeric) Maximum size of the notifications waiting to be published\n"
+            "  \"droppolicy\": \"xxxx\",     (string) Notification dropped when the queue is full (newest or oldest)\n"
+            "  \"notifiers\": [            (array of json objects)\n"
+            "    {\n"
+            "      \"type\": \"xxxx\",       (string) Notification type, e.g. pubhashblock\n"
+            "      \"address\": \"xxxx\",    (string) Address of the publishing socket\n"
+            "      \"sequence\": xxxxx,    (numeric) Sequence number of the next notification\n"
+            "      \"published\": xxxxx,   (numeric) Notifications published since startup\n"
+            "      \"dropped\": xxxxx,     (numeric) Notifications dropped since startup because the queue was full\n"
+            "      \"failed\": xxxxx       (numeric) Notifications that could not be built or sent since startup\n"
+            "    }\n"
+            "    ,...\n"
+            "  ]\n"
+            "}\n"
+            "\nExamples:\n"
+            + HelpExampleCli("getzmqqueueinfo", "")
+            + HelpExampleRpc("getzmqqueueinfo", "")
+        );
+
+    if (!pzmqNotificationInterface)
+        throw JSONRPCError(RPC_MISC_ERROR, "ZMQ notifications not enabled");
+
+    CZMQPublishQueue::Stats stats = pzmqNotificationInterface->GetQueueStats();
+
+    UniValue obj(UniValue::VOBJ);
+    obj.push_back(Pair("queued", (uint64_t)stats.nQueued));
+    obj.push_back(Pair("bytes", (uint64_t)stats.nBytes));
+    obj.push_back(Pair("maxqueued", (uint64_t)stats.nMaxSize));
+    obj.push_back(Pair("maxbytes", (uint64_t)stats.nMaxBytes));
+    obj.push_back(Pair("droppolicy", ZMQDropPolicyName(stats.policy)));
+
+    UniValue notifiers(UniValue::VARR);
+    const std::vector<CZMQAbstractPublishNotifier*>& vNotifiers = pzmqNotificationInterface->GetPublishNotifiers();
+    for (unsigned int i = 0; i < vNotifiers.size(); i++) {
+        const CZMQAbstractPublishNotifier* notifier = vNotifiers[i];
+        UniValue entry(UniValue::VOBJ);
+        entry.push_back(Pair("type", notifier->GetType()));
+        entry.push_back(Pair("address", notifier->GetAddress()));
+        entry.push_back(Pair("sequence", (uint64_t)notifier->GetSequence()));
+        entry.push_back(Pair("published", notifier->GetPublishedCount()));
+        entry.push_back(Pair("dropped", notifier->GetDroppedCount()));
+        entry.push_back(Pair("failed", notifier->GetFailedCount()));
+        notifiers.push_back(entry);
+    }
+    obj.push_back(Pair("notifiers", notifiers));
+
+    return obj;
+}
+
+static const CRPCCommand commands[] =
+{ //  category              name                      actor (function)         okSafeMode  threadSafe
+  //  --------------------- ------------------------  -----------------------  ----------  ----------
+    { "zmq",                "getzmqqueueinfo",        &getzmqqueueinfo,        true,  true  },
+};
+
+void RegisterZMQRPCCommands(CRPCTable &tableRPC)
+{
+    for (unsigned int vcidx = 0; vcidx < ARRAYLEN(commands); vcidx++)
+        tableRPC.appendCommand(commands[vcidx].name, &commands[vcidx]);
+}